@@ -1,375 +1,918 @@
-/* This small demo sends a simple sinusoidal wave to your speakers.  */
+/* ALSA playback for the Linux platform layer. The game layer synthesizes the samples once per
+   frame into a ring kept just far enough ahead, as measured by the audio latency controller, the
+   same way the win32 layer does with its DirectSound buffer; a real-time thread moves them from
+   the ring into a short device buffer, so a long frame eats into the ring instead of
+   underrunning the device. */
 /* See http://alsamodular.sourceforge.net/alsa_programming_howto.html */
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sched.h>
-#include <errno.h>
-#include <getopt.h>
 #include <alsa/asoundlib.h>
-#include <sys/time.h>
-#include <math.h>
-
-// typedef int (*transfer_loop_fn) (snd_pcm_t * handle, signed short *samples,
-// snd_pcm_channel_area_t * areas); 
-typedef struct _sound_info_t sound_info_t;
-struct _sound_info_t {
-    char *device;		/* playback device */
-    snd_pcm_format_t format;	/* sample format */
-    snd_pcm_stream_t stream;	/* stream type */
-    snd_pcm_access_t access;	/* access type */
-    unsigned int rate;	/* stream rate */
-    unsigned int channel_count;	/* count of channels */
-    unsigned int buffer_time;	/* ring buffer length in us */
-    unsigned int period_time;	/* period time in us */
-    double tone_hz;		/* sinusoidal wave frequency in Hz */
-    int resample;		/* enable alsa-lib resampling */
-    int period_event = 0;	/* produce poll event after each period */
-    snd_pcm_sframes_t buffer_size;
-    snd_pcm_sframes_t period_size;
-    snd_output_t *output;
-    snd_pcm_t *handle;
-    snd_pcm_hw_params_t *hw_params;
-    snd_pcm_sw_params_t *sw_params;
-    // transfer_loop_fn transfer_loop;
-};
+#include <pthread.h>
+#include <sched.h>
 
-typedef struct _sound_buffer_t sound_buffer_t;
-struct _sound_buffer_t {
-    signed short *samples;
-    snd_pcm_channel_area_t *areas;
+#include "linux_sample_format.cc"
+#include "linux_sample_ring.cc"
+#include "linux_sound_sink.cc"
+
+struct linux_sound_output
+{
+    const char *device;            /* playback device */
+    snd_pcm_format_t format;       /* sample format */
+    snd_pcm_access_t access;       /* access type */
+    unsigned int samples_per_second;    /* stream rate */
+    unsigned int channel_count;    /* count of channels */
+    unsigned int buffer_time;      /* ring buffer length in us */
+    unsigned int period_time;      /* period time in us */
+    int resample;                  /* enable alsa-lib resampling */
+    unsigned int game_samples_per_second;       /* what the game mixes at */
+    snd_pcm_uframes_t buffer_size;
+    snd_pcm_uframes_t period_size;
+    audio_latency_controller latency;   /* how far ahead of the device the game stays */
+    snd_pcm_t *handle;             /* only touched by the sound thread once it runs */
+    linux_sound_sink sink;         /* what the sound thread writes to instead, if not ALSA */
+    linux_sample_ring ring;        /* filled by the game thread, drained by the sound thread */
+    int16 *silence;                /* 2 periods, for when the ring runs dry */
+
+    /* only when the device rate is not the game's: the game mixes into game_samples */
+    audio_resampler *resampler;
+    int16 *game_samples;
+
+    /* the sound thread sleeps in its own event loop on the PCM descriptors, but only while the
+       ring has something to give them; otherwise on wake_fd, which the game signals after every
+       fill and linux_free_sound to stop it */
+    pthread_t thread;
+    bool thread_running;
+    bool volatile stop_thread;
+    int wake_fd;
+    linux_event_loop event_loop;
+    struct pollfd *poll_fds;
+    int poll_fd_count;
+    bool pcm_armed;
+
+    /* published by the sound thread for the latency controller and the telemetry */
+    snd_pcm_sframes_t volatile device_delay;
+    audio_xrun_log xruns;
+
+    /* the audio clock, for pacing frames off the device: which device frame was playing at
+       what CLOCK_MONOTONIC time. published by the sound thread under clock_sequence, which is
+       odd while it writes */
+    bool has_clock;
+    uint32 volatile clock_sequence;
+    uint64 volatile clock_frame_position;
+    int64 volatile clock_time_ns;
+
+    /* sound thread only */
+    uint64 device_frame_count;     /* every frame handed to the device, silence too */
+    bool ring_ran_dry;             /* silence is covering for a late frame, already counted */
+    bool suspended;                /* waiting to resume, with the PCM descriptors out of the set */
+
+    /* converts the game's samples when the device did not take S16_LE */
+    linux_sample_format sample_format;
+    linux_sample_writer *write_samples;
+    int bytes_per_frame;
+    void *device_samples;
 };
 
-static void
-generate_sine (sound_buffer_t * sound_buffer, sound_info_t * sound_info,
-               snd_pcm_uframes_t offset, double *_phase, error_t ** error) {
-    static double max_phase = 2.0 * M_PI;
-    double phase = *_phase;
-    double step = max_phase * sound_info->tone_hz / (double) sound_info->rate;
-    unsigned char *samples[sound_info->channel_count];
-    int steps[sound_info->channel_count];
-    int bits_per_sample = snd_pcm_format_width (sound_info->format);
-    unsigned int maxval = (1 << (bits_per_sample - 1)) - 1;
-    int bytes_per_sample = bits_per_sample / 8;	/* bytes per sample */
-    int phys_bytes_per_sample = snd_pcm_format_physical_width (sound_info->format) / 8;
-    int big_endian = snd_pcm_format_big_endian (sound_info->format) == 1;
-    int to_unsigned = snd_pcm_format_unsigned (sound_info->format) == 1;
-    int is_float = (sound_info->format == SND_PCM_FORMAT_FLOAT_LE
-                    || sound_info->format == SND_PCM_FORMAT_FLOAT_BE);
-
-    error_return_if (is_float,, "float format not supported");
-
-    /* verify and prepare the contents of areas */
-    for (unsigned int channel_index = 0; channel_index < sound_info->channel_count;
-         channel_index++) {
-        error_return_if ((sound_buffer->areas[channel_index].first % 8) != 0,,
-                         "areas[%i].first == %i, aborting...", channel_index,
-                         areas[channel_index].first);
-        samples[channel_index] =
-            /* (signed short *) */
-            (((unsigned char *) areas[channel_index].addr) +
-             (areas[channel_index].first / 8));
-        error_return_if ((areas[channel_index].step % 16) != 0,,
-                         "areas[%i].step == %i, aborting...\n", channel_index,
-                         areas[channel_index].step);
-        steps[channel_index] = areas[channel_index].step / 8;
-        samples[channel_index] += offset * steps[channel_index];
-    }
-    /* fill the channel areas */
-    int count = sound_info->period_size;
-    while (count-- > 0) {
-        int val = sin (phase) * maxval;
-        if (to_unsigned) {
-            val ^= 1U << (bits_per_sample - 1);
-        }
-
-        for (unsigned int channel_index = 0; channel_index < sound_info->channel_count;
-             channel_index++) {
-            /* Generate data in native endian format */
-            if (big_endian) {
-                for (int i = 0; i < bytes_per_sample; i++)
-                    *(samples[channel_index] + phys_bytes_per_sample - 1 - i) =
-                        (val >> i * 8) & 0xff;
-            }
-            else {
-                for (int i = 0; i < bytes_per_sample; i++)
-                    *(samples[channel_index] + i) = (val >> i * 8) & 0xff;
-            }
-            samples[channel_index] += steps[channel_index];
-        }
-        phase += step;
-        if (phase >= max_phase)
-            phase -= max_phase;
-    }
-    *_phase = phase;
-}
+/* in order of preference: the first one needs no conversion at all */
+static const struct
+{
+    snd_pcm_format_t alsa_format;
+    linux_sample_format format;
+} linux_preferred_formats[] = {
+    {SND_PCM_FORMAT_S16_LE, LINUX_SAMPLE_S16_LE},
+    {SND_PCM_FORMAT_S32_LE, LINUX_SAMPLE_S32_LE},
+    {SND_PCM_FORMAT_FLOAT_LE, LINUX_SAMPLE_FLOAT_LE},
+    {SND_PCM_FORMAT_S24_3LE, LINUX_SAMPLE_S24_3LE},
+    {SND_PCM_FORMAT_U8, LINUX_SAMPLE_U8},
+};
 
-static void
-set_hw_params (sound_info_t * sound_info, error_t ** error) {
+static bool
+set_hw_params (linux_sound_output * output)
+{
     int res;
-
-    snd_pcm_hw_params_alloca (&sound_info->hw_params);
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_alloca (&hw_params);
 
     /* initialize hw_params with the full configuration space of the soundcard */
-    res = snd_pcm_hw_params_any (sound_info->handle, sound_info->hw_params);
-    error_return_if (res < 0,,
-                     "broken configuration for playback: no configurations available: %s\n",
-                     snd_strerror (res));
+    res = snd_pcm_hw_params_any (output->handle, hw_params);
+    if (res < 0) {
+        fprintf (stderr, "broken configuration for playback: no configurations available: %s\n",
+                 snd_strerror (res));
+        return false;
+    }
 
     /* set the resampling rate */
-    res = snd_pcm_hw_params_set_rate_resample (sound_info->handle,
-                                               sound_info->hw_params, sound_info->resample);
-    error_return_if (res < 0,, "resampling setup failed for playback: %s\n",
-                     snd_strerror (res));
+    res = snd_pcm_hw_params_set_rate_resample (output->handle, hw_params, output->resample);
+    if (res < 0) {
+        fprintf (stderr, "resampling setup failed for playback: %s\n", snd_strerror (res));
+        return false;
+    }
 
-    /* set the interleaved read/write format */
-    res = snd_pcm_hw_params_set_access (sound_info->handle, sound_info->hw_params,
-                                        sound_info->access);
-    error_return_if (res < 0,, "access type not available for playback: %s\n",
-                     snd_strerror (res));
+    /* prefer converting straight into the device ring; plain writes cost one more copy, and
+       without it waking up twice as often costs the same */
+    output->access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+    if (snd_pcm_hw_params_test_access (output->handle, hw_params, output->access) < 0) {
+        output->access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    }
+    else {
+        output->buffer_time /= 2;
+        output->period_time /= 2;
+    }
+    res = snd_pcm_hw_params_set_access (output->handle, hw_params, output->access);
+    if (res < 0) {
+        fprintf (stderr, "access type not available for playback: %s\n", snd_strerror (res));
+        return false;
+    }
 
-    /* set the sample format */
-    res = snd_pcm_hw_params_set_format (sound_info->handle, sound_info->hw_params,
-                                        sound_info->format);
-    error_return_if (res < 0,, "sample format not available for playback: %s\n",
-                     snd_strerror (res));
+    /* set the sample format: the first one the device takes that we can convert to */
+    res = -EINVAL;
+    for (unsigned int format_index = 0; format_index < ArrayCount (linux_preferred_formats);
+         format_index++) {
+        snd_pcm_format_t format = linux_preferred_formats[format_index].alsa_format;
+        if (snd_pcm_hw_params_test_format (output->handle, hw_params, format) == 0) {
+            res = snd_pcm_hw_params_set_format (output->handle, hw_params, format);
+            if (res == 0) {
+                output->format = format;
+                output->sample_format = linux_preferred_formats[format_index].format;
+                break;
+            }
+        }
+    }
+    if (res < 0) {
+        fprintf (stderr, "sample format not available for playback: %s\n", snd_strerror (res));
+        return false;
+    }
 
     /* set the count of channels */
-    res = snd_pcm_hw_params_set_channels (sound_info->handle, sound_info->hw_params,
-                                          sound_info->channel_count);
-    error_return_if (res < 0,,
-                     "channels count (%i) not available for playbacks: %s\n",
-                     sound_info->channel_count, snd_strerror (res));
-
-    /* set the stream rate */
-    unsigned int exact_rate = sound_info->sampling_rate;
-    res = snd_pcm_hw_params_set_rate_near (sound_info->handle, sound_info->hw_params,
-                                           &exact_rate, 0);
-    error_return_if (res < 0,, "rate %iHz not available for playback: %s\n",
-                     sound_info->sampling_rate, snd_strerror (res));
-    error_return_if (exact_rate != sound_info->sampling_rate,,
-                     "rate doesn't match (requested %iHz, get %iHz)\n",
-                     sound_info->sampling_rate, exact_rate);
+    res = snd_pcm_hw_params_set_channels (output->handle, hw_params, output->channel_count);
+    if (res < 0) {
+        fprintf (stderr, "channels count (%i) not available for playbacks: %s\n",
+                 output->channel_count, snd_strerror (res));
+        return false;
+    }
+
+    /* set the stream rate: whatever the device gets closest to, we convert to ourselves */
+    unsigned int exact_rate = output->game_samples_per_second;
+    res = snd_pcm_hw_params_set_rate_near (output->handle, hw_params, &exact_rate, 0);
+    if (res < 0) {
+        fprintf (stderr, "rate %iHz not available for playback: %s\n",
+                 output->game_samples_per_second, snd_strerror (res));
+        return false;
+    }
+    output->samples_per_second = exact_rate;
 
     /* set the buffer time */
-    res = snd_pcm_hw_params_set_buffer_time_near (sound_info->handle,
-                                                  sound_info->hw_params,
-                                                  &sound_info->buffer_time, &dir);
-    error_return_if (res < 0,, "unable to set buffer time %i for playback: %s\n",
-                     sound_info->buffer_time, snd_strerror (res));
+    int dir;
+    res = snd_pcm_hw_params_set_buffer_time_near (output->handle, hw_params,
+                                                  &output->buffer_time, &dir);
+    if (res < 0) {
+        fprintf (stderr, "unable to set buffer time %i for playback: %s\n",
+                 output->buffer_time, snd_strerror (res));
+        return false;
+    }
 
     snd_pcm_uframes_t size;
-    res = snd_pcm_hw_params_get_buffer_size (sound_info->hw_params, &size);
-    error_return_if (res < 0,, "unable to get buffer size for playback: %s\n",
-                     snd_strerror (res));
-    sound_info->buffer_size = size;
+    res = snd_pcm_hw_params_get_buffer_size (hw_params, &size);
+    if (res < 0) {
+        fprintf (stderr, "unable to get buffer size for playback: %s\n", snd_strerror (res));
+        return false;
+    }
+    output->buffer_size = size;
 
     /* set the period time */
-    int dir;
-    res = snd_pcm_hw_params_set_period_time_near (sound_info->handle,
-                                                  sound_info->hw_params,
-                                                  &sound_info->period_time, &dir);
-    error_return_if (res < 0,, "unable to set period time %i for playback: %s\n",
-                     sound_info->period_time, snd_strerror (res));
-    res = snd_pcm_hw_params_get_period_size (sound_info->hw_params, &size, &dir);
-    error_return_if (res < 0,, "unable to get period size for playback: %s\n",
-                     snd_strerror (res));
-    sound_info->period_size = size;
+    res = snd_pcm_hw_params_set_period_time_near (output->handle, hw_params,
+                                                  &output->period_time, &dir);
+    if (res < 0) {
+        fprintf (stderr, "unable to set period time %i for playback: %s\n",
+                 output->period_time, snd_strerror (res));
+        return false;
+    }
+    res = snd_pcm_hw_params_get_period_size (hw_params, &size, &dir);
+    if (res < 0) {
+        fprintf (stderr, "unable to get period size for playback: %s\n", snd_strerror (res));
+        return false;
+    }
+    output->period_size = size;
 
     /* write the parameters to device */
-    res = snd_pcm_hw_params (sound_info->handle, sound_info->hw_params);
-    error_return_if (res < 0,, "unable to set hw params for playback: %s\n",
-                     snd_strerror (res));
+    res = snd_pcm_hw_params (output->handle, hw_params);
+    if (res < 0) {
+        fprintf (stderr, "unable to set hw params for playback: %s\n", snd_strerror (res));
+        return false;
+    }
+
+    return true;
 }
 
-static void
-set_sw_params (sound_info_t * sound_info, error_t ** error) {
+static bool
+set_sw_params (linux_sound_output * output)
+{
     int res;
-
-    snd_pcm_sw_params_alloca (&sound_info->sw_params);
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_sw_params_alloca (&sw_params);
 
     /* get the current sw_params */
-    res = snd_pcm_sw_params_current (sound_info->handle, sound_info->sw_params);
-    error_return_if (res < 0,,
-                     "unable to determine current sw_params for playback: %s\n",
-                     snd_strerror (res));
+    res = snd_pcm_sw_params_current (output->handle, sw_params);
+    if (res < 0) {
+        fprintf (stderr, "unable to determine current sw_params for playback: %s\n",
+                 snd_strerror (res));
+        return false;
+    }
 
-    /* start the transfer when the buffer is almost full: */
-    /* (buffer_size / avail_min) * avail_min */
-    res = snd_pcm_sw_params_set_start_threshold (sound_info->handle,
-                                                 sound_info->sw_params,
-                                                 (sound_info->buffer_size /
-                                                  sound_info->period_size) *
-                                                 sound_info->period_size);
-    error_return_if (res < 0,,
-                     "unable to set start threshold mode for playback: %s\n",
-                     snd_strerror (res));
+    /* start the transfer as soon as the sound thread has queued two periods */
+    res = snd_pcm_sw_params_set_start_threshold (output->handle, sw_params,
+                                                 2 * output->period_size);
+    if (res < 0) {
+        fprintf (stderr, "unable to set start threshold mode for playback: %s\n",
+                 snd_strerror (res));
+        return false;
+    }
 
     /* allow the transfer when at least period_size samples can be processed */
-    /* or disable this mechanism when period event is enabled (aka intresupt like style
-       processing) */
-    res = snd_pcm_sw_params_set_avail_min (sound_info->handle, sound_info->sw_params,
-                                           sound_info->period_event ? sound_info->
-                                           buffer_size : sound_info->period_size);
-    error_return_if (res < 0,, "unable to set avail min for playback: %s\n",
-                     snd_strerror (res));
-
-    /* enable period events when requested */
-    if (sound_info->period_event) {
-        res = snd_pcm_sw_params_set_period_event (sound_info->handle,
-                                                  sound_info->sw_params, 1);
-        error_return_if (res < 0,, "unable to set period event: %s\n", snd_strerror (res));
+    res = snd_pcm_sw_params_set_avail_min (output->handle, sw_params, output->period_size);
+    if (res < 0) {
+        fprintf (stderr, "unable to set avail min for playback: %s\n", snd_strerror (res));
+        return false;
     }
 
+    /* timestamp the device position on the clock the frames are paced on; older alsa-lib
+       only has gettimeofday, and then there is no audio clock to pace from */
+    output->has_clock = snd_pcm_sw_params_set_tstamp_mode (output->handle, sw_params,
+                                                           SND_PCM_TSTAMP_ENABLE) == 0
+        && snd_pcm_sw_params_set_tstamp_type (output->handle, sw_params,
+                                              SND_PCM_TSTAMP_TYPE_MONOTONIC) == 0;
+
     /* write the parameters to the playback device */
-    res = snd_pcm_sw_params (sound_info->handle, sound_info->sw_params);
-    error_return_if (res < 0,, "unable to set sw params for playback: %s\n",
-                     snd_strerror (res));
+    res = snd_pcm_sw_params (output->handle, sw_params);
+    if (res < 0) {
+        fprintf (stderr, "unable to set sw params for playback: %s\n", snd_strerror (res));
+        return false;
+    }
+
+    return true;
 }
 
-/* Underrun and suspend recovery */
+/* copies frame_count frames into the mmap'd ring at offset, wherever the areas say each channel
+   lives. normally that is one packed interleaved block, converted in one go */
+static void
+linux_copy_to_areas (linux_sound_output * output, const snd_pcm_channel_area_t * areas,
+                     snd_pcm_uframes_t offset, int16 * source, snd_pcm_uframes_t frame_count)
+{
+    unsigned int bits_per_sample = linux_sample_formats[output->sample_format].bytes_per_sample * 8;
+    bool packed = areas[0].step == (unsigned int) output->bytes_per_frame * 8;
+    for (unsigned int channel_index = 0; channel_index < output->channel_count; channel_index++) {
+        const snd_pcm_channel_area_t *area = areas + channel_index;
+        Assert ((area->first % 8) == 0 && (area->step % 8) == 0);
+        packed = packed && area->addr == areas[0].addr && area->step == areas[0].step
+            && area->first == areas[0].first + channel_index * bits_per_sample;
+    }
 
-static int
-xrun_recovery (snd_pcm_t * handle, int err, error_t ** error) {
-    printf ("stream recovery\n");
+    if (packed) {
+        uint8 *dest = (uint8 *) areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+        output->write_samples (dest, source, frame_count * output->channel_count);
+    }
+    else {
+        /* some plugin handed us a layout we did not ask for: one value at a time */
+        for (unsigned int channel_index = 0; channel_index < output->channel_count;
+             channel_index++) {
+            const snd_pcm_channel_area_t *area = areas + channel_index;
+            uint8 *channel_dest = (uint8 *) area->addr + area->first / 8
+                + offset * (area->step / 8);
+            int16 *channel_source = source + channel_index;
+            for (snd_pcm_uframes_t frame = 0; frame < frame_count; frame++) {
+                output->write_samples (channel_dest, channel_source, 1);
+                channel_dest += area->step / 8;
+                channel_source += output->channel_count;
+            }
+        }
+    }
+}
 
-    if (err == -EPIPE) {	/* under-run */
-        err = snd_pcm_prepare (handle);
-        if (err < 0) {
-            printf ("Can't recovery from underrun, prepare failed: %s\n",
-                    snd_strerror (err));
+/* hands frame_count frames to the device, returns how many it took or a negative error */
+static snd_pcm_sframes_t
+linux_write_device (linux_sound_output * output, int16 * source, snd_pcm_uframes_t frame_count)
+{
+    snd_pcm_sframes_t written = 0;
+    if (output->sink.type != LINUX_SOUND_SINK_ALSA) {
+        written = linux_write_sound_sink (&output->sink, source, frame_count,
+                                          linux_get_monotonic_ns ());
+        if (written < 0) {
+            return written;
         }
-        `return 0;
     }
-    else if (err == -ESTRPIPE) {
-        while ((err = snd_pcm_resume (handle)) == -EAGAIN) {
-            sleep (1);	/* wait until the suspend flag is released */
+    else if (output->access == SND_PCM_ACCESS_MMAP_INTERLEAVED) {
+        /* the device ring may wrap, in which case mmap_begin hands out less than we asked for
+           and we go around again */
+        while ((snd_pcm_uframes_t) written < frame_count) {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t chunk = frame_count - written;
+            int res = snd_pcm_mmap_begin (output->handle, &areas, &offset, &chunk);
+            if (res < 0) {
+                return res;
+            }
+            /* no room right now: report what made it, like a short writei */
+            if (chunk == 0) {
+                break;
+            }
+
+            linux_copy_to_areas (output, areas, offset, source + written * output->channel_count,
+                                 chunk);
+
+            snd_pcm_sframes_t committed = snd_pcm_mmap_commit (output->handle, offset, chunk);
+            if (committed < 0) {
+                return committed;
+            }
+            if ((snd_pcm_uframes_t) committed != chunk) {
+                return -EPIPE;
+            }
+            written += chunk;
+        }
+
+        /* committing does not start the stream the way writei does */
+        if (snd_pcm_state (output->handle) == SND_PCM_STATE_PREPARED) {
+            snd_pcm_start (output->handle);
         }
-        if (err < 0) {
-            err = snd_pcm_prepare (handle);
-            if (err < 0) {
-                printf ("Can't recovery from suspend, prepare failed: %s\n",
-                        snd_strerror (err));
+    }
+    else {
+        /* the format was settled at init, so this is one indirect call per transfer. after an
+           xrun avail can be more than device_samples holds, so that goes in buffer-sized pieces */
+        bool device_full = false;
+        while (!device_full && (snd_pcm_uframes_t) written < frame_count) {
+            int16 *chunk_source = source + written * output->channel_count;
+            snd_pcm_uframes_t chunk = frame_count - written;
+            uint8 *ptr = (uint8 *) chunk_source;
+            if (output->sample_format != LINUX_SAMPLE_S16_LE) {
+                chunk = linux_convert_frames (output->write_samples, output->device_samples,
+                                              output->buffer_size, chunk_source, chunk,
+                                              output->channel_count);
+                ptr = (uint8 *) output->device_samples;
+            }
+
+            snd_pcm_uframes_t chunk_written = 0;
+            while (chunk_written < chunk) {
+                snd_pcm_sframes_t res = snd_pcm_writei (output->handle, ptr, chunk - chunk_written);
+                if (res == -EAGAIN) {
+                    device_full = true;
+                    break;
+                }
+                if (res < 0) {
+                    return res;
+                }
+                ptr += res * output->bytes_per_frame;
+                chunk_written += res;
             }
+            written += chunk_written;
         }
-        return 0;
     }
-    return err;
+
+    output->device_frame_count += written;
+    return written;
 }
 
-/* Transfer method - write only */
+enum
+{
+    LINUX_SOUND_EVENT_WAKE,
+    LINUX_SOUND_EVENT_PCM,
+};
 
+/* a suspended device keeps its descriptors in the error state, so they would wake us for as long
+   as the suspend lasts; they come out of the set and the idle timeout paces the resume attempts */
 static void
-sound_buffer_play (sound_buffer_t * sound_buffer, sound_info_t * sound_info, error_t ** error) {
-    error_t *err = NULL;
-    int res;
-
-    while (1) {
-        double phase = 0;
-        generate_sine (sound_buffer, sound_info, 0, &phase, &err);
-        error_return_if (err != NULL, err, "error generating sine");
-        signed short *ptr = sound_buffer->samples;
-        int cptr = sound_info->period_size;
-        while (cptr > 0) {
-            res = snd_pcm_writei (sound_info->handle, ptr, cptr);
-            if (res == -EAGAIN) {
-                continue;
+linux_set_sound_suspended (linux_sound_output * output, bool suspended)
+{
+    if (suspended != output->suspended) {
+        for (int fd_index = 0; fd_index < output->poll_fd_count; fd_index++) {
+            struct pollfd *poll_fd = output->poll_fds + fd_index;
+            if (suspended) {
+                linux_remove_event_fd (&output->event_loop, poll_fd->fd);
             }
-            if (res < 0) {
-                xrun_recovery (sound_info->handle, res, &err);
-                error_return_if (err != NULL,, "write error: %s\n",
-                                 snd_strerror (err));
-                break;	/* skip one period */
+            else {
+                linux_add_event_fd (&output->event_loop, poll_fd->fd,
+                                    output->pcm_armed ? poll_fd->events : 0,
+                                    LINUX_SOUND_EVENT_PCM, fd_index);
+            }
+        }
+        output->suspended = suspended;
+    }
+}
+
+/* Underrun and suspend recovery, on the sound thread, so it never waits on the device: a device
+   that is not ready to resume yet is tried again on the next wakeup. Every xrun is logged with
+   its cause. returns true when the stream is ready to be primed again */
+static bool
+linux_recover_sound (linux_sound_output * output, int err)
+{
+    if (output->sink.type != LINUX_SOUND_SINK_ALSA) {
+        /* nothing to restart: a full disk stays full */
+        telemetry_record_xrun (&output->xruns, AudioXrunCause_device_error,
+                               linux_get_monotonic_ns ());
+        fprintf (stderr, "sound sink error: %s\n", strerror (-err));
+        return false;
+    }
+    if (err == -ESTRPIPE) {
+        if (!output->suspended) {
+            telemetry_record_xrun (&output->xruns, AudioXrunCause_suspend,
+                                   linux_get_monotonic_ns ());
+            linux_set_sound_suspended (output, true);
+        }
+        err = snd_pcm_resume (output->handle);
+        if (err == -EAGAIN) {
+            return false;
+        }
+        linux_set_sound_suspended (output, false);
+        if (err == 0) {
+            return true;
+        }
+        /* the device cannot pick up where it stopped, so it starts over */
+    }
+    else if (err == -EPIPE) {
+        telemetry_record_xrun (&output->xruns, AudioXrunCause_device_underrun,
+                               linux_get_monotonic_ns ());
+    }
+    else {
+        telemetry_record_xrun (&output->xruns, AudioXrunCause_device_error,
+                               linux_get_monotonic_ns ());
+        fprintf (stderr, "sound error: %s\n", snd_strerror (err));
+    }
+
+    err = snd_pcm_prepare (output->handle);
+    if (err < 0) {
+        fprintf (stderr, "sound: prepare failed: %s\n", snd_strerror (err));
+        return false;
+    }
+    return true;
+}
+
+/* moves whatever the game has queued into the device, and if the game fell behind, keeps the
+   device from running dry with silence. returns 0 or the error to recover from. priming a
+   stream that was just recovered needs silence too, but it is not a late frame. a sink that is
+   not paced never runs dry, and gets no silence */
+static snd_pcm_sframes_t
+linux_refill_sound_device (linux_sound_output * output, bool priming)
+{
+    snd_pcm_sframes_t avail;
+    if (output->sink.type != LINUX_SOUND_SINK_ALSA) {
+        avail = linux_get_sound_sink_room (&output->sink, linux_get_monotonic_ns (),
+                                           output->ring.capacity);
+    }
+    else {
+        avail = snd_pcm_avail_update (output->handle);
+    }
+    if (avail < 0) {
+        return avail;
+    }
+    /* after an xrun avail can run past the buffer size; nothing is queued then, and the silence
+       below must still fit the two periods it is allocated for */
+    snd_pcm_sframes_t queued = (snd_pcm_sframes_t) output->buffer_size - avail;
+    if (queued < 0) {
+        queued = 0;
+    }
+
+    linux_sample_ring_region regions[2];
+    int region_count = linux_begin_sample_ring_read (&output->ring, avail, regions);
+    uint32 frames_read = 0;
+    snd_pcm_sframes_t res = 0;
+    for (int region_index = 0; region_index < region_count; region_index++) {
+        res = linux_write_device (output, regions[region_index].samples,
+                                  regions[region_index].frame_count);
+        if (res < 0) {
+            break;
+        }
+        frames_read += res;
+        if ((uint32) res != regions[region_index].frame_count) {
+            break;
+        }
+    }
+    linux_end_sample_ring_read (&output->ring, frames_read);
+    if (frames_read) {
+        output->ring_ran_dry = false;
+    }
+
+    if (res >= 0 && output->sink.paced) {
+        queued += frames_read;
+        snd_pcm_sframes_t silence_count = 2 * output->period_size - queued;
+        if (silence_count > (snd_pcm_sframes_t) (avail - frames_read)) {
+            silence_count = avail - frames_read;
+        }
+        if (silence_count > 0) {
+            /* one gap is one xrun, however many wakeups it lasts. before the game's first fill
+               this is just the stream starting up */
+            if (!priming && !output->ring_ran_dry && output->ring.write_count) {
+                telemetry_record_xrun (&output->xruns, AudioXrunCause_late_frame,
+                                       linux_get_monotonic_ns ());
+                output->ring_ran_dry = true;
             }
-            ptr += res * sound_info->channel_count;
-            cptr -= res;
+            res = linux_write_device (output, output->silence, silence_count);
         }
     }
+
+    return (res < 0) ? res : 0;
 }
 
 static void
-sound_info_init (sound_info_t * sound_info, error_t ** error) {
-    int res;
-    error_t *err = NULL;
+linux_publish_audio_clock (linux_sound_output * output, uint64 frame_position, int64 time_ns)
+{
+    output->clock_sequence = output->clock_sequence + 1;
+    CompletePreviousWritesBeforeFutureWrites;
+    output->clock_frame_position = frame_position;
+    output->clock_time_ns = time_ns;
+    CompletePreviousWritesBeforeFutureWrites;
+    output->clock_sequence = output->clock_sequence + 1;
+}
+
+/* a paced sink plays on CLOCK_MONOTONIC itself, so its clock is exact */
+static void
+linux_publish_sink_clock (linux_sound_output * output)
+{
+    int64 now_ns = linux_get_monotonic_ns ();
+    uint64 delay = linux_get_sound_sink_delay (&output->sink, now_ns);
+    output->device_delay = delay;
+    if (output->has_clock && output->sink.frame_count) {
+        linux_publish_audio_clock (output, output->sink.frame_count - delay, now_ns);
+    }
+}
 
-    res = snd_output_stdio_attach (&sound_info->output, stdout, 0);
-    error_return_if (res < 0,, "output failed: %s", snd_strerror (res));
+/* one wakeup of the audio thread */
+static void
+linux_update_sound_device (linux_sound_output * output)
+{
+    TIMED_FUNCTION ();
+
+    /* a recovered stream is primed straight away, with what is left in the ring and then
+       silence, rather than a wakeup later; nothing the game queued is dropped */
+    snd_pcm_sframes_t res = linux_refill_sound_device (output, false);
+    if (res < 0 && linux_recover_sound (output, res)) {
+        res = linux_refill_sound_device (output, true);
+        if (res < 0) {
+            linux_recover_sound (output, res);
+        }
+    }
 
-    /* opens a PCM. we use the playback stream (as opposed to the capture stream 0, the
-       standard opening mode */
-    res = snd_pcm_open (&sound_info->handle, sound_info->device, sound_info->stream, 0);
-    error_return_if (res < 0,, "could not open PCM device: %s", sndstrerror (res));
+    if (output->sink.type != LINUX_SOUND_SINK_ALSA) {
+        linux_publish_sink_clock (output);
+        return;
+    }
+
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay (output->handle, &delay) == 0) {
+        output->device_delay = delay;
+    }
 
-    set_hw_params (&sound_info, &err);
-    error_goto_if (err != NULL, pcm_close, err, "could not set hw params");
+    /* the timestamp belongs to the hardware pointer update that avail counts from, so the two
+       make a consistent pair however late we read them. it is zero until the stream runs */
+    snd_pcm_uframes_t avail;
+    snd_htimestamp_t timestamp;
+    if (output->has_clock && snd_pcm_htimestamp (output->handle, &avail, &timestamp) == 0
+        && (timestamp.tv_sec || timestamp.tv_nsec) && avail <= output->buffer_size) {
+        linux_publish_audio_clock (output,
+                                   output->device_frame_count - (output->buffer_size - avail),
+                                   (int64) timestamp.tv_sec * 1000000000LL + timestamp.tv_nsec);
+    }
+}
 
-    set_sw_params (&sound_info, &err);
-    error_goto_if (err != NULL, pcm_close, err, "could not set sw params");
+/* any thread: the last position the sound thread read off the device, in device frames since
+   the stream started, and when it was playing. false until there is one */
+static bool
+linux_get_audio_clock (linux_sound_output * output, uint64 * frame_position, int64 * time_ns)
+{
+    if (!output->thread_running || !output->has_clock) {
+        return false;
+    }
+    for (;;) {
+        uint32 sequence = output->clock_sequence;
+        CompletePreviousReadsBeforeFutureReads;
+        *frame_position = output->clock_frame_position;
+        *time_ns = output->clock_time_ns;
+        CompletePreviousReadsBeforeFutureReads;
+        if (!(sequence & 1) && sequence == output->clock_sequence) {
+            return *time_ns != 0;
+        }
+        sched_yield ();
+    }
+}
 
-pcm_close:
-    snd_pcm_close (sound_info->handle);
+/* a PCM descriptor stays ready for as long as the device has room, so it only belongs in the
+   set while the ring has frames to fill that room with; anything else would spin */
+static void
+linux_arm_pcm_descriptors (linux_sound_output * output, bool armed)
+{
+    if (armed != output->pcm_armed && !output->suspended) {
+        for (int fd_index = 0; fd_index < output->poll_fd_count; fd_index++) {
+            struct pollfd *poll_fd = output->poll_fds + fd_index;
+            linux_modify_event_fd (&output->event_loop, poll_fd->fd, armed ? poll_fd->events : 0,
+                                   LINUX_SOUND_EVENT_PCM, fd_index);
+        }
+    }
+    output->pcm_armed = armed;
 }
 
-void
-sound_buffer_init (sound_buffer_t * sound_buffer, sound_info_t * sound_info, error_t ** error) {
-    sound_buffer->samples =
-        malloc ((sound_info->period_size * sound_info->channel_count *
-                 snd_pcm_format_physical_width (sound_info->format)) / 8);
-    error_return_if (sound_buffer->samples == NULL,, "no enough memory");
+static void *
+linux_sound_thread_proc (void *parameter)
+{
+    linux_sound_output *output = (linux_sound_output *) parameter;
+    linux_event_loop *loop = &output->event_loop;
+
+    /* disarmed, we still wake once a period, in case the game stalls and the device needs
+       silence before the next fill comes. a sink has no descriptors: a paced one is serviced
+       once a period, one that is not on every fill */
+    int idle_timeout_ms = (output->period_time + 999) / 1000;
+    while (!output->stop_thread) {
+        bool pcm_waiting = output->poll_fd_count && output->pcm_armed && !output->suspended;
+        int timeout_ms = (pcm_waiting || !output->sink.paced) ? -1 : idle_timeout_ms;
+        int count = linux_wait_for_events (loop, timeout_ms);
+        if (count < 0) {
+            fprintf (stderr, "sound thread: epoll_wait failed: %s\n", strerror (errno));
+            break;
+        }
 
-    sound_buffer->areas = calloc (sound_info->channel_count, sizeof (snd_pcm_channel_area_t));
-    error_return_if (sound_buffer->areas == NULL,, "no enough memory\n");
+        bool pcm_ready = (count == 0);
+        for (int event_index = 0; event_index < count; event_index++) {
+            struct epoll_event *event = loop->ready + event_index;
+            if (linux_event_tag (event) == LINUX_SOUND_EVENT_WAKE) {
+                uint64 wake_count;
+                read (output->wake_fd, &wake_count, sizeof (wake_count));
+                pcm_ready = true;
+            }
+            else {
+                output->poll_fds[linux_event_index (event)].revents = (short) event->events;
+                /* disarmed descriptors still report errors, e.g. an xrun nobody has handled */
+                pcm_ready = pcm_ready || !output->pcm_armed;
+            }
+        }
 
-    for (unsigned int i = 0; i < sound_buffer->channel_count; i++) {
-        sound_buffer->areas[i].addr = sound_buffer->samples;
-        sound_buffer->areas[i].first =
-            i * snd_pcm_format_physical_width (sound_info->format);
-        sound_buffer->areas[i].step =
-            channels * snd_pcm_format_physical_width (sound_info->format);
+        if (pcm_waiting) {
+            unsigned short revents = 0;
+            int res = snd_pcm_poll_descriptors_revents (output->handle, output->poll_fds,
+                                                        output->poll_fd_count, &revents);
+            for (int fd_index = 0; fd_index < output->poll_fd_count; fd_index++) {
+                output->poll_fds[fd_index].revents = 0;
+            }
+            if (res < 0) {
+                linux_recover_sound (output, res);
+            }
+            pcm_ready = pcm_ready || (revents & (POLLOUT | POLLERR));
+        }
+
+        if (pcm_ready && !output->stop_thread) {
+            linux_update_sound_device (output);
+        }
+        linux_arm_pcm_descriptors (output, linux_sample_ring_filled (&output->ring) != 0);
     }
+
+    return 0;
 }
 
-void
-sound_buffer_free (sound_buffer_t * sound_buffer) {
-    free (sound_buffer->samples);
-    free (sound_buffer->areas);
+/* a frame that runs long must not delay the device, so the audio thread asks for a real-time
+   priority. without RLIMIT_RTPRIO (see limits.conf) that fails, and it runs as a normal thread */
+static bool
+linux_start_sound_thread (linux_sound_output * output)
+{
+    output->stop_thread = false;
+    output->pcm_armed = true;
+    output->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    output->poll_fd_count = 0;
+    if (output->sink.type == LINUX_SOUND_SINK_ALSA) {
+        output->poll_fd_count = snd_pcm_poll_descriptors_count (output->handle);
+    }
+    if (output->wake_fd < 0 || output->poll_fd_count < 0) {
+        fprintf (stderr, "could not set up the sound thread's descriptors\n");
+        return false;
+    }
+    output->poll_fds = (struct pollfd *) calloc (output->poll_fd_count + 1,
+                                                 sizeof (struct pollfd));
+    if (output->poll_fds == NULL
+        || (output->poll_fd_count
+            && snd_pcm_poll_descriptors (output->handle, output->poll_fds,
+                                         output->poll_fd_count) < 0)
+        || !linux_init_event_loop (&output->event_loop)
+        || !linux_add_event_fd (&output->event_loop, output->wake_fd, EPOLLIN,
+                                LINUX_SOUND_EVENT_WAKE, 0)) {
+        return false;
+    }
+    for (int fd_index = 0; fd_index < output->poll_fd_count; fd_index++) {
+        if (!linux_add_event_fd (&output->event_loop, output->poll_fds[fd_index].fd,
+                                 output->poll_fds[fd_index].events, LINUX_SOUND_EVENT_PCM,
+                                 fd_index)) {
+            return false;
+        }
+    }
+
+    if (pthread_create (&output->thread, 0, linux_sound_thread_proc, output) != 0) {
+        fprintf (stderr, "could not create the sound thread\n");
+        return false;
+    }
+    output->thread_running = true;
+
+    struct sched_param param = { };
+    param.sched_priority = (sched_get_priority_min (SCHED_FIFO)
+                            + sched_get_priority_max (SCHED_FIFO)) / 2;
+    int res = pthread_setschedparam (output->thread, SCHED_FIFO, &param);
+    if (res != 0) {
+        fprintf (stderr, "sound thread: no SCHED_FIFO priority (%s)\n", strerror (res));
+    }
+
+    return true;
 }
 
-int
-main (int argc, char *argv[]) {
-    int res;
-    error_t *err = NULL;
+static void
+linux_wake_sound_thread (linux_sound_output * output)
+{
+    uint64 one = 1;
+    write (output->wake_fd, &one, sizeof (one));
+}
 
-    char pcm_device[] = "plughw:0,0";
+static void
+linux_free_sound (linux_sound_output * output)
+{
+    if (output->thread_running) {
+        output->stop_thread = true;
+        linux_wake_sound_thread (output);
+        pthread_join (output->thread, 0);
+        output->thread_running = false;
+    }
+    if (output->wake_fd >= 0) {
+        close (output->wake_fd);
+        output->wake_fd = -1;
+    }
+    linux_free_event_loop (&output->event_loop);
+    free (output->poll_fds);
+    output->poll_fds = 0;
+    if (output->handle) {
+        snd_pcm_close (output->handle);
+        output->handle = 0;
+    }
+    linux_close_sound_sink (&output->sink);
+    linux_free_sample_ring (&output->ring);
+    free (output->resampler);
+    output->resampler = 0;
+    free (output->game_samples);
+    output->game_samples = 0;
+    free (output->silence);
+    output->silence = 0;
+    free (output->device_samples);
+    output->device_samples = 0;
+}
 
-    sound_info_t sound_info = { };
-    sound_info.device = pcm_device;
-    sound_info.format = SND_PCM_FORMAT_S16;	/* Signed 16bit CPU endian */
-    sound_info.stream = SND_PCM_STREAM_PLAYBACK;	/* playback stream */
-    sound_info.access = SND_PCM_ACCESS_RW_INTERLEAVED	/* access type */
-        sound_info.sampling_rate = 44100;	/* stream rate */
-    sound_info.channel_count = 2;	/* count of channels */
-    sound_info.buffer_time = 500000;	/* ring buffer length in us */
-    sound_info.period_time = 100000;	/* period time in us */
-    sound_info.tone_hz = 440.0f;	/* sinusoidal wave frequency in Hz */
-    sound_info.resampling = 1;	/* enable alsa-lib resampling */
-    sound_info.period_event = 0;	/* produce poll event after each period */
+/* device is an ALSA device or one of the sinks in linux_sound_sink.cc. on failure the output
+   is left without a sound thread, and the game simply runs silent */
+static bool
+linux_init_sound (linux_sound_output * output, const char *device,
+                  unsigned int game_samples_per_second)
+{
+    output->device = device;
+    output->wake_fd = -1;
+    output->event_loop.epoll_fd = -1;
+    output->game_samples_per_second = game_samples_per_second;
+    output->channel_count = 2;
+    output->buffer_time = 40000;
+    output->period_time = 10000;
+    output->resample = 0;
+
+    if (linux_parse_sound_sink (&output->sink, device)) {
+        /* a sink takes the game's rate and samples as they are, in the periods a device
+           would have */
+        output->samples_per_second = game_samples_per_second;
+        output->format = SND_PCM_FORMAT_S16_LE;
+        output->sample_format = LINUX_SAMPLE_S16_LE;
+        output->access = SND_PCM_ACCESS_RW_INTERLEAVED;
+        output->period_size = (uint64) output->samples_per_second * output->period_time / 1000000;
+        output->buffer_size = LINUX_SINK_LEAD_PERIODS * output->period_size;
+        output->has_clock = output->sink.paced;
+        if (!linux_open_sound_sink (&output->sink, output->samples_per_second,
+                                    output->channel_count, output->period_size)) {
+            linux_free_sound (output);
+            return false;
+        }
+    }
+    else {
+        /* non-blocking, we only ever write what snd_pcm_avail_update says fits */
+        int res = snd_pcm_open (&output->handle, output->device, SND_PCM_STREAM_PLAYBACK,
+                                SND_PCM_NONBLOCK);
+        if (res < 0) {
+            fprintf (stderr, "could not open PCM device '%s': %s\n", output->device,
+                     snd_strerror (res));
+            output->handle = 0;
+            return false;
+        }
 
-    sound_info_init (&sound_info, &err);
-    error_log_if (err != NULL,, "unable to initialize ALSA sound info");
+        if (!set_hw_params (output) || !set_sw_params (output)) {
+            linux_free_sound (output);
+            return false;
+        }
+    }
 
-    sound_buffer_init (&sound_buffer, &sound_info, &err);
-    error_log_if (err != NULL,, "unable to initialize ALSA sound buffer");
+    linux_sample_format_info *format_info = linux_sample_formats + output->sample_format;
+    output->write_samples = format_info->write;
+    output->bytes_per_frame = format_info->bytes_per_sample * output->channel_count;
+    bool use_mmap = (output->access == SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    printf ("sound: %s, %uHz (game %uHz), %s, %s, %lu frame device buffer\n", output->device,
+            output->samples_per_second, output->game_samples_per_second, format_info->name,
+            use_mmap ? "mmap" : (output->handle ? "writei" : "sink"),
+            (unsigned long) output->buffer_size);
+
+    /* half a second of ring is far more than the game ever queues */
+    bool needs_device_samples = !use_mmap && output->sample_format != LINUX_SAMPLE_S16_LE;
+    bool ring_ok = linux_init_sample_ring (&output->ring, output->samples_per_second / 2,
+                                           output->channel_count);
+    output->silence = (int16 *) calloc (2 * output->period_size * output->channel_count,
+                                        sizeof (int16));
+    if (needs_device_samples) {
+        output->device_samples = malloc (output->buffer_size * output->bytes_per_frame);
+    }
+    bool needs_resampler = output->samples_per_second != output->game_samples_per_second;
+    if (needs_resampler && ring_ok) {
+        /* enough game frames for a whole ring's worth of output, plus the filter */
+        uint64 game_frame_count = ((uint64) output->ring.capacity * output->game_samples_per_second
+                                   / output->samples_per_second) + RESAMPLER_TAP_COUNT + 2;
+        output->resampler = (audio_resampler *) malloc (sizeof (audio_resampler));
+        output->game_samples = (int16 *) malloc (game_frame_count * output->channel_count
+                                                 * sizeof (int16));
+        if (output->resampler) {
+            initialize_audio_resampler (output->resampler, output->game_samples_per_second,
+                                        output->samples_per_second);
+        }
+    }
+    if (!ring_ok || output->silence == NULL
+        || (needs_device_samples && output->device_samples == NULL)
+        || (needs_resampler && (output->resampler == NULL || output->game_samples == NULL))) {
+        fprintf (stderr, "no enough memory\n");
+        linux_free_sound (output);
+        return false;
+    }
 
-    sound_buffer_play (&sound_buffer, &sound_info, &err);
-    error_log_if (err != NULL,, "unable to play ALSA sound buffer");
+    /* starts where the win32 layer used to sit for good, and never goes below the two periods
+       the sound thread keeps queued in the device */
+    audio_latency_init (&output->latency, output->samples_per_second,
+                        2 * output->period_size, output->samples_per_second / 4,
+                        output->samples_per_second / 15);
 
-buffer_cleanup:
-    sound_buffer_free (&sound_buffer);
+    if (!linux_start_sound_thread (output)) {
+        linux_free_sound (output);
+        return false;
+    }
 
-pcm_close:
-    snd_pcm_close (sound_info->handle);
+    return true;
+}
 
-    return 0;
+/* called once per frame on the game thread: tops the ring up so that ring and device together
+   hold the controller's target. the device itself is only ever touched by the sound thread */
+static void
+linux_fill_sound (linux_sound_output * output, game_memory * memory, int tone_hz,
+                  frame_telemetry * telemetry)
+{
+    if (!output->thread_running) {
+        return;
+    }
+
+    TIMED_FUNCTION ();
+
+    /* the device delay can be a period stale, which only makes the delay look a little longer */
+    int32 delay = linux_sample_ring_filled (&output->ring) + output->device_delay;
+    int32 target = audio_latency_update (&output->latency, delay,
+                                         telemetry_underrun_count (&output->xruns));
+    telemetry_record_audio (telemetry, output->samples_per_second, target, delay, &output->xruns);
+    if (delay >= target) {
+        return;
+    }
+
+    linux_sample_ring_region regions[2];
+    int region_count = linux_begin_sample_ring_write (&output->ring, target - delay, regions);
+    game_sound_output_buffer sound_buffer = { };
+    sound_buffer.samples_per_second = output->game_samples_per_second;
+    uint32 frames_written = 0;
+    if (output->resampler) {
+        /* exactly as many game frames as it takes to make each region; the resampler carries
+           its state from one to the next */
+        for (int region_index = 0; region_index < region_count; region_index++) {
+            linux_sample_ring_region *region = regions + region_index;
+            int game_frame_count = get_resampler_input_frame_count (output->resampler,
+                                                                    region->frame_count);
+            sound_buffer.regions = get_contiguous_audio_regions (output->game_samples,
+                                                                 game_frame_count);
+            game_get_sound_samples (memory, &sound_buffer, tone_hz);
+            int made = resample_audio (output->resampler, output->game_samples, game_frame_count,
+                                       region->samples, region->frame_count);
+            frames_written += made;
+            /* only what was made is committed, and the frames after a short region are not
+               contiguous with it */
+            if (made < (int) region->frame_count) {
+                break;
+            }
+        }
+    }
+    else {
+        /* the game writes straight across the wrap in one go */
+        for (int region_index = 0; region_index < region_count; region_index++) {
+            sound_buffer.regions.samples[region_index] = regions[region_index].samples;
+            sound_buffer.regions.sample_count[region_index] = regions[region_index].frame_count;
+            frames_written += regions[region_index].frame_count;
+        }
+        if (frames_written) {
+            game_get_sound_samples (memory, &sound_buffer, tone_hz);
+        }
+    }
+    linux_end_sample_ring_write (&output->ring, frames_written);
+    if (frames_written) {
+        linux_wake_sound_thread (output);
+    }
 }
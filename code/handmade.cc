@@ -1,33 +1,102 @@
 #include "handmade.h"
+#include "handmade_intrinsics.h"
+#include "handmade_debug.cc"
+#include "handmade_render_group.cc"
+#include "handmade_telemetry.cc"
+#include "handmade_audio.cc"
+#include "handmade_audio_latency.cc"
 
-internal void
-render_weird_gradient (game_offscreen_buffer *buffer,
-                       int blue_offset, int green_offset)
+internal game_state *
+get_game_state(game_memory *memory)
 {
-    // TODO(casey): Let's see what the optimizer does
-
-    uint8 *row = (uint8 *)buffer->memory;    
-    for(int y = 0;
-        y < buffer->height;
-        ++y)
+    Assert(sizeof(game_state) <= memory->permanent_storage_size);
+    game_state *state = (game_state *)memory->permanent_storage;
+    if(!memory->is_initialized)
     {
-        uint32 *pixel = (uint32 *)row;
-        for(int x = 0;
-            x < buffer->width;
-            ++x)
-        {
-            uint8 blue = (x + blue_offset);
-            uint8 green = (y + green_offset);
+        initialize_arena(&state->transient_arena, (memory_index)memory->transient_storage_size,
+                         memory->transient_storage);
+
+        // NOTE: The test tone, at the old fixed 3000.
+        initialize_audio_mixer(&state->mixer);
+        state->tone_voice_id = play_sine_voice(&state->mixer, 256, 3000.0f / 32768.0f, 0.0f);
 
-            *pixel++ = ((green << 8) | blue);
+        // NOTE: Music, only when asked for, streamed from the file as it
+        // plays.
+        if(memory->music_file_name)
+        {
+            platform_mapped_file music_file = memory->map_file(memory->music_file_name);
+            if(load_wav(&state->music, music_file))
+            {
+                state->music_voice_id = play_sound_voice(&state->mixer, &state->music,
+                                                         0.5f, 0.0f, true);
+                set_audio_voice_bus(&state->mixer, state->music_voice_id, GameAudioBus_music);
+            }
+            else if(music_file.contents)
+            {
+                memory->unmap_file(&music_file);
+            }
         }
-        
-        row += buffer->pitch;
+
+        memory->is_initialized = true;
     }
+
+    return(state);
+}
+
+internal void
+game_update_render(game_memory *memory, game_offscreen_buffer *buffer,
+                   int blue_offset, int green_offset)
+{
+    TIMED_FUNCTION();
+
+    game_state *state = get_game_state(memory);
+
+    temporary_memory render_memory = begin_temporary_memory(&state->transient_arena);
+    render_group *group = allocate_render_group(&state->transient_arena, Kilobytes(64));
+
+    push_gradient(group, blue_offset, green_offset);
+
+    tiled_render_group_to_output(memory, &state->render_cache, group, buffer);
+    end_temporary_memory(render_memory);
 }
 
+// NOTE: The master gets a 20Hz high-pass, for DC and rumble nothing can
+// play anyway. Music gets a dip around 3kHz, to leave room for the game
+// sound on top of it.
 internal void
-game_update_render(game_offscreen_buffer *buffer, int blue_offset, int green_offset)
+set_game_audio_filters(audio_mixer *mixer, int samples_per_second)
 {
-  render_weird_gradient(buffer, blue_offset, green_offset);
+    clear_audio_bus_filters(mixer, GameAudioBus_master);
+    set_audio_bus_filter(mixer, GameAudioBus_master, 0,
+                         make_audio_biquad(AudioFilter_high_pass, 20.0f, 0.7071f, 1.0f,
+                                           samples_per_second));
+
+    clear_audio_bus_filters(mixer, GameAudioBus_music);
+    set_audio_bus_filter(mixer, GameAudioBus_music, 0,
+                         make_audio_biquad(AudioFilter_peaking, 3000.0f, 0.7071f, 0.7f,
+                                           samples_per_second));
+}
+
+internal void
+game_get_sound_samples(game_memory *memory, game_sound_output_buffer *sound_buffer,
+                       int tone_hz)
+{
+    TIMED_FUNCTION();
+
+    game_state *state = get_game_state(memory);
+
+    audio_voice *tone_voice = get_audio_voice(&state->mixer, state->tone_voice_id);
+    if(tone_voice)
+    {
+        tone_voice->tone_hz = tone_hz;
+    }
+
+    if(state->filter_samples_per_second != sound_buffer->samples_per_second)
+    {
+        state->filter_samples_per_second = sound_buffer->samples_per_second;
+        set_game_audio_filters(&state->mixer, sound_buffer->samples_per_second);
+    }
+
+    stream_audio_voices(&state->mixer, memory->prefetch_file);
+    mix_audio(&state->mixer, &sound_buffer->regions, sound_buffer->samples_per_second);
 }
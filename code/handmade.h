@@ -1,5 +1,79 @@
 #if !defined(HANDMADE_H)
 
+#include <stdint.h>
+#include <stddef.h>
+
+#define internal static
+#define local_persist static
+#define global_variable static
+
+#define Pi32 3.14159265359f
+
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef int64_t int64;
+typedef int32 bool32;
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+
+typedef size_t memory_index;
+
+typedef float real32;
+typedef double real64;
+
+#if HANDMADE_SLOW
+#define Assert(Expression) if(!(Expression)) {*(volatile int *)0 = 0;}
+#else
+#define Assert(Expression)
+#endif
+
+#define InvalidCodePath Assert(!"InvalidCodePath")
+#define InvalidDefaultCase default: {InvalidCodePath;} break
+
+#define Kilobytes(Value) ((Value)*1024LL)
+#define Megabytes(Value) (Kilobytes(Value)*1024LL)
+#define Gigabytes(Value) (Megabytes(Value)*1024LL)
+
+#define ArrayCount(Array) (sizeof(Array) / sizeof((Array)[0]))
+
+// NOTE: Services that the platform layer provides to the game.
+struct platform_work_queue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(platform_work_queue *queue, void *data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+typedef void platform_add_entry(platform_work_queue *queue,
+                                platform_work_queue_callback *callback, void *data);
+typedef void platform_complete_all_work(platform_work_queue *queue);
+
+// NOTE: A file mapped read-only into memory. Nothing is read up front: pages
+// come in from the OS file cache the first time they are touched, so mapping
+// even a long music track costs no more than its first page. contents is 0
+// when the file could not be mapped.
+struct platform_mapped_file
+{
+    void *contents;
+    uint64 size;
+};
+
+typedef platform_mapped_file platform_map_file(char const *file_name);
+typedef void platform_unmap_file(platform_mapped_file *file);
+// NOTE: A hint, and it does not wait: asks the OS to start reading the
+// range in, so that touching it later does not stall on the disk.
+typedef void platform_prefetch_file(platform_mapped_file *file, uint64 offset, uint64 size);
+
+struct game_rect
+{
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+};
+
+#define MAX_DIRTY_RECT_COUNT 64
 struct game_offscreen_buffer
 {
     // NOTE(casey): Pixels are always 32-bits wide, Memory Order BB GG RR XX
@@ -7,10 +81,172 @@ struct game_offscreen_buffer
     int width;
     int height;
     int pitch;
+
+    // NOTE: Filled by the renderer with the (merged) regions whose pixels
+    // changed this frame; the platform only needs to present those. The
+    // renderer assumes memory still holds the previous frame it drew, unless
+    // memory, width, height or pitch changed or the platform sets
+    // lost_contents (e.g. because it just reallocated the memory).
+    bool32 lost_contents;
+    int dirty_rect_count;
+    game_rect dirty_rects[MAX_DIRTY_RECT_COUNT];
+};
+
+// NOTE: Where the sound goes in a platform's ring buffer: the free part of
+// it, as up to two regions. The second one is where the ring wraps back to
+// its start, and has no samples when it does not wrap.
+struct audio_ring_regions
+{
+    int16 *samples[2];
+    uint32 sample_count[2];
+};
+
+// NOTE: Interleaved stereo, left then right, 16 bits per channel.
+struct game_sound_output_buffer
+{
+    int samples_per_second;
+    audio_ring_regions regions;
+};
+
+struct game_memory
+{
+    bool32 is_initialized;
+
+    // NOTE: Both storages are allocated once by the platform layer and are
+    // required to be cleared to zero at startup.
+    uint64 permanent_storage_size;
+    void *permanent_storage;
+
+    uint64 transient_storage_size;
+    void *transient_storage;
+
+    // NOTE: Entries added to render_queue run on the platform's worker
+    // threads; complete_all_work is the barrier that waits for them.
+    platform_work_queue *render_queue;
+    platform_add_entry *add_entry;
+    platform_complete_all_work *complete_all_work;
+
+    platform_map_file *map_file;
+    platform_unmap_file *unmap_file;
+    platform_prefetch_file *prefetch_file;
+
+    // NOTE: A WAV file to loop as music, named by whoever started the
+    // game; 0 plays none.
+    char const *music_file_name;
 };
 
-internal void game_update_render (game_offscreen_buffer *buffer,
+internal void game_update_render (game_memory *memory, game_offscreen_buffer *buffer,
                                   int blue_offset, int green_offset);
 
+// NOTE: Fills both regions, the first one and then the second, in one
+// pass. The platform asks for exactly as many samples as it is about to
+// queue, so consecutive calls continue the same waveform.
+internal void game_get_sound_samples (game_memory *memory, game_sound_output_buffer *sound_buffer,
+                                      int tone_hz);
+
+//
+// NOTE: Game layer internals, not visible to the platform layer
+//
+
+struct memory_arena
+{
+    memory_index size;
+    uint8 *base;
+    memory_index used;
+
+    int32 temp_count;
+};
+
+struct temporary_memory
+{
+    memory_arena *arena;
+    memory_index used;
+};
+
+inline void
+initialize_arena(memory_arena *arena, memory_index size, void *base)
+{
+    arena->size = size;
+    arena->base = (uint8 *)base;
+    arena->used = 0;
+    arena->temp_count = 0;
+}
+
+#define PushStruct(arena, type) (type *)push_size_(arena, sizeof(type))
+#define PushArray(arena, count, type) (type *)push_size_(arena, (count)*sizeof(type))
+#define PushSize(arena, size) push_size_(arena, size)
+inline void *
+push_size_(memory_arena *arena, memory_index size)
+{
+    Assert((arena->used + size) <= arena->size);
+    void *Result = arena->base + arena->used;
+    arena->used += size;
+
+    return(Result);
+}
+
+inline void
+zero_size(memory_index size, void *ptr)
+{
+    // TODO(casey): Check this guy for performance
+    uint8 *byte = (uint8 *)ptr;
+    while(size--)
+    {
+        *byte++ = 0;
+    }
+}
+
+inline temporary_memory
+begin_temporary_memory(memory_arena *arena)
+{
+    temporary_memory Result;
+
+    Result.arena = arena;
+    Result.used = arena->used;
+
+    ++arena->temp_count;
+
+    return(Result);
+}
+
+inline void
+end_temporary_memory(temporary_memory temp_mem)
+{
+    memory_arena *arena = temp_mem.arena;
+    Assert(arena->used >= temp_mem.used);
+    arena->used = temp_mem.used;
+    Assert(arena->temp_count > 0);
+    --arena->temp_count;
+}
+
+#include "handmade_render_group.h"
+#include "handmade_audio.h"
+
+// NOTE: The mixer bus each kind of game sound plays on.
+enum game_audio_bus
+{
+    GameAudioBus_master,
+    GameAudioBus_music,
+};
+
+struct game_state
+{
+    // NOTE: Everything in here is rebuilt every frame, e.g. the render
+    // command buffer.
+    memory_arena transient_arena;
+
+    tile_cache render_cache;
+
+    audio_mixer mixer;
+    uint32 tone_voice_id;
+
+    audio_sound music;
+    uint32 music_voice_id;
+
+    // NOTE: The rate the bus filters were designed for; they are designed
+    // again whenever the platform mixes at another one.
+    int filter_samples_per_second;
+};
+
 #define HANDMADE_H
 #endif
@@ -0,0 +1,1670 @@
+// NOTE: Oscillator phase is a 32-bit fixed-point fraction of a cycle, so it
+// wraps for free and never loses precision, however long the game runs.
+// A phase_step of (tone_hz << 32) / samples_per_second advances it by one
+// sample.
+//
+// sine_of_phase and its 4x and 8x versions must produce exactly the same
+// bits for the same phase; the wide ones only differ in how many samples
+// they produce per step.
+
+// NOTE: sin(2*pi*x) for x in [-0.5, 0.5) cycles. x is first folded into
+// [-0.25, 0.25], where the Taylor series up to x^9 is within 4e-6.
+#define SINE_C1  6.28318531f
+#define SINE_C3 -41.3417022f
+#define SINE_C5  81.6052493f
+#define SINE_C7 -76.7058598f
+#define SINE_C9  42.0586939f
+#define PHASE_TO_CYCLES (1.0f / 4294967296.0f)
+
+inline real32
+sine_of_phase(uint32 phase)
+{
+    real32 x = (real32)(int32)phase*PHASE_TO_CYCLES;
+    real32 abs_x = (x < 0.0f) ? -x : x;
+    real32 mirrored = 0.5f - abs_x;
+    real32 folded = (mirrored < abs_x) ? mirrored : abs_x;
+    x = (x < 0.0f) ? -folded : folded;
+
+    real32 x2 = x*x;
+    real32 Result = x*(SINE_C1 + x2*(SINE_C3 + x2*(SINE_C5 + x2*(SINE_C7 + x2*SINE_C9))));
+
+    return(Result);
+}
+
+// NOTE: sine_of_phase four and eight at a time, same operations in the same
+// order, so the results are the same bits.
+inline __m128
+sine_of_phase_4x(__m128i phase)
+{
+    __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(phase), _mm_set1_ps(PHASE_TO_CYCLES));
+    __m128 sign = _mm_and_ps(x, sign_mask);
+    __m128 abs_x = _mm_andnot_ps(sign_mask, x);
+    __m128 folded = _mm_min_ps(_mm_sub_ps(_mm_set1_ps(0.5f), abs_x), abs_x);
+    x = _mm_or_ps(folded, sign);
+
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 Result = _mm_add_ps(_mm_set1_ps(SINE_C7), _mm_mul_ps(x2, _mm_set1_ps(SINE_C9)));
+    Result = _mm_add_ps(_mm_set1_ps(SINE_C5), _mm_mul_ps(x2, Result));
+    Result = _mm_add_ps(_mm_set1_ps(SINE_C3), _mm_mul_ps(x2, Result));
+    Result = _mm_add_ps(_mm_set1_ps(SINE_C1), _mm_mul_ps(x2, Result));
+    Result = _mm_mul_ps(x, Result);
+
+    return(Result);
+}
+
+HANDMADE_TARGET("avx2") inline __m256
+sine_of_phase_8x(__m256i phase)
+{
+    __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(phase), _mm256_set1_ps(PHASE_TO_CYCLES));
+    __m256 sign = _mm256_and_ps(x, sign_mask);
+    __m256 abs_x = _mm256_andnot_ps(sign_mask, x);
+    __m256 folded = _mm256_min_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), abs_x), abs_x);
+    x = _mm256_or_ps(folded, sign);
+
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 Result = _mm256_add_ps(_mm256_set1_ps(SINE_C7), _mm256_mul_ps(x2, _mm256_set1_ps(SINE_C9)));
+    Result = _mm256_add_ps(_mm256_set1_ps(SINE_C5), _mm256_mul_ps(x2, Result));
+    Result = _mm256_add_ps(_mm256_set1_ps(SINE_C3), _mm256_mul_ps(x2, Result));
+    Result = _mm256_add_ps(_mm256_set1_ps(SINE_C1), _mm256_mul_ps(x2, Result));
+    Result = _mm256_mul_ps(x, Result);
+
+    return(Result);
+}
+
+// NOTE: sin(pi*x) and cos(pi*x) for any x, through sine_of_phase.
+inline real32
+sine_of_half_cycles(real64 x)
+{
+    real64 cycles = 0.5*x;
+    cycles -= (real64)(int64)cycles;
+    real32 Result = sine_of_phase((uint32)(int64)(cycles*4294967296.0));
+    return(Result);
+}
+
+inline uint32
+get_phase_step(int tone_hz, int samples_per_second)
+{
+    uint32 Result = (uint32)((((uint64)tone_hz << 32) + samples_per_second/2) /
+                             (uint64)samples_per_second);
+    return(Result);
+}
+
+//
+// NOTE: Mixer. Three kernels, each with a scalar, an sse2 and an avx2
+// version that must all produce exactly the same bits, the wide ones
+// falling back to the scalar math for the tail: two add a sine voice or a
+// sound voice into the accumulators, the other turns the accumulators into
+// int16 output.
+//
+
+typedef void mix_sine_voice_kernel(real32 *left, real32 *right, int frame_count,
+                                   uint32 phase, uint32 phase_step,
+                                   real32 left_gain, real32 right_gain);
+typedef void mix_pcm_voice_kernel(real32 *left, real32 *right, int frame_count,
+                                  int16 *samples, uint32 channel_count,
+                                  real32 left_gain, real32 right_gain);
+typedef void output_mixed_samples_kernel(int16 *samples, real32 *left, real32 *right,
+                                         int frame_count);
+
+internal void
+mix_sine_voice_scalar(real32 *left, real32 *right, int frame_count,
+                      uint32 phase, uint32 phase_step, real32 left_gain, real32 right_gain)
+{
+    for(int frame_index = 0;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        real32 sine = sine_of_phase(phase);
+        left[frame_index] += sine*left_gain;
+        right[frame_index] += sine*right_gain;
+
+        phase += phase_step;
+    }
+}
+
+internal void
+mix_sine_voice_sse2(real32 *left, real32 *right, int frame_count,
+                    uint32 phase, uint32 phase_step, real32 left_gain, real32 right_gain)
+{
+    __m128 left_gain_4x = _mm_set1_ps(left_gain);
+    __m128 right_gain_4x = _mm_set1_ps(right_gain);
+    __m128i phase_4x = _mm_setr_epi32(phase, phase + phase_step,
+                                      phase + 2*phase_step, phase + 3*phase_step);
+    __m128i phase_step_4x = _mm_set1_epi32(4*phase_step);
+
+    int frame_index = 0;
+    for(;
+        frame_index + 4 <= frame_count;
+        frame_index += 4)
+    {
+        __m128 sine = sine_of_phase_4x(phase_4x);
+        _mm_storeu_ps(left + frame_index,
+                      _mm_add_ps(_mm_loadu_ps(left + frame_index), _mm_mul_ps(sine, left_gain_4x)));
+        _mm_storeu_ps(right + frame_index,
+                      _mm_add_ps(_mm_loadu_ps(right + frame_index), _mm_mul_ps(sine, right_gain_4x)));
+
+        phase_4x = _mm_add_epi32(phase_4x, phase_step_4x);
+    }
+
+    mix_sine_voice_scalar(left + frame_index, right + frame_index, frame_count - frame_index,
+                          phase + (uint32)frame_index*phase_step, phase_step,
+                          left_gain, right_gain);
+}
+
+HANDMADE_TARGET("avx2") internal void
+mix_sine_voice_avx2(real32 *left, real32 *right, int frame_count,
+                    uint32 phase, uint32 phase_step, real32 left_gain, real32 right_gain)
+{
+    __m256 left_gain_8x = _mm256_set1_ps(left_gain);
+    __m256 right_gain_8x = _mm256_set1_ps(right_gain);
+    __m256i phase_8x = _mm256_setr_epi32(phase, phase + phase_step,
+                                         phase + 2*phase_step, phase + 3*phase_step,
+                                         phase + 4*phase_step, phase + 5*phase_step,
+                                         phase + 6*phase_step, phase + 7*phase_step);
+    __m256i phase_step_8x = _mm256_set1_epi32(8*phase_step);
+
+    int frame_index = 0;
+    for(;
+        frame_index + 8 <= frame_count;
+        frame_index += 8)
+    {
+        __m256 sine = sine_of_phase_8x(phase_8x);
+        _mm256_storeu_ps(left + frame_index,
+                         _mm256_add_ps(_mm256_loadu_ps(left + frame_index),
+                                       _mm256_mul_ps(sine, left_gain_8x)));
+        _mm256_storeu_ps(right + frame_index,
+                         _mm256_add_ps(_mm256_loadu_ps(right + frame_index),
+                                       _mm256_mul_ps(sine, right_gain_8x)));
+
+        phase_8x = _mm256_add_epi32(phase_8x, phase_step_8x);
+    }
+
+    mix_sine_voice_scalar(left + frame_index, right + frame_index, frame_count - frame_index,
+                          phase + (uint32)frame_index*phase_step, phase_step,
+                          left_gain, right_gain);
+}
+
+// NOTE: A sound voice at the mixing rate, read straight out of the sound's
+// samples. left_gain and right_gain already carry the 1/32768 that takes a
+// sample to full scale, so every variant does the same one multiply and
+// one add per channel. A mono sound reads its one channel into both.
+internal void
+mix_pcm_voice_scalar(real32 *left, real32 *right, int frame_count,
+                     int16 *samples, uint32 channel_count, real32 left_gain, real32 right_gain)
+{
+    for(int frame_index = 0;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        int16 *frame = samples + channel_count*frame_index;
+        left[frame_index] += (real32)frame[0]*left_gain;
+        right[frame_index] += (real32)frame[channel_count - 1]*right_gain;
+    }
+}
+
+internal void
+mix_pcm_voice_sse2(real32 *left, real32 *right, int frame_count,
+                   int16 *samples, uint32 channel_count, real32 left_gain, real32 right_gain)
+{
+    __m128 left_gain_4x = _mm_set1_ps(left_gain);
+    __m128 right_gain_4x = _mm_set1_ps(right_gain);
+
+    int frame_index = 0;
+    for(;
+        frame_index + 4 <= frame_count;
+        frame_index += 4)
+    {
+        // NOTE: Sign-extended out of the low and high halves of each
+        // 32-bit lane: for stereo that is one frame per lane, for mono one
+        // sample duplicated into both halves.
+        __m128i frames;
+        if(channel_count == 2)
+        {
+            frames = _mm_loadu_si128((__m128i *)(samples + 2*frame_index));
+        }
+        else
+        {
+            frames = _mm_loadl_epi64((__m128i *)(samples + frame_index));
+            frames = _mm_unpacklo_epi16(frames, frames);
+        }
+        __m128 left_sample = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(frames, 16), 16));
+        __m128 right_sample = _mm_cvtepi32_ps(_mm_srai_epi32(frames, 16));
+
+        _mm_storeu_ps(left + frame_index,
+                      _mm_add_ps(_mm_loadu_ps(left + frame_index),
+                                 _mm_mul_ps(left_sample, left_gain_4x)));
+        _mm_storeu_ps(right + frame_index,
+                      _mm_add_ps(_mm_loadu_ps(right + frame_index),
+                                 _mm_mul_ps(right_sample, right_gain_4x)));
+    }
+
+    mix_pcm_voice_scalar(left + frame_index, right + frame_index, frame_count - frame_index,
+                         samples + channel_count*frame_index, channel_count,
+                         left_gain, right_gain);
+}
+
+HANDMADE_TARGET("avx2") internal void
+mix_pcm_voice_avx2(real32 *left, real32 *right, int frame_count,
+                   int16 *samples, uint32 channel_count, real32 left_gain, real32 right_gain)
+{
+    __m256 left_gain_8x = _mm256_set1_ps(left_gain);
+    __m256 right_gain_8x = _mm256_set1_ps(right_gain);
+
+    int frame_index = 0;
+    for(;
+        frame_index + 8 <= frame_count;
+        frame_index += 8)
+    {
+        __m256 left_sample;
+        __m256 right_sample;
+        if(channel_count == 2)
+        {
+            __m256i frames = _mm256_loadu_si256((__m256i *)(samples + 2*frame_index));
+            left_sample = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(frames, 16), 16));
+            right_sample = _mm256_cvtepi32_ps(_mm256_srai_epi32(frames, 16));
+        }
+        else
+        {
+            __m128i frames = _mm_loadu_si128((__m128i *)(samples + frame_index));
+            left_sample = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(frames));
+            right_sample = left_sample;
+        }
+
+        _mm256_storeu_ps(left + frame_index,
+                         _mm256_add_ps(_mm256_loadu_ps(left + frame_index),
+                                       _mm256_mul_ps(left_sample, left_gain_8x)));
+        _mm256_storeu_ps(right + frame_index,
+                         _mm256_add_ps(_mm256_loadu_ps(right + frame_index),
+                                       _mm256_mul_ps(right_sample, right_gain_8x)));
+    }
+
+    mix_pcm_voice_scalar(left + frame_index, right + frame_index, frame_count - frame_index,
+                         samples + channel_count*frame_index, channel_count,
+                         left_gain, right_gain);
+}
+
+// NOTE: A sound voice at any other rate: one 32.32 step through the sound
+// per output frame, interpolating linearly between the frames either side.
+// The last frame has nothing after it and interpolates towards itself. No
+// wide versions; this is the uncommon case.
+internal void
+mix_pcm_voice_interpolated(real32 *left, real32 *right, int frame_count, audio_sound *sound,
+                           uint64 position, uint64 step, real32 left_gain, real32 right_gain)
+{
+    uint32 channel_count = sound->channel_count;
+    uint32 last_frame = sound->frame_count - 1;
+    for(int frame_index = 0;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        uint32 frame = (uint32)(position >> 32);
+        Assert(frame <= last_frame);
+        int16 *from = sound->samples + channel_count*frame;
+        int16 *to = (frame < last_frame) ? from + channel_count : from;
+        real32 t = (real32)(uint32)position*PHASE_TO_CYCLES;
+
+        real32 left_sample = (real32)from[0] + t*(real32)(to[0] - from[0]);
+        real32 right_sample = ((real32)from[channel_count - 1] +
+                               t*(real32)(to[channel_count - 1] - from[channel_count - 1]));
+        left[frame_index] += left_sample*left_gain;
+        right[frame_index] += right_sample*right_gain;
+
+        position += step;
+    }
+}
+
+// NOTE: Clamped in float before the conversion, which truncates: out of
+// range values would otherwise convert to 0x80000000, which is no use for
+// anything loud and positive.
+#define MIXER_FULL_SCALE 32768.0f
+#define MIXER_MIN_SAMPLE -32768.0f
+#define MIXER_MAX_SAMPLE 32767.0f
+
+internal void
+output_mixed_samples_scalar(int16 *samples, real32 *left, real32 *right, int frame_count)
+{
+    int16 *sample_out = samples;
+    for(int frame_index = 0;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        real32 left_value = left[frame_index]*MIXER_FULL_SCALE;
+        real32 right_value = right[frame_index]*MIXER_FULL_SCALE;
+        left_value = (left_value < MIXER_MIN_SAMPLE) ? MIXER_MIN_SAMPLE : left_value;
+        left_value = (left_value > MIXER_MAX_SAMPLE) ? MIXER_MAX_SAMPLE : left_value;
+        right_value = (right_value < MIXER_MIN_SAMPLE) ? MIXER_MIN_SAMPLE : right_value;
+        right_value = (right_value > MIXER_MAX_SAMPLE) ? MIXER_MAX_SAMPLE : right_value;
+
+        *sample_out++ = (int16)left_value;
+        *sample_out++ = (int16)right_value;
+    }
+}
+
+internal void
+output_mixed_samples_sse2(int16 *samples, real32 *left, real32 *right, int frame_count)
+{
+    __m128 full_scale = _mm_set1_ps(MIXER_FULL_SCALE);
+    __m128 min_sample = _mm_set1_ps(MIXER_MIN_SAMPLE);
+    __m128 max_sample = _mm_set1_ps(MIXER_MAX_SAMPLE);
+
+    int16 *sample_out = samples;
+    int frame_index = 0;
+    for(;
+        frame_index + 4 <= frame_count;
+        frame_index += 4)
+    {
+        __m128 left_value = _mm_mul_ps(_mm_loadu_ps(left + frame_index), full_scale);
+        __m128 right_value = _mm_mul_ps(_mm_loadu_ps(right + frame_index), full_scale);
+        left_value = _mm_min_ps(_mm_max_ps(left_value, min_sample), max_sample);
+        right_value = _mm_min_ps(_mm_max_ps(right_value, min_sample), max_sample);
+
+        __m128i left_16 = _mm_cvttps_epi32(left_value);
+        __m128i right_16 = _mm_cvttps_epi32(right_value);
+        left_16 = _mm_packs_epi32(left_16, left_16);
+        right_16 = _mm_packs_epi32(right_16, right_16);
+        _mm_storeu_si128((__m128i *)sample_out, _mm_unpacklo_epi16(left_16, right_16));
+        sample_out += 8;
+    }
+
+    output_mixed_samples_scalar(sample_out, left + frame_index, right + frame_index,
+                                frame_count - frame_index);
+}
+
+HANDMADE_TARGET("avx2") internal void
+output_mixed_samples_avx2(int16 *samples, real32 *left, real32 *right, int frame_count)
+{
+    __m256 full_scale = _mm256_set1_ps(MIXER_FULL_SCALE);
+    __m256 min_sample = _mm256_set1_ps(MIXER_MIN_SAMPLE);
+    __m256 max_sample = _mm256_set1_ps(MIXER_MAX_SAMPLE);
+
+    // NOTE: A ring hands out regions wherever the device happens to be, and
+    // stores that split a cache line cost more than loads that do, so the
+    // first few frames go through the scalar path until the output is
+    // aligned.
+    int frame_index = (int)((32 - ((memory_index)samples & 31)) & 31) / 4;
+    frame_index = (frame_index > frame_count) ? frame_count : frame_index;
+    output_mixed_samples_scalar(samples, left, right, frame_index);
+
+    int16 *sample_out = samples + 2*frame_index;
+    for(;
+        frame_index + 8 <= frame_count;
+        frame_index += 8)
+    {
+        __m256 left_value = _mm256_mul_ps(_mm256_loadu_ps(left + frame_index), full_scale);
+        __m256 right_value = _mm256_mul_ps(_mm256_loadu_ps(right + frame_index), full_scale);
+        left_value = _mm256_min_ps(_mm256_max_ps(left_value, min_sample), max_sample);
+        right_value = _mm256_min_ps(_mm256_max_ps(right_value, min_sample), max_sample);
+
+        // NOTE: pack and unpack work within 128-bit lanes, which keeps
+        // frames 0-3 in the low half and 4-7 in the high half, in order.
+        __m256i left_16 = _mm256_cvttps_epi32(left_value);
+        __m256i right_16 = _mm256_cvttps_epi32(right_value);
+        left_16 = _mm256_packs_epi32(left_16, left_16);
+        right_16 = _mm256_packs_epi32(right_16, right_16);
+        _mm256_storeu_si256((__m256i *)sample_out, _mm256_unpacklo_epi16(left_16, right_16));
+        sample_out += 16;
+    }
+
+    output_mixed_samples_scalar(sample_out, left + frame_index, right + frame_index,
+                                frame_count - frame_index);
+}
+
+internal mix_sine_voice_kernel *
+select_mix_sine_voice_kernel(cpu_features features)
+{
+    mix_sine_voice_kernel *Result = mix_sine_voice_scalar;
+    if(features.avx2)
+    {
+        Result = mix_sine_voice_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = mix_sine_voice_sse2;
+    }
+
+    return(Result);
+}
+
+internal mix_pcm_voice_kernel *
+select_mix_pcm_voice_kernel(cpu_features features)
+{
+    mix_pcm_voice_kernel *Result = mix_pcm_voice_scalar;
+    if(features.avx2)
+    {
+        Result = mix_pcm_voice_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = mix_pcm_voice_sse2;
+    }
+
+    return(Result);
+}
+
+internal output_mixed_samples_kernel *
+select_output_mixed_samples_kernel(cpu_features features)
+{
+    output_mixed_samples_kernel *Result = output_mixed_samples_scalar;
+    if(features.avx2)
+    {
+        Result = output_mixed_samples_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = output_mixed_samples_sse2;
+    }
+
+    return(Result);
+}
+
+//
+// NOTE: Effects. One kernel runs a bus's whole cascade over a chunk, in
+// place; same bit-exact rule as the mixer. Every stage is
+//
+//     y = b0*x + z1
+//     z1 = (b1*x - a1*y) + z2
+//     z2 = b2*x - a2*y
+//
+// in exactly that order, whatever lane it runs in.
+//
+
+typedef void filter_audio_kernel(audio_filter_chain *chain, real32 *left, real32 *right,
+                                 int frame_count);
+
+internal void
+filter_audio_scalar(audio_filter_chain *chain, real32 *left, real32 *right, int frame_count)
+{
+    for(uint32 lane = 0;
+        lane < 2*chain->biquad_count;
+        ++lane)
+    {
+        real32 *samples = (lane & 1) ? right : left;
+        real32 b0 = chain->b0[lane];
+        real32 b1 = chain->b1[lane];
+        real32 b2 = chain->b2[lane];
+        real32 a1 = chain->a1[lane];
+        real32 a2 = chain->a2[lane];
+        real32 z1 = chain->z1[lane];
+        real32 z2 = chain->z2[lane];
+        for(int frame_index = 0;
+            frame_index < frame_count;
+            ++frame_index)
+        {
+            real32 x = samples[frame_index];
+            real32 y = b0*x + z1;
+            z1 = (b1*x - a1*y) + z2;
+            z2 = b2*x - a2*y;
+            samples[frame_index] = y;
+        }
+        chain->z1[lane] = z1;
+        chain->z2[lane] = z2;
+    }
+}
+
+// NOTE: Into left/right pairs and back, four frames at a time.
+internal void
+interleave_audio_frames(real32 *frames, real32 *left, real32 *right, int frame_count)
+{
+    int frame_index = 0;
+    for(;
+        frame_index + 4 <= frame_count;
+        frame_index += 4)
+    {
+        __m128 left_4x = _mm_loadu_ps(left + frame_index);
+        __m128 right_4x = _mm_loadu_ps(right + frame_index);
+        _mm_storeu_ps(frames + 2*frame_index, _mm_unpacklo_ps(left_4x, right_4x));
+        _mm_storeu_ps(frames + 2*frame_index + 4, _mm_unpackhi_ps(left_4x, right_4x));
+    }
+    for(;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        frames[2*frame_index] = left[frame_index];
+        frames[2*frame_index + 1] = right[frame_index];
+    }
+}
+
+internal void
+deinterleave_audio_frames(real32 *left, real32 *right, real32 *frames, int frame_count)
+{
+    int frame_index = 0;
+    for(;
+        frame_index + 4 <= frame_count;
+        frame_index += 4)
+    {
+        __m128 low = _mm_loadu_ps(frames + 2*frame_index);
+        __m128 high = _mm_loadu_ps(frames + 2*frame_index + 4);
+        _mm_storeu_ps(left + frame_index, _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + frame_index, _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    for(;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        left[frame_index] = frames[2*frame_index];
+        right[frame_index] = frames[2*frame_index + 1];
+    }
+}
+
+// NOTE: Two stages per pass. At step s the low pair runs the first stage
+// on frame s and the high pair the second stage on frame s - 1, so a pass
+// takes one step more than there are frames; on the first and the last
+// step one pair has nothing to do, and keeps its state.
+internal void
+filter_audio_sse2(audio_filter_chain *chain, real32 *left, real32 *right, int frame_count)
+{
+    Assert(frame_count <= AUDIO_MIXER_CHUNK_FRAME_COUNT);
+    real32 frames[2*AUDIO_MIXER_CHUNK_FRAME_COUNT];
+    interleave_audio_frames(frames, left, right, frame_count);
+
+    __m128i lane_index = _mm_setr_epi32(0, 1, 2, 3);
+    for(uint32 first_stage = 0;
+        first_stage < chain->biquad_count;
+        first_stage += 2)
+    {
+        uint32 first_lane = 2*first_stage;
+        __m128 b0 = _mm_loadu_ps(chain->b0 + first_lane);
+        __m128 b1 = _mm_loadu_ps(chain->b1 + first_lane);
+        __m128 b2 = _mm_loadu_ps(chain->b2 + first_lane);
+        __m128 a1 = _mm_loadu_ps(chain->a1 + first_lane);
+        __m128 a2 = _mm_loadu_ps(chain->a2 + first_lane);
+        __m128 z1 = _mm_loadu_ps(chain->z1 + first_lane);
+        __m128 z2 = _mm_loadu_ps(chain->z2 + first_lane);
+
+        __m128 y = _mm_setzero_ps();
+        for(int step = 0;
+            step < frame_count + 1;
+            ++step)
+        {
+            __m128 input = _mm_setzero_ps();
+            if(step < frame_count)
+            {
+                input = _mm_castpd_ps(_mm_load_sd((real64 *)(frames + 2*step)));
+            }
+            __m128 x = _mm_movelh_ps(input, y);
+
+            y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+            __m128 next_z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+            __m128 next_z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            if((step < 1) || (step >= frame_count))
+            {
+                // NOTE: The pair for stage g works on frame step - g.
+                __m128i low_lane = _mm_set1_epi32(2*(step - frame_count) + 1);
+                __m128i high_lane = _mm_set1_epi32(2*step + 2);
+                __m128i active_lanes = _mm_and_si128(_mm_cmpgt_epi32(lane_index, low_lane),
+                                                     _mm_cmplt_epi32(lane_index, high_lane));
+                __m128 active = _mm_castsi128_ps(active_lanes);
+                next_z1 = _mm_or_ps(_mm_and_ps(active, next_z1), _mm_andnot_ps(active, z1));
+                next_z2 = _mm_or_ps(_mm_and_ps(active, next_z2), _mm_andnot_ps(active, z2));
+            }
+            z1 = next_z1;
+            z2 = next_z2;
+
+            if(step >= 1)
+            {
+                _mm_storeh_pi((__m64 *)(frames + 2*(step - 1)), y);
+            }
+        }
+
+        _mm_storeu_ps(chain->z1 + first_lane, z1);
+        _mm_storeu_ps(chain->z2 + first_lane, z2);
+    }
+
+    deinterleave_audio_frames(left, right, frames, frame_count);
+}
+
+// NOTE: The same, four stages per pass: the pairs move up one place every
+// step, and the new frame comes in at the bottom.
+HANDMADE_TARGET("avx2") internal void
+filter_audio_avx2(audio_filter_chain *chain, real32 *left, real32 *right, int frame_count)
+{
+    Assert(frame_count <= AUDIO_MIXER_CHUNK_FRAME_COUNT);
+    real32 frames[2*AUDIO_MIXER_CHUNK_FRAME_COUNT];
+    interleave_audio_frames(frames, left, right, frame_count);
+
+    __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i move_up = _mm256_setr_epi32(0, 1, 0, 1, 2, 3, 4, 5);
+    for(uint32 first_stage = 0;
+        first_stage < chain->biquad_count;
+        first_stage += 4)
+    {
+        uint32 first_lane = 2*first_stage;
+        __m256 b0 = _mm256_loadu_ps(chain->b0 + first_lane);
+        __m256 b1 = _mm256_loadu_ps(chain->b1 + first_lane);
+        __m256 b2 = _mm256_loadu_ps(chain->b2 + first_lane);
+        __m256 a1 = _mm256_loadu_ps(chain->a1 + first_lane);
+        __m256 a2 = _mm256_loadu_ps(chain->a2 + first_lane);
+        __m256 z1 = _mm256_loadu_ps(chain->z1 + first_lane);
+        __m256 z2 = _mm256_loadu_ps(chain->z2 + first_lane);
+
+        __m256 y = _mm256_setzero_ps();
+        for(int step = 0;
+            step < frame_count + 3;
+            ++step)
+        {
+            __m256 input = _mm256_setzero_ps();
+            if(step < frame_count)
+            {
+                input = _mm256_castpd_ps(_mm256_broadcast_sd((real64 *)(frames + 2*step)));
+            }
+            __m256 x = _mm256_blend_ps(_mm256_permutevar8x32_ps(y, move_up), input, 0x03);
+
+            y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+            __m256 next_z1 = _mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y));
+            next_z1 = _mm256_add_ps(next_z1, z2);
+            __m256 next_z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+            if((step < 3) || (step >= frame_count))
+            {
+                __m256i low_lane = _mm256_set1_epi32(2*(step - frame_count) + 1);
+                __m256i high_lane = _mm256_set1_epi32(2*step + 2);
+                __m256 active = _mm256_castsi256_ps(
+                    _mm256_and_si256(_mm256_cmpgt_epi32(lane_index, low_lane),
+                                     _mm256_cmpgt_epi32(high_lane, lane_index)));
+                next_z1 = _mm256_blendv_ps(z1, next_z1, active);
+                next_z2 = _mm256_blendv_ps(z2, next_z2, active);
+            }
+            z1 = next_z1;
+            z2 = next_z2;
+
+            if(step >= 3)
+            {
+                _mm_storeh_pi((__m64 *)(frames + 2*(step - 3)), _mm256_extractf128_ps(y, 1));
+            }
+        }
+
+        _mm256_storeu_ps(chain->z1 + first_lane, z1);
+        _mm256_storeu_ps(chain->z2 + first_lane, z2);
+    }
+
+    deinterleave_audio_frames(left, right, frames, frame_count);
+}
+
+internal filter_audio_kernel *
+select_filter_audio_kernel(cpu_features features)
+{
+    filter_audio_kernel *Result = filter_audio_scalar;
+    if(features.avx2)
+    {
+        Result = filter_audio_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = filter_audio_sse2;
+    }
+
+    return(Result);
+}
+
+global_variable mix_sine_voice_kernel *mix_sine_voice_ = 0;
+global_variable filter_audio_kernel *filter_audio_ = 0;
+global_variable mix_pcm_voice_kernel *mix_pcm_voice_ = 0;
+global_variable output_mixed_samples_kernel *output_mixed_samples_ = 0;
+
+// NOTE: The cookbook formulas (Robert Bristow-Johnson's), for a cutoff or
+// center at hz and a q of 0.7071 for a flat Butterworth response. 1 - cos
+// comes from the half-angle sine, which keeps low cutoffs accurate.
+internal audio_biquad
+make_audio_biquad(audio_filter_type type, real32 hz, real32 q, real32 gain,
+                  int samples_per_second)
+{
+    real32 cycles = hz / (real32)samples_per_second;
+    real32 sin_w0 = sine_of_half_cycles(2.0f*cycles);
+    real32 sin_half_w0 = sine_of_half_cycles(cycles);
+    real32 one_minus_cos_w0 = 2.0f*sin_half_w0*sin_half_w0;
+    real32 cos_w0 = 1.0f - one_minus_cos_w0;
+    real32 alpha = sin_w0 / (2.0f*q);
+
+    real32 b0 = 1.0f;
+    real32 b1 = 0.0f;
+    real32 b2 = 0.0f;
+    real32 a0 = 1.0f;
+    real32 a2 = 1.0f;
+    switch(type)
+    {
+        case AudioFilter_low_pass:
+        {
+            b0 = 0.5f*one_minus_cos_w0;
+            b1 = one_minus_cos_w0;
+            b2 = b0;
+            a0 = 1.0f + alpha;
+            a2 = 1.0f - alpha;
+        } break;
+
+        case AudioFilter_high_pass:
+        {
+            b0 = 0.5f*(2.0f - one_minus_cos_w0);
+            b1 = -2.0f*b0;
+            b2 = b0;
+            a0 = 1.0f + alpha;
+            a2 = 1.0f - alpha;
+        } break;
+
+        case AudioFilter_peaking:
+        {
+            real32 a = square_root(gain);
+            b0 = 1.0f + alpha*a;
+            b1 = -2.0f*cos_w0;
+            b2 = 1.0f - alpha*a;
+            a0 = 1.0f + alpha / a;
+            a2 = 1.0f - alpha / a;
+        } break;
+
+        InvalidDefaultCase;
+    }
+
+    audio_biquad Result;
+    Result.b0 = b0 / a0;
+    Result.b1 = b1 / a0;
+    Result.b2 = b2 / a0;
+    Result.a1 = -2.0f*cos_w0 / a0;
+    Result.a2 = a2 / a0;
+
+    return(Result);
+}
+
+internal void
+set_filter_chain_stage(audio_filter_chain *chain, uint32 stage_index, audio_biquad biquad)
+{
+    for(uint32 lane = 2*stage_index;
+        lane < 2*stage_index + 2;
+        ++lane)
+    {
+        chain->b0[lane] = biquad.b0;
+        chain->b1[lane] = biquad.b1;
+        chain->b2[lane] = biquad.b2;
+        chain->a1[lane] = biquad.a1;
+        chain->a2[lane] = biquad.a2;
+    }
+}
+
+// NOTE: Every stage back to passing its input through, with no state.
+internal void
+clear_audio_bus_filters(audio_mixer *mixer, uint32 bus_index)
+{
+    Assert(bus_index < AUDIO_BUS_COUNT);
+    audio_filter_chain *chain = &mixer->buses[bus_index].filters;
+    zero_size(sizeof(*chain), chain);
+
+    audio_biquad pass = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for(uint32 stage_index = 0;
+        stage_index < MAX_AUDIO_BIQUAD_COUNT;
+        ++stage_index)
+    {
+        set_filter_chain_stage(chain, stage_index, pass);
+    }
+}
+
+// NOTE: Replaces stage stage_index, or adds it when it is the one after
+// the last. Returns false when the chain has no room for it.
+internal bool32
+set_audio_bus_filter(audio_mixer *mixer, uint32 bus_index, uint32 stage_index,
+                     audio_biquad biquad)
+{
+    Assert(bus_index < AUDIO_BUS_COUNT);
+    audio_filter_chain *chain = &mixer->buses[bus_index].filters;
+
+    bool32 Result = false;
+    if((stage_index <= chain->biquad_count) && (stage_index < MAX_AUDIO_BIQUAD_COUNT))
+    {
+        set_filter_chain_stage(chain, stage_index, biquad);
+        if(stage_index == chain->biquad_count)
+        {
+            ++chain->biquad_count;
+        }
+        Result = true;
+    }
+
+    return(Result);
+}
+
+internal void
+initialize_audio_mixer(audio_mixer *mixer)
+{
+    zero_size(sizeof(*mixer), mixer);
+
+    // NOTE: Handed out from the end, so the first voice is voice 0.
+    mixer->free_voice_count = MAX_AUDIO_VOICE_COUNT;
+    for(uint32 voice_index = 0;
+        voice_index < MAX_AUDIO_VOICE_COUNT;
+        ++voice_index)
+    {
+        mixer->free_voice_indices[voice_index] = MAX_AUDIO_VOICE_COUNT - 1 - voice_index;
+    }
+
+    for(uint32 bus_index = 0;
+        bus_index < AUDIO_BUS_COUNT;
+        ++bus_index)
+    {
+        clear_audio_bus_filters(mixer, bus_index);
+    }
+}
+
+// NOTE: Voice ids are the pool index plus one, so that 0 is never a voice.
+inline audio_voice *
+get_audio_voice(audio_mixer *mixer, uint32 voice_id)
+{
+    audio_voice *Result = 0;
+    if((voice_id > 0) && (voice_id <= MAX_AUDIO_VOICE_COUNT))
+    {
+        Result = mixer->voices + (voice_id - 1);
+        if(!Result->is_playing)
+        {
+            Result = 0;
+        }
+    }
+
+    return(Result);
+}
+
+internal uint32
+play_sine_voice(audio_mixer *mixer, int tone_hz, real32 volume, real32 pan)
+{
+    uint32 Result = 0;
+    if(mixer->free_voice_count)
+    {
+        uint32 voice_index = mixer->free_voice_indices[--mixer->free_voice_count];
+        audio_voice *voice = mixer->voices + voice_index;
+        zero_size(sizeof(*voice), voice);
+        voice->is_playing = true;
+        voice->tone_hz = tone_hz;
+        voice->volume = volume;
+        voice->pan = pan;
+
+        Result = voice_index + 1;
+    }
+
+    return(Result);
+}
+
+internal void
+stop_audio_voice(audio_mixer *mixer, uint32 voice_id)
+{
+    audio_voice *voice = get_audio_voice(mixer, voice_id);
+    if(voice)
+    {
+        voice->is_playing = false;
+        mixer->free_voice_indices[mixer->free_voice_count++] = voice_id - 1;
+    }
+}
+
+internal void
+set_audio_voice_bus(audio_mixer *mixer, uint32 voice_id, uint32 bus_index)
+{
+    Assert(bus_index < AUDIO_BUS_COUNT);
+    audio_voice *voice = get_audio_voice(mixer, voice_id);
+    if(voice)
+    {
+        voice->bus_index = bus_index;
+    }
+}
+
+//
+// NOTE: Sounds streamed out of mapped WAV files.
+//
+
+#define RIFF_CODE(a, b, c, d) (((uint32)(a) << 0) | ((uint32)(b) << 8) | \
+                               ((uint32)(c) << 16) | ((uint32)(d) << 24))
+
+inline uint32
+read_wav_uint(uint8 *at, int byte_count)
+{
+    uint32 Result = 0;
+    for(int byte_index = byte_count - 1;
+        byte_index >= 0;
+        --byte_index)
+    {
+        Result = (Result << 8) | at[byte_index];
+    }
+
+    return(Result);
+}
+
+// NOTE: Walks the RIFF chunks for "fmt " and "data" and skips everything
+// else. A data chunk that says it is longer than the file (a recording
+// that was never finished, say) plays as much as there is. The samples are
+// used as they are in the file, which is little-endian, like everything we
+// run on. Returns false, with the sound empty, for anything but 16-bit PCM.
+internal bool32
+load_wav(audio_sound *sound, platform_mapped_file file)
+{
+    bool32 Result = false;
+    zero_size(sizeof(*sound), sound);
+    sound->file = file;
+
+    uint8 *at = (uint8 *)file.contents;
+    uint8 *end = at + file.size;
+    if(at && (file.size >= 12) &&
+       (read_wav_uint(at, 4) == RIFF_CODE('R', 'I', 'F', 'F')) &&
+       (read_wav_uint(at + 8, 4) == RIFF_CODE('W', 'A', 'V', 'E')))
+    {
+        uint32 format = 0;
+        uint32 channel_count = 0;
+        uint32 samples_per_second = 0;
+        uint32 bits_per_sample = 0;
+        uint8 *data = 0;
+        uint32 data_size = 0;
+
+        at += 12;
+        while((end - at) >= 8)
+        {
+            uint32 code = read_wav_uint(at, 4);
+            uint32 chunk_size = read_wav_uint(at + 4, 4);
+            uint8 *chunk = at + 8;
+            if(chunk_size > (uint64)(end - chunk))
+            {
+                chunk_size = (uint32)(end - chunk);
+            }
+
+            if((code == RIFF_CODE('f', 'm', 't', ' ')) && (chunk_size >= 16))
+            {
+                format = read_wav_uint(chunk, 2);
+                channel_count = read_wav_uint(chunk + 2, 2);
+                samples_per_second = read_wav_uint(chunk + 4, 4);
+                bits_per_sample = read_wav_uint(chunk + 14, 2);
+
+                // NOTE: WAVE_FORMAT_EXTENSIBLE keeps the real format in the
+                // first two bytes of its subformat GUID.
+                if((format == 0xFFFE) && (chunk_size >= 26))
+                {
+                    format = read_wav_uint(chunk + 24, 2);
+                }
+            }
+            else if(code == RIFF_CODE('d', 'a', 't', 'a'))
+            {
+                data = chunk;
+                data_size = chunk_size;
+            }
+
+            // NOTE: Chunks are padded to an even size.
+            at = chunk + chunk_size + (chunk_size & 1);
+        }
+
+        if((format == 1) && (bits_per_sample == 16) &&
+           ((channel_count == 1) || (channel_count == 2)) &&
+           (samples_per_second > 0) && (samples_per_second <= 0x7FFFFFFF) &&
+           data && !((memory_index)data & 1))
+        {
+            sound->samples = (int16 *)data;
+            sound->channel_count = channel_count;
+            sound->frame_count = data_size / (channel_count*sizeof(int16));
+            sound->samples_per_second = (int32)samples_per_second;
+            Result = true;
+        }
+    }
+
+    return(Result);
+}
+
+// NOTE: The sound has to stay where it is, and mapped, for as long as the
+// voice plays it.
+internal uint32
+play_sound_voice(audio_mixer *mixer, audio_sound *sound, real32 volume, real32 pan,
+                 bool32 is_looping)
+{
+    uint32 Result = 0;
+    if(mixer->free_voice_count && sound->frame_count)
+    {
+        uint32 voice_index = mixer->free_voice_indices[--mixer->free_voice_count];
+        audio_voice *voice = mixer->voices + voice_index;
+        zero_size(sizeof(*voice), voice);
+        voice->is_playing = true;
+        voice->volume = volume;
+        voice->pan = pan;
+        voice->sound = sound;
+        voice->is_looping = is_looping;
+
+        Result = voice_index + 1;
+    }
+
+    return(Result);
+}
+
+internal void
+prefetch_sound_frames(audio_sound *sound, platform_prefetch_file *prefetch_file,
+                      uint32 first_frame, uint32 end_frame)
+{
+    end_frame = (end_frame > sound->frame_count) ? sound->frame_count : end_frame;
+    if(first_frame < end_frame)
+    {
+        uint64 frame_size = sound->channel_count*sizeof(int16);
+        uint64 offset = (uint64)((uint8 *)sound->samples - (uint8 *)sound->file.contents);
+        prefetch_file(&sound->file, offset + first_frame*frame_size,
+                      (end_frame - first_frame)*frame_size);
+    }
+}
+
+// NOTE: Asks for the next window half a window before the voice gets
+// there, so the hint goes out a couple of times a second rather than on
+// every mix, and a looping voice gets its start asked for again before it
+// wraps around to it.
+internal void
+stream_audio_voices(audio_mixer *mixer, platform_prefetch_file *prefetch_file)
+{
+    TIMED_FUNCTION();
+
+    for(uint32 voice_index = 0;
+        voice_index < MAX_AUDIO_VOICE_COUNT;
+        ++voice_index)
+    {
+        audio_voice *voice = mixer->voices + voice_index;
+        audio_sound *sound = voice->sound;
+        if(voice->is_playing && sound)
+        {
+            uint32 frame = (uint32)(voice->position >> 32);
+            uint32 window_frame_count = AUDIO_STREAM_PREFETCH_SECONDS*sound->samples_per_second;
+            if((uint64)frame + window_frame_count/2 >= voice->prefetch_frame)
+            {
+                uint64 window_end = (uint64)frame + window_frame_count;
+                uint32 first_frame = ((voice->prefetch_frame > frame) ?
+                                      voice->prefetch_frame : frame);
+                prefetch_sound_frames(sound, prefetch_file, first_frame,
+                                      (window_end > sound->frame_count) ?
+                                      sound->frame_count : (uint32)window_end);
+                if(voice->is_looping && (window_end > sound->frame_count))
+                {
+                    prefetch_sound_frames(sound, prefetch_file, 0,
+                                          (uint32)(window_end - sound->frame_count));
+                }
+
+                voice->prefetch_frame = (window_end > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32)window_end;
+            }
+        }
+    }
+}
+
+// NOTE: Mixes until the chunk is full or the sound runs out. A looping
+// voice carries on from the start, keeping the fraction of its position;
+// any other voice stops.
+internal void
+mix_sound_voice(audio_mixer *mixer, uint32 voice_index, real32 *left, real32 *right,
+                int frame_count, int samples_per_second, real32 left_gain, real32 right_gain)
+{
+    audio_voice *voice = mixer->voices + voice_index;
+    audio_sound *sound = voice->sound;
+    uint64 step = ((uint64)sound->samples_per_second << 32) / (uint64)samples_per_second;
+    uint64 end = (uint64)sound->frame_count << 32;
+    left_gain *= 1.0f / MIXER_FULL_SCALE;
+    right_gain *= 1.0f / MIXER_FULL_SCALE;
+
+    int frame_index = 0;
+    while(frame_index < frame_count)
+    {
+        if(voice->position >= end)
+        {
+            if(!voice->is_looping)
+            {
+                stop_audio_voice(mixer, voice_index + 1);
+                break;
+            }
+            voice->position %= end;
+            voice->prefetch_frame = 0;
+        }
+
+        uint64 remaining_count = (end - voice->position + step - 1) / step;
+        int mix_count = frame_count - frame_index;
+        if((uint64)mix_count > remaining_count)
+        {
+            mix_count = (int)remaining_count;
+        }
+
+        if(step == ((uint64)1 << 32))
+        {
+            uint32 frame = (uint32)(voice->position >> 32);
+            mix_pcm_voice_(left + frame_index, right + frame_index, mix_count,
+                           sound->samples + sound->channel_count*frame, sound->channel_count,
+                           left_gain, right_gain);
+        }
+        else
+        {
+            mix_pcm_voice_interpolated(left + frame_index, right + frame_index,
+                                       mix_count, sound, voice->position, step,
+                                       left_gain, right_gain);
+        }
+        voice->position += (uint64)mix_count*step;
+        frame_index += mix_count;
+    }
+}
+
+//
+// NOTE: Ring buffer writes. No kernels here, just the arithmetic every
+// platform used to do inline.
+//
+
+inline uint32
+get_audio_ring_sample_count(audio_ring_regions *regions)
+{
+    uint32 Result = regions->sample_count[0] + regions->sample_count[1];
+
+    return(Result);
+}
+
+// NOTE: One region, for a buffer that does not wrap.
+inline audio_ring_regions
+get_contiguous_audio_regions(int16 *samples, uint32 sample_count)
+{
+    audio_ring_regions Result = {};
+    Result.samples[0] = samples;
+    Result.sample_count[0] = sample_count;
+
+    return(Result);
+}
+
+internal audio_ring_regions
+get_audio_ring_regions(int16 *ring_samples, uint32 ring_sample_count, uint32 write_index,
+                       uint32 sample_count)
+{
+    Assert((write_index < ring_sample_count) && (sample_count <= ring_sample_count));
+
+    audio_ring_regions Result = {};
+    Result.samples[0] = ring_samples + 2*write_index;
+    Result.sample_count[0] = ring_sample_count - write_index;
+    if(Result.sample_count[0] >= sample_count)
+    {
+        Result.sample_count[0] = sample_count;
+    }
+    else
+    {
+        Result.samples[1] = ring_samples;
+        Result.sample_count[1] = sample_count - Result.sample_count[0];
+    }
+
+    return(Result);
+}
+
+// NOTE: play_index is where the device is playing, safe_index the earliest
+// place it lets us write; anything between the two it may already have
+// read. The first measure always resyncs, and is not an xrun.
+inline audio_ring_position
+measure_audio_ring(uint32 ring_sample_count, uint32 running_sample_index,
+                   uint32 play_index, uint32 safe_index, uint32 max_delay_sample_count)
+{
+    audio_ring_position Result = {};
+    Result.running_sample_index = running_sample_index;
+    Result.write_index = running_sample_index % ring_sample_count;
+    Result.delay_sample_count = ((Result.write_index + ring_sample_count - play_index) %
+                                 ring_sample_count);
+
+    uint32 safety_sample_count = (safe_index + ring_sample_count - play_index) % ring_sample_count;
+    if((Result.delay_sample_count < safety_sample_count) ||
+       (Result.delay_sample_count > max_delay_sample_count))
+    {
+        Result.ran_dry = (running_sample_index != 0);
+        Result.running_sample_index = safe_index;
+        Result.write_index = safe_index;
+        Result.delay_sample_count = safety_sample_count;
+    }
+
+    return(Result);
+}
+
+internal void
+mix_audio(audio_mixer *mixer, audio_ring_regions *regions, int samples_per_second)
+{
+    TIMED_FUNCTION();
+
+    if(!mix_sine_voice_)
+    {
+        cpu_features features = get_cpu_features();
+        mix_sine_voice_ = select_mix_sine_voice_kernel(features);
+        mix_pcm_voice_ = select_mix_pcm_voice_kernel(features);
+        filter_audio_ = select_filter_audio_kernel(features);
+        output_mixed_samples_ = select_output_mixed_samples_kernel(features);
+    }
+
+    int sample_count = (int)get_audio_ring_sample_count(regions);
+    int region_index = 0;
+    int16 *sample_out = regions->samples[0];
+    int region_left = (int)regions->sample_count[0];
+    for(int chunk_start = 0;
+        chunk_start < sample_count;
+        chunk_start += AUDIO_MIXER_CHUNK_FRAME_COUNT)
+    {
+        int frame_count = sample_count - chunk_start;
+        if(frame_count > AUDIO_MIXER_CHUNK_FRAME_COUNT)
+        {
+            frame_count = AUDIO_MIXER_CHUNK_FRAME_COUNT;
+        }
+
+        // NOTE: A bus is only cleared once something plays on it, or it
+        // has filters whose tails still have to ring out.
+        audio_bus *master = mixer->buses;
+        bool32 bus_is_live[AUDIO_BUS_COUNT];
+        for(uint32 bus_index = 0;
+            bus_index < AUDIO_BUS_COUNT;
+            ++bus_index)
+        {
+            audio_bus *bus = mixer->buses + bus_index;
+            bus_is_live[bus_index] = ((bus_index == 0) || bus->filters.biquad_count);
+            if(bus_is_live[bus_index])
+            {
+                zero_size(frame_count*sizeof(real32), bus->left);
+                zero_size(frame_count*sizeof(real32), bus->right);
+            }
+        }
+
+        for(uint32 voice_index = 0;
+            voice_index < MAX_AUDIO_VOICE_COUNT;
+            ++voice_index)
+        {
+            audio_voice *voice = mixer->voices + voice_index;
+            if(voice->is_playing)
+            {
+                audio_bus *bus = mixer->buses + voice->bus_index;
+                if(!bus_is_live[voice->bus_index])
+                {
+                    bus_is_live[voice->bus_index] = true;
+                    zero_size(frame_count*sizeof(real32), bus->left);
+                    zero_size(frame_count*sizeof(real32), bus->right);
+                }
+
+                // NOTE: Balance rather than constant power, so a centered
+                // voice plays at exactly its volume in both channels.
+                real32 left_gain = voice->volume*((voice->pan > 0.0f) ? (1.0f - voice->pan) : 1.0f);
+                real32 right_gain = voice->volume*((voice->pan < 0.0f) ? (1.0f + voice->pan) : 1.0f);
+                if(voice->sound)
+                {
+                    mix_sound_voice(mixer, voice_index, bus->left, bus->right, frame_count,
+                                    samples_per_second, left_gain, right_gain);
+                }
+                else
+                {
+                    uint32 phase_step = get_phase_step(voice->tone_hz, samples_per_second);
+
+                    mix_sine_voice_(bus->left, bus->right, frame_count,
+                                    voice->phase, phase_step, left_gain, right_gain);
+                    voice->phase += (uint32)frame_count*phase_step;
+                }
+            }
+        }
+
+        for(uint32 bus_index = 1;
+            bus_index < AUDIO_BUS_COUNT;
+            ++bus_index)
+        {
+            audio_bus *bus = mixer->buses + bus_index;
+            if(bus_is_live[bus_index])
+            {
+                if(bus->filters.biquad_count)
+                {
+                    filter_audio_(&bus->filters, bus->left, bus->right, frame_count);
+                }
+                for(int frame_index = 0;
+                    frame_index < frame_count;
+                    ++frame_index)
+                {
+                    master->left[frame_index] += bus->left[frame_index];
+                    master->right[frame_index] += bus->right[frame_index];
+                }
+            }
+        }
+        if(master->filters.biquad_count)
+        {
+            filter_audio_(&master->filters, master->left, master->right, frame_count);
+        }
+
+        // NOTE: The one chunk that straddles the wrap is converted in two
+        // goes, the rest of it into the second region.
+        int output_start = 0;
+        while(output_start < frame_count)
+        {
+            if(!region_left)
+            {
+                ++region_index;
+                Assert(region_index < 2);
+                sample_out = regions->samples[region_index];
+                region_left = (int)regions->sample_count[region_index];
+            }
+
+            int output_count = frame_count - output_start;
+            if(output_count > region_left)
+            {
+                output_count = region_left;
+            }
+            output_mixed_samples_(sample_out, master->left + output_start,
+                                  master->right + output_start, output_count);
+            sample_out += 2*output_count;
+            region_left -= output_count;
+            output_start += output_count;
+        }
+    }
+}
+
+//
+// NOTE: Resampler. The one kernel turns history into as many output frames
+// as the history allows; same bit-exact rule as above. Each tap sum is
+// accumulated in eight lanes (tap i into lane i % 8) and then folded in a
+// fixed order, which is what the SIMD versions do naturally.
+//
+
+typedef int resample_kernel(audio_resampler *resampler, int16 *output, int output_frame_count);
+
+internal void
+initialize_audio_resampler(audio_resampler *resampler,
+                           int32 input_samples_per_second, int32 output_samples_per_second)
+{
+    zero_size(sizeof(*resampler), resampler);
+    resampler->input_samples_per_second = input_samples_per_second;
+    resampler->output_samples_per_second = output_samples_per_second;
+    resampler->step = (((uint64)input_samples_per_second << 32) /
+                       (uint64)output_samples_per_second);
+
+    // NOTE: Half a filter of silence up front, so the first output frame
+    // lines up with the first input frame, give or take one frame.
+    resampler->history_frame_count = RESAMPLER_TAP_COUNT/2;
+
+    // NOTE: Cutoff in cycles per input frame, a little below the lower
+    // Nyquist rate so the Blackman window's transition band fits under it.
+    real64 cutoff = 0.45;
+    if(output_samples_per_second < input_samples_per_second)
+    {
+        cutoff *= (real64)output_samples_per_second / (real64)input_samples_per_second;
+    }
+
+    real64 half_width = 0.5*RESAMPLER_TAP_COUNT;
+    for(int phase_index = 0;
+        phase_index <= RESAMPLER_PHASE_COUNT;
+        ++phase_index)
+    {
+        real32 *row = resampler->coefficients + phase_index*RESAMPLER_TAP_COUNT;
+        real64 fraction = (real64)phase_index / (real64)RESAMPLER_PHASE_COUNT;
+        real64 sum = 0.0;
+        for(int tap_index = 0;
+            tap_index < RESAMPLER_TAP_COUNT;
+            ++tap_index)
+        {
+            // NOTE: Distance from the output instant, which sits just past
+            // the middle of the taps.
+            real64 t = (real64)tap_index - fraction - (half_width - 1.0);
+            real64 x = 2.0*cutoff*t;
+            real64 sinc = (x != 0.0) ? (sine_of_half_cycles(x) / (Pi32*x)) : 1.0;
+            real64 u = t / half_width;
+            real64 window = 0.0;
+            if((u > -1.0) && (u < 1.0))
+            {
+                window = (0.42 + 0.5*sine_of_half_cycles(u + 0.5) +
+                          0.08*sine_of_half_cycles(2.0*u + 0.5));
+            }
+            real64 coefficient = sinc*window;
+            row[tap_index] = (real32)coefficient;
+            sum += coefficient;
+        }
+
+        // NOTE: Unity gain at DC for every phase, or the output would
+        // ripple at the rate the phases cycle.
+        for(int tap_index = 0;
+            tap_index < RESAMPLER_TAP_COUNT;
+            ++tap_index)
+        {
+            row[tap_index] = (real32)(row[tap_index] / sum);
+        }
+    }
+}
+
+inline int16
+resampler_output_sample(real32 value)
+{
+    value = (value < MIXER_MIN_SAMPLE) ? MIXER_MIN_SAMPLE : value;
+    value = (value > MIXER_MAX_SAMPLE) ? MIXER_MAX_SAMPLE : value;
+    return((int16)value);
+}
+
+inline real32
+resampler_fold_lanes(real32 *lanes)
+{
+    real32 t0 = lanes[0] + lanes[4];
+    real32 t1 = lanes[1] + lanes[5];
+    real32 t2 = lanes[2] + lanes[6];
+    real32 t3 = lanes[3] + lanes[7];
+    real32 Result = (t0 + t2) + (t1 + t3);
+    return(Result);
+}
+
+inline real32
+resampler_dot_scalar(real32 *history, real32 *row)
+{
+    real32 lanes[8] = {};
+    for(int tap_index = 0;
+        tap_index < RESAMPLER_TAP_COUNT;
+        ++tap_index)
+    {
+        lanes[tap_index % 8] += history[tap_index]*row[tap_index];
+    }
+    real32 Result = resampler_fold_lanes(lanes);
+    return(Result);
+}
+
+internal int
+resample_scalar(audio_resampler *resampler, int16 *output, int output_frame_count)
+{
+    int frame_index = 0;
+    for(;
+        frame_index < output_frame_count;
+        ++frame_index)
+    {
+        uint32 base = (uint32)(resampler->position >> 32);
+        if(base + RESAMPLER_TAP_COUNT > resampler->history_frame_count)
+        {
+            break;
+        }
+        uint32 fraction = (uint32)resampler->position;
+        uint32 phase_index = fraction >> 24;
+        real32 weight = (real32)(fraction & 0xFFFFFF)*(1.0f / 16777216.0f);
+        real32 *row0 = resampler->coefficients + phase_index*RESAMPLER_TAP_COUNT;
+        real32 *row1 = row0 + RESAMPLER_TAP_COUNT;
+
+        real32 left0 = resampler_dot_scalar(resampler->history_left + base, row0);
+        real32 left1 = resampler_dot_scalar(resampler->history_left + base, row1);
+        real32 right0 = resampler_dot_scalar(resampler->history_right + base, row0);
+        real32 right1 = resampler_dot_scalar(resampler->history_right + base, row1);
+        *output++ = resampler_output_sample(left0 + weight*(left1 - left0));
+        *output++ = resampler_output_sample(right0 + weight*(right1 - right0));
+
+        resampler->position += resampler->step;
+    }
+
+    return(frame_index);
+}
+
+inline real32
+resampler_fold_4x(__m128 t)
+{
+    __m128 u = _mm_add_ps(t, _mm_movehl_ps(t, t));
+    u = _mm_add_ss(u, _mm_shuffle_ps(u, u, _MM_SHUFFLE(1, 1, 1, 1)));
+    return(_mm_cvtss_f32(u));
+}
+
+inline real32
+resampler_dot_sse2(real32 *history, real32 *row)
+{
+    __m128 low = _mm_setzero_ps();
+    __m128 high = _mm_setzero_ps();
+    for(int tap_index = 0;
+        tap_index < RESAMPLER_TAP_COUNT;
+        tap_index += 8)
+    {
+        low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(history + tap_index),
+                                         _mm_loadu_ps(row + tap_index)));
+        high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(history + tap_index + 4),
+                                           _mm_loadu_ps(row + tap_index + 4)));
+    }
+    return(resampler_fold_4x(_mm_add_ps(low, high)));
+}
+
+internal int
+resample_sse2(audio_resampler *resampler, int16 *output, int output_frame_count)
+{
+    int frame_index = 0;
+    for(;
+        frame_index < output_frame_count;
+        ++frame_index)
+    {
+        uint32 base = (uint32)(resampler->position >> 32);
+        if(base + RESAMPLER_TAP_COUNT > resampler->history_frame_count)
+        {
+            break;
+        }
+        uint32 fraction = (uint32)resampler->position;
+        uint32 phase_index = fraction >> 24;
+        real32 weight = (real32)(fraction & 0xFFFFFF)*(1.0f / 16777216.0f);
+        real32 *row0 = resampler->coefficients + phase_index*RESAMPLER_TAP_COUNT;
+        real32 *row1 = row0 + RESAMPLER_TAP_COUNT;
+
+        real32 left0 = resampler_dot_sse2(resampler->history_left + base, row0);
+        real32 left1 = resampler_dot_sse2(resampler->history_left + base, row1);
+        real32 right0 = resampler_dot_sse2(resampler->history_right + base, row0);
+        real32 right1 = resampler_dot_sse2(resampler->history_right + base, row1);
+        *output++ = resampler_output_sample(left0 + weight*(left1 - left0));
+        *output++ = resampler_output_sample(right0 + weight*(right1 - right0));
+
+        resampler->position += resampler->step;
+    }
+
+    return(frame_index);
+}
+
+HANDMADE_TARGET("avx2") inline real32
+resampler_dot_avx2(real32 *history, real32 *row)
+{
+    __m256 sum = _mm256_setzero_ps();
+    for(int tap_index = 0;
+        tap_index < RESAMPLER_TAP_COUNT;
+        tap_index += 8)
+    {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(history + tap_index),
+                                               _mm256_loadu_ps(row + tap_index)));
+    }
+    return(resampler_fold_4x(_mm_add_ps(_mm256_castps256_ps128(sum),
+                                        _mm256_extractf128_ps(sum, 1))));
+}
+
+HANDMADE_TARGET("avx2") internal int
+resample_avx2(audio_resampler *resampler, int16 *output, int output_frame_count)
+{
+    int frame_index = 0;
+    for(;
+        frame_index < output_frame_count;
+        ++frame_index)
+    {
+        uint32 base = (uint32)(resampler->position >> 32);
+        if(base + RESAMPLER_TAP_COUNT > resampler->history_frame_count)
+        {
+            break;
+        }
+        uint32 fraction = (uint32)resampler->position;
+        uint32 phase_index = fraction >> 24;
+        real32 weight = (real32)(fraction & 0xFFFFFF)*(1.0f / 16777216.0f);
+        real32 *row0 = resampler->coefficients + phase_index*RESAMPLER_TAP_COUNT;
+        real32 *row1 = row0 + RESAMPLER_TAP_COUNT;
+
+        real32 left0 = resampler_dot_avx2(resampler->history_left + base, row0);
+        real32 left1 = resampler_dot_avx2(resampler->history_left + base, row1);
+        real32 right0 = resampler_dot_avx2(resampler->history_right + base, row0);
+        real32 right1 = resampler_dot_avx2(resampler->history_right + base, row1);
+        *output++ = resampler_output_sample(left0 + weight*(left1 - left0));
+        *output++ = resampler_output_sample(right0 + weight*(right1 - right0));
+
+        resampler->position += resampler->step;
+    }
+
+    return(frame_index);
+}
+
+internal resample_kernel *
+select_resample_kernel(cpu_features features)
+{
+    resample_kernel *Result = resample_scalar;
+    if(features.avx2)
+    {
+        Result = resample_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = resample_sse2;
+    }
+
+    return(Result);
+}
+
+global_variable resample_kernel *resample_ = 0;
+
+internal int
+get_resampler_input_frame_count(audio_resampler *resampler, int output_frame_count)
+{
+    int Result = 0;
+    if(output_frame_count > 0)
+    {
+        uint64 last_position = resampler->position + (uint64)(output_frame_count - 1)*resampler->step;
+        uint64 needed = (last_position >> 32) + RESAMPLER_TAP_COUNT;
+        if(needed > resampler->history_frame_count)
+        {
+            Result = (int)(needed - resampler->history_frame_count);
+        }
+    }
+
+    return(Result);
+}
+
+// NOTE: Takes all of the input, and returns how many output frames that
+// made, which is never more than output_frame_count.
+internal int
+resample_audio(audio_resampler *resampler, int16 *input, int input_frame_count,
+               int16 *output, int output_frame_count)
+{
+    TIMED_FUNCTION();
+
+    if(!resample_)
+    {
+        resample_ = select_resample_kernel(get_cpu_features());
+    }
+
+    int Result = 0;
+    for(;;)
+    {
+        uint32 space = RESAMPLER_HISTORY_FRAME_COUNT - resampler->history_frame_count;
+        uint32 copy_count = ((uint32)input_frame_count < space) ? (uint32)input_frame_count : space;
+        real32 *left = resampler->history_left + resampler->history_frame_count;
+        real32 *right = resampler->history_right + resampler->history_frame_count;
+        for(uint32 frame_index = 0;
+            frame_index < copy_count;
+            ++frame_index)
+        {
+            *left++ = (real32)*input++;
+            *right++ = (real32)*input++;
+        }
+        resampler->history_frame_count += copy_count;
+        input_frame_count -= copy_count;
+
+        int made = resample_(resampler, output + 2*Result, output_frame_count - Result);
+        Result += made;
+
+        // NOTE: Drop the history no future output frame reaches back to.
+        uint32 consumed = (uint32)(resampler->position >> 32);
+        if(consumed > resampler->history_frame_count)
+        {
+            consumed = resampler->history_frame_count;
+        }
+        uint32 kept = resampler->history_frame_count - consumed;
+        for(uint32 frame_index = 0;
+            frame_index < kept;
+            ++frame_index)
+        {
+            resampler->history_left[frame_index] = resampler->history_left[consumed + frame_index];
+            resampler->history_right[frame_index] = resampler->history_right[consumed + frame_index];
+        }
+        resampler->history_frame_count = kept;
+        resampler->position -= (uint64)consumed << 32;
+
+        // NOTE: Stuck only when given more input than the output asked
+        // for, and then the rest of it is dropped.
+        bool32 stuck = (!copy_count && !made && !consumed);
+        Assert(!stuck);
+        if(!input_frame_count || stuck)
+        {
+            break;
+        }
+    }
+
+    return(Result);
+}
@@ -0,0 +1,223 @@
+#if !defined(HANDMADE_AUDIO_H)
+
+/* NOTE:
+
+   1) All game sound goes through the mixer: every voice is summed into a
+      float accumulation buffer, left and right kept apart, and only the
+      final sum, after the effects, is converted to interleaved int16,
+      clamped to full scale in one pass.
+
+   2) Voices come from a fixed pool that lives in the game state, so
+      starting one never allocates. play_sine_voice and play_sound_voice
+      hand back a voice id (0 when the pool is full) that stays valid
+      until the voice is stopped, or its sound runs out.
+
+   3) Accumulators are in units of full scale: 1.0 is int16 32768. Volume
+      scales a voice linearly; pan runs from -1 (left only) through 0 (both
+      channels at full volume) to 1 (right only).
+*/
+
+#define MAX_AUDIO_VOICE_COUNT 256
+#define AUDIO_MIXER_CHUNK_FRAME_COUNT 1024
+
+/* NOTE:
+
+   Sounds streamed from WAV files the platform maps into memory.
+
+   1) load_wav only finds the PCM in the file: samples points straight into
+      the mapping, so nothing is decoded or copied, and a sound costs
+      whatever of it the OS file cache holds.
+
+   2) A sound voice reads its frames from the mapping as it mixes them.
+      stream_audio_voices runs before every mix and asks the platform to
+      read ahead AUDIO_STREAM_PREFETCH_SECONDS past each voice, so only the
+      first pages of a sound are ever waited for, when it starts.
+
+   3) Only 16-bit PCM, mono or stereo. A sound at the mixing rate is
+      mixed as it is; any other rate is stepped through in 32.32 fixed
+      point with linear interpolation.
+*/
+
+#define AUDIO_STREAM_PREFETCH_SECONDS 1
+
+struct audio_sound
+{
+    platform_mapped_file file;
+
+    int16 *samples;
+    uint32 channel_count;
+    uint32 frame_count;
+    int32 samples_per_second;
+};
+
+struct audio_voice
+{
+    bool32 is_playing;
+    real32 volume;
+    real32 pan;
+    uint32 bus_index;
+
+    // NOTE: Sine voices only.
+    int tone_hz;
+    uint32 phase;
+
+    // NOTE: Sound voices only; sound is 0 for a sine voice. position is in
+    // frames of the sound, 32.32 fixed point. Everything before
+    // prefetch_frame has been asked for already.
+    audio_sound *sound;
+    bool32 is_looping;
+    uint64 position;
+    uint32 prefetch_frame;
+};
+
+/* NOTE:
+
+   Effects, between the mix and the conversion to int16.
+
+   1) Every voice plays on one of AUDIO_BUS_COUNT buses, 0 unless it is
+      moved. Bus 0 is the master: the other buses are mixed into it after
+      their own effects, and its effects are the last thing everything goes
+      through.
+
+   2) A bus's effects are a cascade of up to MAX_AUDIO_BIQUAD_COUNT
+      biquads, in transposed direct form II, run in place over the bus a
+      chunk at a time. make_audio_biquad designs low-pass, high-pass and
+      peaking EQ stages with the usual cookbook formulas. Coefficients and
+      state live in the mixer, so changing or running them never
+      allocates, and changing a stage keeps its state, so a filter can be
+      swept while it plays.
+
+   3) The wide kernels interleave a chunk into left/right pairs, so two
+      lanes run one stage on both channels, and run a group of stages at
+      once: each pair of lanes is one frame behind the pair before it, and
+      takes what that pair just produced as its input.
+*/
+
+#define AUDIO_BUS_COUNT 4
+#define MAX_AUDIO_BIQUAD_COUNT 8
+
+enum audio_filter_type
+{
+    AudioFilter_low_pass,
+    AudioFilter_high_pass,
+    // NOTE: gain is linear, e.g. 2 for +6dB at hz.
+    AudioFilter_peaking,
+};
+
+// NOTE: Normalized, so a0 is 1.
+struct audio_biquad
+{
+    real32 b0;
+    real32 b1;
+    real32 b2;
+    real32 a1;
+    real32 a2;
+};
+
+struct audio_filter_chain
+{
+    uint32 biquad_count;
+
+    // NOTE: Each value twice, left then right, so lanes load them as they
+    // are. Stages past biquad_count pass their input straight through,
+    // which lets the wide kernels always run whole groups.
+    real32 b0[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 b1[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 b2[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 a1[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 a2[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 z1[2*MAX_AUDIO_BIQUAD_COUNT];
+    real32 z2[2*MAX_AUDIO_BIQUAD_COUNT];
+};
+
+struct audio_bus
+{
+    audio_filter_chain filters;
+
+    // NOTE: Mixed a chunk at a time, however many samples are asked for.
+    real32 left[AUDIO_MIXER_CHUNK_FRAME_COUNT];
+    real32 right[AUDIO_MIXER_CHUNK_FRAME_COUNT];
+};
+
+struct audio_mixer
+{
+    uint32 free_voice_count;
+    uint32 free_voice_indices[MAX_AUDIO_VOICE_COUNT];
+    audio_voice voices[MAX_AUDIO_VOICE_COUNT];
+
+    audio_bus buses[AUDIO_BUS_COUNT];
+};
+
+/* NOTE:
+
+   Writing ahead of a device that plays out of a ring buffer, the same on
+   every platform. Positions and counts are in stereo samples.
+
+   1) measure_audio_ring takes where the device is playing and the
+      earliest place it lets us write, and works out where our next sample
+      goes and how many are still queued ahead of the play position. If
+      the device played past everything we wrote, the write jumps up to
+      the earliest safe place and ran_dry tells the platform, so it can
+      count the xrun.
+
+   2) get_audio_ring_regions splits a write at the end of the ring into
+      the two regions, the way DirectSound's Lock does, for rings that the
+      platform keeps itself.
+
+   3) mix_audio writes straight across both regions: the voices are mixed
+      a chunk at a time as usual, and only the conversion to int16 is
+      split where the ring wraps.
+*/
+
+struct audio_ring_position
+{
+    // NOTE: Every sample written so far; moved up to the write cursor
+    // after the device ran dry.
+    uint32 running_sample_index;
+    uint32 write_index;
+    uint32 delay_sample_count;
+    bool32 ran_dry;
+};
+
+/* NOTE:
+
+   Sample-rate conversion, for platforms whose device does not run at the
+   rate the game mixes at.
+
+   1) Windowed-sinc polyphase FIR: RESAMPLER_TAP_COUNT taps, with the
+      filter stored at RESAMPLER_PHASE_COUNT fractional offsets (plus one
+      more row, for the offset of a whole sample). An output sample
+      linearly interpolates between the two rows around its exact offset,
+      so any pair of rates works, not just small ratios.
+
+   2) The cutoff sits below the lower of the two Nyquist rates, so going
+      down in rate also filters out what the output could not hold.
+
+   3) Input is kept as planar float history. Asking
+      get_resampler_input_frame_count first tells the caller exactly how
+      many input frames give the number of output frames it wants.
+*/
+
+#define RESAMPLER_TAP_COUNT 32
+#define RESAMPLER_PHASE_COUNT 256
+#define RESAMPLER_HISTORY_FRAME_COUNT 4096
+
+struct audio_resampler
+{
+    int32 input_samples_per_second;
+    int32 output_samples_per_second;
+
+    // NOTE: In input frames, 32.32 fixed point. position is relative to
+    // the first frame of history.
+    uint64 step;
+    uint64 position;
+
+    uint32 history_frame_count;
+    real32 history_left[RESAMPLER_HISTORY_FRAME_COUNT];
+    real32 history_right[RESAMPLER_HISTORY_FRAME_COUNT];
+
+    real32 coefficients[(RESAMPLER_PHASE_COUNT + 1)*RESAMPLER_TAP_COUNT];
+};
+
+#define HANDMADE_AUDIO_H
+#endif
@@ -0,0 +1,81 @@
+#include "handmade_audio_latency.h"
+
+internal void
+audio_latency_init(audio_latency_controller *controller, int32 samples_per_second,
+                   int32 min_sample_count, int32 max_sample_count, int32 initial_sample_count)
+{
+    zero_size(sizeof(*controller), controller);
+    controller->samples_per_second = samples_per_second;
+    controller->min_sample_count = min_sample_count;
+    controller->max_sample_count = max_sample_count;
+
+    // NOTE: 2ms of delay we never shrink into, for the jitter of the
+    // measurement itself.
+    controller->margin_sample_count = samples_per_second / 500;
+
+    controller->target_sample_count = initial_sample_count;
+    if(controller->target_sample_count < min_sample_count)
+    {
+        controller->target_sample_count = min_sample_count;
+    }
+    if(controller->target_sample_count > max_sample_count)
+    {
+        controller->target_sample_count = max_sample_count;
+    }
+    controller->window_min_delay = controller->target_sample_count;
+}
+
+internal int32
+audio_latency_update(audio_latency_controller *controller, int32 delay_sample_count,
+                     uint32 xrun_count)
+{
+    int32 target = controller->target_sample_count;
+
+    if(xrun_count != controller->xrun_count)
+    {
+        controller->xrun_count = xrun_count;
+
+        target += target/2 + controller->margin_sample_count;
+        controller->window_frame_count = 0;
+        controller->window_min_delay = target;
+        controller->hold_window_count = AUDIO_LATENCY_HOLD_WINDOWS;
+    }
+    else
+    {
+        if(delay_sample_count < controller->window_min_delay)
+        {
+            controller->window_min_delay = delay_sample_count;
+        }
+
+        if(++controller->window_frame_count >= AUDIO_LATENCY_WINDOW_FRAMES)
+        {
+            if(controller->hold_window_count)
+            {
+                --controller->hold_window_count;
+            }
+            else
+            {
+                int32 slack = controller->window_min_delay - controller->margin_sample_count;
+                if(slack > 1)
+                {
+                    target -= slack/2;
+                }
+            }
+
+            controller->window_frame_count = 0;
+            controller->window_min_delay = target;
+        }
+    }
+
+    if(target < controller->min_sample_count)
+    {
+        target = controller->min_sample_count;
+    }
+    if(target > controller->max_sample_count)
+    {
+        target = controller->max_sample_count;
+    }
+    controller->target_sample_count = target;
+
+    return(target);
+}
@@ -0,0 +1,43 @@
+#if !defined(HANDMADE_AUDIO_LATENCY_H)
+
+/* NOTE:
+
+   Picks how far ahead of the sound device the platform keeps writing,
+   instead of a fixed guess. The platform calls audio_latency_update once
+   per frame, just before it tops the sound up, with:
+
+     - the delay: how many samples are still queued ahead of what the
+       device is playing right now, that is, how close it is to running dry;
+     - its running count of xruns (underruns the listener could hear).
+
+   1) Any new xrun grows the target by half and holds it there for a few
+      windows, so one bad stretch does not bounce straight back down.
+
+   2) Otherwise the lowest delay over a window of frames is the slack we
+      never needed. Half of whatever is above the safety margin is taken
+      off the target at the end of the window, so it settles just above
+      the worst frame-to-frame jitter it has seen.
+
+   3) The target always stays between the platform's min and max; the min
+      is what the device itself needs queued to keep running.
+*/
+
+#define AUDIO_LATENCY_WINDOW_FRAMES 120
+#define AUDIO_LATENCY_HOLD_WINDOWS 4
+
+struct audio_latency_controller
+{
+    int32 samples_per_second;
+    int32 min_sample_count;
+    int32 max_sample_count;
+    int32 margin_sample_count;
+    int32 target_sample_count;
+
+    uint32 xrun_count;
+    int32 window_frame_count;
+    int32 window_min_delay;
+    int32 hold_window_count;
+};
+
+#define HANDMADE_AUDIO_LATENCY_H
+#endif
@@ -0,0 +1,2303 @@
+//
+// NOTE: Standalone micro-benchmarks for the game layer hot loops. Every
+// variant is checked against the scalar reference before it is timed, so a
+// run doubles as a correctness check.
+//
+//   g++ -O2 -o handmade_bench handmade_bench.cc -lpthread
+//
+// Add -DHANDMADE_PROFILE=1 to also measure the timed block overhead and get
+// the profile of everything the benchmarks ran.
+//
+
+#include "handmade.h"
+#include "handmade.cc"
+#include "linux_work_queue.cc"
+#include "linux_mapped_file.cc"
+#include "linux_sample_format.cc"
+#include "linux_sample_ring.cc"
+#include "linux_sound_sink.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+
+struct bench_gradient_kernel
+{
+    char const *name;
+    render_weird_gradient_kernel *kernel;
+    bool32 available;
+};
+
+internal game_offscreen_buffer
+bench_allocate_buffer(int width, int height, int pitch)
+{
+    game_offscreen_buffer Result = {};
+    Result.width = width;
+    Result.height = height;
+    Result.pitch = pitch;
+    Result.memory = calloc(height, pitch);
+
+    return(Result);
+}
+
+internal game_memory
+bench_allocate_game_memory(platform_work_queue *queue)
+{
+    game_memory Result = {};
+    Result.render_queue = queue;
+    Result.add_entry = linux_add_entry;
+    Result.complete_all_work = linux_complete_all_work;
+    Result.map_file = linux_map_file;
+    Result.unmap_file = linux_unmap_file;
+    Result.prefetch_file = linux_prefetch_file;
+    Result.permanent_storage_size = Megabytes(1);
+    Result.permanent_storage = calloc(1, Result.permanent_storage_size);
+    Result.transient_storage_size = Megabytes(16);
+    Result.transient_storage = calloc(1, Result.transient_storage_size);
+
+    return(Result);
+}
+
+internal void
+bench_free_game_memory(game_memory *memory)
+{
+    free(memory->permanent_storage);
+    free(memory->transient_storage);
+}
+
+internal bool32
+bench_gradient_matches(render_weird_gradient_kernel *kernel)
+{
+    bool32 Result = true;
+
+    // NOTE: Odd widths exercise the scalar tail, the padded pitch checks we
+    // never write past the row, negative offsets check the byte wrap.
+    int sizes[][2] = {{1, 1}, {3, 2}, {17, 5}, {33, 9}, {1280, 720}};
+    int offsets[][2] = {{0, 0}, {5, -5}, {-1000, 77}, {123456, -98765}};
+    for(int size_index = 0;
+        size_index < (int)ArrayCount(sizes);
+        ++size_index)
+    {
+        int width = sizes[size_index][0];
+        int height = sizes[size_index][1];
+        int pitch = (width + 7)*4;
+        game_offscreen_buffer expected = bench_allocate_buffer(width, height, pitch);
+        game_offscreen_buffer actual = bench_allocate_buffer(width, height, pitch);
+
+        for(int offset_index = 0;
+            offset_index < (int)ArrayCount(offsets);
+            ++offset_index)
+        {
+            int blue_offset = offsets[offset_index][0];
+            int green_offset = offsets[offset_index][1];
+            render_weird_gradient_scalar(&expected, blue_offset, green_offset);
+            kernel(&actual, blue_offset, green_offset);
+            if(memcmp(expected.memory, actual.memory, height*pitch) != 0)
+            {
+                printf("  mismatch at %dx%d, offsets %d,%d\n",
+                       width, height, blue_offset, green_offset);
+                Result = false;
+            }
+        }
+
+        free(expected.memory);
+        free(actual.memory);
+    }
+
+    return(Result);
+}
+
+internal bool32
+bench_render_weird_gradient(void)
+{
+    bool32 Result = true;
+
+    cpu_features features = get_cpu_features();
+    bench_gradient_kernel kernels[] =
+    {
+        {"scalar", render_weird_gradient_scalar, true},
+        {"sse2", render_weird_gradient_sse2, features.sse2},
+        {"avx2", render_weird_gradient_avx2, features.avx2},
+        {"avx512", render_weird_gradient_avx512, features.avx512},
+    };
+
+    int resolutions[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    int const repeat_count = 50;
+
+    printf("render_weird_gradient (cycles/pixel, best of %d)\n", repeat_count);
+    for(int kernel_index = 0;
+        kernel_index < (int)ArrayCount(kernels);
+        ++kernel_index)
+    {
+        bench_gradient_kernel *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s not supported by this CPU\n", kernel->name);
+            continue;
+        }
+
+        if(!bench_gradient_matches(kernel->kernel))
+        {
+            printf("  %-8s FAILED bit-exact check\n", kernel->name);
+            Result = false;
+            continue;
+        }
+
+        printf("  %-8s", kernel->name);
+        for(int resolution_index = 0;
+            resolution_index < (int)ArrayCount(resolutions);
+            ++resolution_index)
+        {
+            int width = resolutions[resolution_index][0];
+            int height = resolutions[resolution_index][1];
+            game_offscreen_buffer buffer = bench_allocate_buffer(width, height, width*4);
+
+            uint64 best_cycles = (uint64)-1;
+            for(int repeat = 0;
+                repeat < repeat_count;
+                ++repeat)
+            {
+                uint64 start = read_cpu_timer();
+                kernel->kernel(&buffer, repeat, repeat);
+                uint64 elapsed = read_cpu_timer() - start;
+                if(elapsed < best_cycles)
+                {
+                    best_cycles = elapsed;
+                }
+            }
+
+            printf("  %dx%d: %6.3f", width, height,
+                   (real64)best_cycles / (real64)(width*height));
+            free(buffer.memory);
+        }
+        printf("\n");
+    }
+
+    return(Result);
+}
+
+internal int64
+bench_get_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return((int64)now.tv_sec*1000000000LL + now.tv_nsec);
+}
+
+struct bench_sine_kernel
+{
+    char const *name;
+    mix_sine_voice_kernel *kernel;
+    bool32 available;
+};
+
+// NOTE: What game_get_sound_samples used to do, into the accumulators: sinf
+// on an unwrapped float phase, with the period rounded to whole samples.
+internal void
+bench_mix_sine_voice_libm(real32 *left, real32 *right, int frame_count, real32 *t_sine,
+                          int tone_hz, int samples_per_second, real32 gain)
+{
+    int wave_period = samples_per_second/tone_hz;
+    for(int frame_index = 0;
+        frame_index < frame_count;
+        ++frame_index)
+    {
+        real32 sine = sinf(*t_sine);
+        left[frame_index] += sine*gain;
+        right[frame_index] += sine*gain;
+
+        *t_sine += 2.0f*Pi32*1.0f/(real32)wave_period;
+    }
+}
+
+internal bool32
+bench_mix_sine_voice(void)
+{
+    bool32 Result = true;
+
+    // NOTE: The polynomial against libm, over every 4096th phase.
+    real64 max_error = 0.0;
+    for(uint64 phase = 0;
+        phase < ((uint64)1 << 32);
+        phase += 4096)
+    {
+        real64 exact = sin(2.0*3.14159265358979323846*(real64)(int32)(uint32)phase / 4294967296.0);
+        real64 error = fabs(sine_of_phase((uint32)phase) - exact);
+        if(error > max_error)
+        {
+            max_error = error;
+        }
+    }
+    printf("mix_sine_voice: max error %.2e against libm\n", max_error);
+    if(max_error > 1e-5)
+    {
+        printf("mix_sine_voice: FAILED polynomial is off\n");
+        Result = false;
+    }
+
+    // NOTE: An hour at 48kHz: the old float accumulator is unusable by then,
+    // the fixed-point phase is exact by construction.
+    int samples_per_second = 48000;
+    int tone_hz = 256;
+    int64 hour_sample_count = 3600LL*samples_per_second;
+    real32 t_sine = 0.0f;
+    int wave_period = samples_per_second/tone_hz;
+    for(int64 sample_index = 0;
+        sample_index < hour_sample_count;
+        ++sample_index)
+    {
+        t_sine += 2.0f*Pi32*1.0f/(real32)wave_period;
+    }
+    real64 exact_t_sine = 2.0*3.14159265358979323846*(real64)hour_sample_count / (real64)wave_period;
+    printf("mix_sine_voice: float phase off by %.3f rad after an hour\n",
+           fabs((real64)t_sine - exact_t_sine));
+
+    cpu_features features = get_cpu_features();
+    bench_sine_kernel kernels[] =
+    {
+        {"scalar", mix_sine_voice_scalar, true},
+        {"sse2", mix_sine_voice_sse2, features.sse2},
+        {"avx2", mix_sine_voice_avx2, features.avx2},
+    };
+
+    // NOTE: One mixer chunk at a time, as mix_audio runs them.
+    int const block_frame_count = AUDIO_MIXER_CHUNK_FRAME_COUNT;
+    int const repeat_count = 2000;
+    memory_index block_size = 2*block_frame_count*sizeof(real32);
+    real32 *expected = (real32 *)malloc(block_size);
+    real32 *samples = (real32 *)malloc(block_size);
+    uint32 phase_step = get_phase_step(tone_hz, samples_per_second);
+    real32 const left_gain = 0.25f;
+    real32 const right_gain = 0.125f;
+
+    printf("mix_sine_voice (ns/frame, best of %d chunks of %d)\n",
+           repeat_count, block_frame_count);
+    {
+        real64 best_ns = 1e30;
+        t_sine = 0.0f;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            int64 start = bench_get_ns();
+            bench_mix_sine_voice_libm(samples, samples + block_frame_count, block_frame_count,
+                                      &t_sine, tone_hz, samples_per_second, left_gain);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+        }
+        printf("  %-8s %6.3f\n", "libm", best_ns / (real64)block_frame_count);
+    }
+
+    for(int kernel_index = 0;
+        kernel_index < (int)ArrayCount(kernels);
+        ++kernel_index)
+    {
+        bench_sine_kernel *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s not supported by this CPU\n", kernel->name);
+            continue;
+        }
+
+        // NOTE: Odd counts and phases near the wrap exercise the tails.
+        bool32 matches = true;
+        uint32 phases[] = {0, 0x7FFFFFF0, 0xFFFFFF00, 12345};
+        int counts[] = {block_frame_count, 1, 7, block_frame_count - 1};
+        for(int test_index = 0;
+            test_index < (int)ArrayCount(phases);
+            ++test_index)
+        {
+            memset(expected, 0, block_size);
+            memset(samples, 0, block_size);
+            mix_sine_voice_scalar(expected, expected + block_frame_count, counts[test_index],
+                                  phases[test_index], phase_step*(test_index + 1),
+                                  left_gain, right_gain);
+            kernel->kernel(samples, samples + block_frame_count, counts[test_index],
+                           phases[test_index], phase_step*(test_index + 1),
+                           left_gain, right_gain);
+            if(memcmp(expected, samples, block_size) != 0)
+            {
+                matches = false;
+            }
+        }
+        if(!matches)
+        {
+            printf("  %-8s FAILED bit-exact check\n", kernel->name);
+            Result = false;
+            continue;
+        }
+
+        real64 best_ns = 1e30;
+        uint32 phase = 0;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            int64 start = bench_get_ns();
+            kernel->kernel(samples, samples + block_frame_count, block_frame_count,
+                           phase, phase_step, left_gain, right_gain);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+            phase += (uint32)block_frame_count*phase_step;
+        }
+        printf("  %-8s %6.3f\n", kernel->name, best_ns / (real64)block_frame_count);
+    }
+
+    free(expected);
+    free(samples);
+
+    return(Result);
+}
+
+struct bench_mixer_kernels
+{
+    char const *name;
+    mix_sine_voice_kernel *mix_sine_voice;
+    output_mixed_samples_kernel *output_mixed_samples;
+    bool32 available;
+};
+
+// NOTE: A full pool of voices spread over pitch, volume and pan, with a
+// sample count that is not a multiple of the chunk or of any SIMD width.
+internal void
+bench_fill_mixer(audio_mixer *mixer)
+{
+    initialize_audio_mixer(mixer);
+    uint32 random = 777;
+    for(int voice_index = 0;
+        voice_index < MAX_AUDIO_VOICE_COUNT;
+        ++voice_index)
+    {
+        random = random*1664525 + 1013904223;
+        int tone_hz = 50 + (int)((random >> 8) % 4000);
+        real32 volume = 0.002f + 0.008f*(real32)((random >> 4) & 0xF) / 15.0f;
+        real32 pan = -1.0f + 2.0f*(real32)(random >> 24) / 255.0f;
+        play_sine_voice(mixer, tone_hz, volume, pan);
+    }
+}
+
+internal bool32
+bench_audio_mixer(void)
+{
+    bool32 Result = true;
+
+    int const samples_per_second = 48000;
+    int const block_sample_count = 4801;
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    int16 *expected = (int16 *)malloc(samples_per_second*2*sizeof(int16));
+    int16 *samples = (int16 *)malloc(samples_per_second*2*sizeof(int16));
+
+    // NOTE: The pool hands out every voice once, then refuses, and takes
+    // them back.
+    bench_fill_mixer(mixer);
+    if(play_sine_voice(mixer, 440, 1.0f, 0.0f) != 0)
+    {
+        printf("audio mixer: FAILED handed out more voices than the pool holds\n");
+        Result = false;
+    }
+    stop_audio_voice(mixer, 17);
+    if((get_audio_voice(mixer, 17) != 0) || (play_sine_voice(mixer, 440, 0.0f, 0.0f) != 17))
+    {
+        printf("audio mixer: FAILED did not reuse a stopped voice\n");
+        Result = false;
+    }
+
+    // NOTE: Eight voices in phase at half volume sum to four times full
+    // scale, which must clamp and never wrap around.
+    initialize_audio_mixer(mixer);
+    for(int voice_index = 0;
+        voice_index < 8;
+        ++voice_index)
+    {
+        play_sine_voice(mixer, 440, 0.5f, 0.0f);
+    }
+    audio_ring_regions regions = get_contiguous_audio_regions(samples, block_sample_count);
+    mix_audio(mixer, &regions, samples_per_second);
+    uint32 phase_step = get_phase_step(440, samples_per_second);
+    int wrapped_count = 0;
+    int clamped_count = 0;
+    for(int frame_index = 0;
+        frame_index < block_sample_count;
+        ++frame_index)
+    {
+        real32 sine = sine_of_phase((uint32)frame_index*phase_step);
+        int16 value = samples[2*frame_index];
+        if(((sine > 0.01f) && (value <= 0)) || ((sine < -0.01f) && (value >= 0)) ||
+           (value != samples[2*frame_index + 1]))
+        {
+            ++wrapped_count;
+        }
+        if((value == 32767) || (value == -32768))
+        {
+            ++clamped_count;
+        }
+    }
+    if(wrapped_count || !clamped_count)
+    {
+        printf("audio mixer: FAILED %d samples wrapped around instead of clamping\n",
+               wrapped_count);
+        Result = false;
+    }
+
+    cpu_features features = get_cpu_features();
+    bench_mixer_kernels kernels[] =
+    {
+        {"scalar", mix_sine_voice_scalar, output_mixed_samples_scalar, true},
+        {"sse2", mix_sine_voice_sse2, output_mixed_samples_sse2, features.sse2},
+        {"avx2", mix_sine_voice_avx2, output_mixed_samples_avx2, features.avx2},
+    };
+
+    int const repeat_count = 5;
+    printf("audio mixer (%d voices, %% of one core at %dHz, best of %d seconds)\n",
+           MAX_AUDIO_VOICE_COUNT, samples_per_second, repeat_count);
+    for(int kernel_index = 0;
+        kernel_index < (int)ArrayCount(kernels);
+        ++kernel_index)
+    {
+        bench_mixer_kernels *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s unavailable\n", kernel->name);
+            continue;
+        }
+        mix_sine_voice_ = kernel->mix_sine_voice;
+        output_mixed_samples_ = kernel->output_mixed_samples;
+
+        bench_fill_mixer(mixer);
+        regions = get_contiguous_audio_regions((kernel_index == 0) ? expected : samples,
+                                               block_sample_count);
+        mix_audio(mixer, &regions, samples_per_second);
+        if((kernel_index > 0) &&
+           (memcmp(expected, samples, block_sample_count*2*sizeof(int16)) != 0))
+        {
+            printf("  %-8s FAILED does not match scalar\n", kernel->name);
+            Result = false;
+            continue;
+        }
+
+        real64 best_ns = 1e30;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            regions = get_contiguous_audio_regions(samples, samples_per_second);
+            int64 start = bench_get_ns();
+            mix_audio(mixer, &regions, samples_per_second);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+        }
+        printf("  %-8s %6.2f%%\n", kernel->name, best_ns / 1e7);
+    }
+    mix_sine_voice_ = 0;
+    output_mixed_samples_ = 0;
+
+    free(mixer);
+    free(expected);
+    free(samples);
+
+    return(Result);
+}
+
+// NOTE: The ring writer against a simulated DirectSound buffer: the cursor
+// arithmetic, the split at the end of the ring, and a mix that straddles
+// the wrap coming out the same as one into a flat buffer. Then what writing
+// across the wrap saves over mixing into a flat buffer and copying it in.
+internal bool32
+bench_audio_ring(void)
+{
+    bool32 Result = true;
+
+    uint32 const ring_sample_count = 48000;
+    uint32 const max_delay = 12000;
+    struct
+    {
+        uint32 running_sample_index;
+        uint32 play_index;
+        uint32 safe_index;
+        audio_ring_position expected;
+    } cases[] =
+    {
+        // NOTE: The first measure jumps to the write cursor, without an xrun.
+        {0, 100, 1060, {1060, 1060, 960, false}},
+        // NOTE: 3000 queued, across the end of the ring.
+        {ring_sample_count + 1000, 46000, 46960, {ring_sample_count + 1000, 1000, 3000, false}},
+        // NOTE: The device played past what we wrote.
+        {5000, 5200, 6160, {6160, 6160, 960, true}},
+        // NOTE: Written inside the part the device may already have read.
+        {5500, 5000, 5960, {5960, 5960, 960, true}},
+    };
+    for(int case_index = 0;
+        case_index < (int)ArrayCount(cases);
+        ++case_index)
+    {
+        audio_ring_position position = measure_audio_ring(ring_sample_count,
+                                                          cases[case_index].running_sample_index,
+                                                          cases[case_index].play_index,
+                                                          cases[case_index].safe_index, max_delay);
+        audio_ring_position *expected = &cases[case_index].expected;
+        if((position.running_sample_index != expected->running_sample_index) ||
+           (position.write_index != expected->write_index) ||
+           (position.delay_sample_count != expected->delay_sample_count) ||
+           (position.ran_dry != expected->ran_dry))
+        {
+            printf("audio ring: FAILED case %d measured %u/%u/%u/%d\n", case_index,
+                   position.running_sample_index, position.write_index,
+                   position.delay_sample_count, position.ran_dry);
+            Result = false;
+        }
+    }
+
+    int16 *ring = (int16 *)malloc(ring_sample_count*2*sizeof(int16));
+    int16 *flat = (int16 *)malloc(ring_sample_count*2*sizeof(int16));
+    audio_ring_regions fits = get_audio_ring_regions(ring, ring_sample_count, 100, 900);
+    audio_ring_regions wraps = get_audio_ring_regions(ring, ring_sample_count,
+                                                      ring_sample_count - 700, 2500);
+    if((fits.samples[0] != ring + 200) || (fits.sample_count[0] != 900) || fits.sample_count[1] ||
+       (wraps.sample_count[0] != 700) || (wraps.samples[1] != ring) ||
+       (wraps.sample_count[1] != 1800))
+    {
+        printf("audio ring: FAILED split at the end of the ring\n");
+        Result = false;
+    }
+
+    // NOTE: 700 samples before the wrap is inside the first mixer chunk.
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    bench_fill_mixer(mixer);
+    audio_ring_regions flat_regions = get_contiguous_audio_regions(flat, 2500);
+    mix_audio(mixer, &flat_regions, 48000);
+    bench_fill_mixer(mixer);
+    mix_audio(mixer, &wraps, 48000);
+    if((memcmp(ring + 2*(ring_sample_count - 700), flat, 700*2*sizeof(int16)) != 0) ||
+       (memcmp(ring, flat + 2*700, 1800*2*sizeof(int16)) != 0))
+    {
+        printf("audio ring: FAILED mixing across the wrap does not match a flat buffer\n");
+        Result = false;
+    }
+
+    // NOTE: One 60Hz frame of sound a time, always straddling the wrap,
+    // with a single voice so the write itself is what gets measured.
+    initialize_audio_mixer(mixer);
+    play_sine_voice(mixer, 440, 0.5f, 0.0f);
+    uint32 const write_count = 800;
+    int const repeat_count = 2000;
+    real64 best_copy_ns = 1e30;
+    real64 best_direct_ns = 1e30;
+    for(int repeat = 0;
+        repeat < repeat_count;
+        ++repeat)
+    {
+        int64 start = bench_get_ns();
+        flat_regions = get_contiguous_audio_regions(flat, write_count);
+        mix_audio(mixer, &flat_regions, 48000);
+        int16 *source = flat;
+        for(int region_index = 0;
+            region_index < 2;
+            ++region_index)
+        {
+            int16 *dest = wraps.samples[region_index];
+            for(uint32 sample_index = 0;
+                sample_index < ((region_index == 0) ? 300 : write_count - 300);
+                ++sample_index)
+            {
+                *dest++ = *source++;
+                *dest++ = *source++;
+            }
+        }
+        real64 elapsed = (real64)(bench_get_ns() - start);
+        best_copy_ns = (elapsed < best_copy_ns) ? elapsed : best_copy_ns;
+
+        start = bench_get_ns();
+        audio_ring_regions regions = get_audio_ring_regions(ring, ring_sample_count,
+                                                            ring_sample_count - 300, write_count);
+        mix_audio(mixer, &regions, 48000);
+        elapsed = (real64)(bench_get_ns() - start);
+        best_direct_ns = (elapsed < best_direct_ns) ? elapsed : best_direct_ns;
+    }
+    printf("audio ring (ns/sample, %u samples across the wrap, best of %d)\n",
+           write_count, repeat_count);
+    printf("  %-16s %6.3f\n", "mix then copy", best_copy_ns / write_count);
+    printf("  %-16s %6.3f\n", "mix into regions", best_direct_ns / write_count);
+
+    free(mixer);
+    free(flat);
+    free(ring);
+
+    return(Result);
+}
+
+struct bench_resample_kernel
+{
+    char const *name;
+    resample_kernel *kernel;
+    bool32 available;
+};
+
+// NOTE: Feeds a tone through in uneven blocks, asking for the exact input
+// count every time, the way a platform tops up its buffer. Returns the
+// worst error against the exact tone at the output instants, past the
+// filter's warm-up, relative to the amplitude; or -1 when a block did not
+// come out at the size asked for.
+internal real64
+bench_resample_tone(audio_resampler *resampler, int input_rate, int output_rate,
+                    real64 tone_hz, int16 *input, int16 *output, int output_frame_count)
+{
+    real64 const amplitude = 16000.0;
+    real64 const two_pi = 2.0*3.14159265358979323846;
+    initialize_audio_resampler(resampler, input_rate, output_rate);
+
+    int64 input_index = 0;
+    int output_index = 0;
+    while(output_index < output_frame_count)
+    {
+        int block_frame_count = 1 + ((output_index*7) % 700);
+        if(block_frame_count > output_frame_count - output_index)
+        {
+            block_frame_count = output_frame_count - output_index;
+        }
+
+        int input_frame_count = get_resampler_input_frame_count(resampler, block_frame_count);
+        for(int frame_index = 0;
+            frame_index < input_frame_count;
+            ++frame_index)
+        {
+            int16 value = (int16)(amplitude*sin(two_pi*tone_hz*(real64)input_index / input_rate));
+            input[2*frame_index] = value;
+            input[2*frame_index + 1] = (int16)-value;
+            ++input_index;
+        }
+
+        int made = resample_audio(resampler, input, input_frame_count,
+                                  output + 2*output_index, block_frame_count);
+        if(made != block_frame_count)
+        {
+            return(-1.0);
+        }
+        output_index += made;
+    }
+
+    // NOTE: Output frame k lands on input frame k*step - 1 (see
+    // initialize_audio_resampler).
+    real64 max_error = 0.0;
+    for(int frame_index = 64;
+        frame_index < output_frame_count;
+        ++frame_index)
+    {
+        real64 input_time = (real64)((uint64)frame_index*resampler->step) / 4294967296.0 - 1.0;
+        real64 exact = amplitude*sin(two_pi*tone_hz*input_time / input_rate);
+        real64 error = fabs((real64)output[2*frame_index] - exact);
+        real64 right_error = fabs((real64)output[2*frame_index + 1] + exact);
+        error = (right_error > error) ? right_error : error;
+        max_error = (error > max_error) ? error : max_error;
+    }
+
+    return(max_error / amplitude);
+}
+
+internal bool32
+bench_resampler(void)
+{
+    bool32 Result = true;
+
+    int const input_rate = 48000;
+    int const output_frame_count = 96000;
+    audio_resampler *resampler = (audio_resampler *)malloc(sizeof(audio_resampler));
+    int16 *input = (int16 *)malloc(2*2*output_frame_count*sizeof(int16));
+    int16 *expected = (int16 *)malloc(2*output_frame_count*sizeof(int16));
+    int16 *output = (int16 *)malloc(2*output_frame_count*sizeof(int16));
+
+    // NOTE: Pass band: a 1kHz tone comes through to within 0.1% everywhere
+    // we might open a device.
+    resample_ = resample_scalar;
+    int output_rates[] = {44100, 32000, 22050, 96000, 48000};
+    printf("resampler: 1kHz from %dHz, max error relative to the amplitude\n", input_rate);
+    for(int rate_index = 0;
+        rate_index < (int)ArrayCount(output_rates);
+        ++rate_index)
+    {
+        real64 error = bench_resample_tone(resampler, input_rate, output_rates[rate_index],
+                                           1000.0, input, output, output_frame_count);
+        printf("  %6dHz %.2e\n", output_rates[rate_index], error);
+        if((error < 0.0) || (error > 1e-3))
+        {
+            printf("  FAILED\n");
+            Result = false;
+        }
+    }
+
+    // NOTE: Stop band: 18kHz cannot exist at 22050Hz and must be filtered
+    // out, not folded down to 4050Hz.
+    bench_resample_tone(resampler, input_rate, 22050, 18000.0, input, output, output_frame_count);
+    int16 loudest = 0;
+    for(int index = 2*64;
+        index < 2*output_frame_count;
+        ++index)
+    {
+        int16 value = (output[index] < 0) ? (int16)-output[index] : output[index];
+        loudest = (value > loudest) ? value : loudest;
+    }
+    printf("resampler: 18kHz to 22050Hz leaves %d of 16000\n", loudest);
+    if(loudest > 160)
+    {
+        printf("resampler: FAILED aliasing\n");
+        Result = false;
+    }
+
+    cpu_features features = get_cpu_features();
+    bench_resample_kernel kernels[] =
+    {
+        {"scalar", resample_scalar, true},
+        {"sse2", resample_sse2, features.sse2},
+        {"avx2", resample_avx2, features.avx2},
+    };
+
+    int const repeat_count = 20;
+    printf("resampler 48000Hz to 44100Hz (ns/output frame, best of %d)\n", repeat_count);
+    for(int kernel_index = 0;
+        kernel_index < (int)ArrayCount(kernels);
+        ++kernel_index)
+    {
+        bench_resample_kernel *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s unavailable\n", kernel->name);
+            continue;
+        }
+        resample_ = kernel->kernel;
+
+        bench_resample_tone(resampler, input_rate, 44100, 1234.5, input,
+                            (kernel_index == 0) ? expected : output, output_frame_count);
+        if((kernel_index > 0) &&
+           (memcmp(expected, output, 2*output_frame_count*sizeof(int16)) != 0))
+        {
+            printf("  %-8s FAILED does not match scalar\n", kernel->name);
+            Result = false;
+            continue;
+        }
+
+        int input_frame_count = get_resampler_input_frame_count(resampler, 44100);
+        real64 best_ns = 1e30;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            int64 start = bench_get_ns();
+            resample_audio(resampler, input, input_frame_count, output, 44100);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+            input_frame_count = get_resampler_input_frame_count(resampler, 44100);
+        }
+        printf("  %-8s %6.2f\n", kernel->name, best_ns / 44100.0);
+    }
+    resample_ = 0;
+
+    free(resampler);
+    free(input);
+    free(expected);
+    free(output);
+
+    return(Result);
+}
+
+// NOTE: Byte-at-a-time reference for each device format, the way alsa.c's
+// old generate_sine wrote them.
+internal void
+bench_write_sample_reference(linux_sample_format format, uint8 *out, int16 value)
+{
+    uint32 wide = (uint32)(uint16)value << 16;
+    switch(format)
+    {
+        case LINUX_SAMPLE_S16_LE: {out[0] = (uint8)value; out[1] = (uint8)(value >> 8);} break;
+        case LINUX_SAMPLE_S24_3LE: {out[0] = 0; out[1] = (uint8)value; out[2] = (uint8)(value >> 8);} break;
+        case LINUX_SAMPLE_S32_LE:
+        {
+            for(int byte_index = 0; byte_index < 4; ++byte_index)
+            {
+                out[byte_index] = (uint8)(wide >> (8*byte_index));
+            }
+        } break;
+        case LINUX_SAMPLE_FLOAT_LE:
+        {
+            real32 sample = (real32)value / 32768.0f;
+            memcpy(out, &sample, 4);
+        } break;
+        case LINUX_SAMPLE_U8: {out[0] = (uint8)((value >> 8) ^ 0x80);} break;
+        InvalidDefaultCase;
+    }
+}
+
+internal bool32
+bench_sample_writers(void)
+{
+    bool32 Result = true;
+
+    // NOTE: Every 16-bit value, plus an odd count to hit the tails.
+    long const value_count = 65536 + 13;
+    int16 *source = (int16 *)malloc(value_count*sizeof(int16));
+    for(long index = 0;
+        index < value_count;
+        ++index)
+    {
+        source[index] = (int16)(index*7919);
+    }
+    uint8 *expected = (uint8 *)malloc(value_count*4);
+    uint8 *written = (uint8 *)malloc(value_count*4);
+
+    int const repeat_count = 200;
+    printf("sample writers (ns/value, best of %d)\n", repeat_count);
+    for(int format = 0;
+        format < LINUX_SAMPLE_FORMAT_COUNT;
+        ++format)
+    {
+        linux_sample_format_info *info = linux_sample_formats + format;
+        for(long index = 0;
+            index < value_count;
+            ++index)
+        {
+            bench_write_sample_reference((linux_sample_format)format,
+                                         expected + index*info->bytes_per_sample, source[index]);
+        }
+
+        info->write(written, source, value_count);
+        if(memcmp(expected, written, value_count*info->bytes_per_sample) != 0)
+        {
+            printf("  %-8s FAILED does not match the reference\n", info->name);
+            Result = false;
+            continue;
+        }
+
+        real64 best_ns = 1e30;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            int64 start = bench_get_ns();
+            info->write(written, source, value_count);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+        }
+        printf("  %-8s %6.3f\n", info->name, best_ns / (real64)value_count);
+    }
+
+    // NOTE: A ring region bigger than the device buffer, as after an xrun,
+    // has to go over in buffer-sized pieces without running past the
+    // buffer, and come out the same as converting it in one go.
+    uint32 const channel_count = 2;
+    uint32 const device_frame_count = 1000;
+    uint32 const region_frame_count = 2*device_frame_count + 333;
+    uint32 const guard_size = 64;
+    uint8 *device_samples = (uint8 *)malloc(device_frame_count*channel_count*4 + guard_size);
+    for(int format = 0;
+        format < LINUX_SAMPLE_FORMAT_COUNT;
+        ++format)
+    {
+        linux_sample_format_info *info = linux_sample_formats + format;
+        uint32 bytes_per_frame = channel_count*info->bytes_per_sample;
+        uint32 device_size = device_frame_count*bytes_per_frame;
+        info->write(expected, source, (long)region_frame_count*channel_count);
+        memset(device_samples + device_size, 0xCD, guard_size);
+
+        bool32 matches = true;
+        uint32 frames_done = 0;
+        while(frames_done < region_frame_count)
+        {
+            uint32 chunk = linux_convert_frames(info->write, device_samples, device_frame_count,
+                                                source + frames_done*channel_count,
+                                                region_frame_count - frames_done, channel_count);
+            if(!chunk || (chunk > device_frame_count) ||
+               (memcmp(device_samples, expected + frames_done*bytes_per_frame,
+                       chunk*bytes_per_frame) != 0))
+            {
+                matches = false;
+                break;
+            }
+            frames_done += chunk;
+        }
+        for(uint32 guard_index = 0;
+            guard_index < guard_size;
+            ++guard_index)
+        {
+            if(device_samples[device_size + guard_index] != 0xCD)
+            {
+                matches = false;
+            }
+        }
+        if(!matches)
+        {
+            printf("  %-8s FAILED region bigger than the device buffer\n", info->name);
+            Result = false;
+        }
+    }
+    printf("  regions over the device buffer go in pieces\n");
+
+    free(device_samples);
+    free(source);
+    free(expected);
+    free(written);
+
+    return(Result);
+}
+
+// NOTE: One thread produces a counting sequence in odd-sized chunks, the
+// other drains it in chunks of a different size and checks every frame, so
+// the wrap and both sides running out of room all get hit.
+#define BENCH_RING_FRAME_COUNT (1 << 22)
+
+internal void *
+bench_sample_ring_producer(void *parameter)
+{
+    linux_sample_ring *ring = (linux_sample_ring *)parameter;
+    uint32 next_value = 0;
+    while(next_value < BENCH_RING_FRAME_COUNT)
+    {
+        uint32 frame_count = 1 + (next_value % 383);
+        if(frame_count > BENCH_RING_FRAME_COUNT - next_value)
+        {
+            frame_count = BENCH_RING_FRAME_COUNT - next_value;
+        }
+
+        linux_sample_ring_region regions[2];
+        int region_count = linux_begin_sample_ring_write(ring, frame_count, regions);
+        if(!region_count)
+        {
+            sched_yield();
+        }
+        uint32 frames_written = 0;
+        for(int region_index = 0;
+            region_index < region_count;
+            ++region_index)
+        {
+            int16 *samples = regions[region_index].samples;
+            for(uint32 frame = 0;
+                frame < regions[region_index].frame_count;
+                ++frame)
+            {
+                *samples++ = (int16)next_value;
+                *samples++ = (int16)~next_value;
+                ++next_value;
+            }
+            frames_written += regions[region_index].frame_count;
+        }
+        linux_end_sample_ring_write(ring, frames_written);
+    }
+
+    return(0);
+}
+
+internal bool32
+bench_sample_ring(void)
+{
+    linux_sample_ring ring;
+    linux_init_sample_ring(&ring, 1000, 2);
+
+    pthread_t producer;
+    int64 start = bench_get_ns();
+    pthread_create(&producer, 0, bench_sample_ring_producer, &ring);
+
+    uint32 mismatch_count = 0;
+    uint32 expected_value = 0;
+    while(expected_value < BENCH_RING_FRAME_COUNT)
+    {
+        linux_sample_ring_region regions[2];
+        int region_count = linux_begin_sample_ring_read(&ring, 1 + (expected_value % 517), regions);
+        if(!region_count)
+        {
+            sched_yield();
+        }
+        uint32 frames_read = 0;
+        for(int region_index = 0;
+            region_index < region_count;
+            ++region_index)
+        {
+            int16 *samples = regions[region_index].samples;
+            for(uint32 frame = 0;
+                frame < regions[region_index].frame_count;
+                ++frame)
+            {
+                if((samples[0] != (int16)expected_value) ||
+                   (samples[1] != (int16)~expected_value))
+                {
+                    ++mismatch_count;
+                }
+                samples += 2;
+                ++expected_value;
+            }
+            frames_read += regions[region_index].frame_count;
+        }
+        linux_end_sample_ring_read(&ring, frames_read);
+    }
+
+    pthread_join(producer, 0);
+    real64 elapsed = (real64)(bench_get_ns() - start);
+    uint32 left_over = linux_sample_ring_filled(&ring);
+    linux_free_sample_ring(&ring);
+
+    bool32 Result = (mismatch_count == 0);
+    if(left_over)
+    {
+        printf("sample ring: FAILED %u frames left over\n", left_over);
+        Result = false;
+    }
+    printf("sample ring (capacity %u frames)\n", ring.capacity);
+    printf("  %u frames across threads, %.2f ns/frame, %s\n",
+           BENCH_RING_FRAME_COUNT, elapsed / (real64)BENCH_RING_FRAME_COUNT,
+           Result ? "in order" : "FAILED frames out of order");
+
+    return(Result);
+}
+
+internal bool32
+bench_tiled_game_update_render(void)
+{
+    bool32 Result = true;
+
+    // NOTE: Workers are persistent, so every thread count gets its own queue.
+    // The last one is what the Linux platform starts on this machine.
+    int thread_counts[] = {1, 2, 4, 8, (int)linux_get_worker_thread_count() + 1};
+    int resolutions[][2] = {{1920, 1080}, {3840, 2160}};
+    int const repeat_count = 50;
+
+    printf("tiled game_update_render (cycles/pixel, best of %d)\n", repeat_count);
+    for(int thread_index = 0;
+        thread_index < (int)ArrayCount(thread_counts);
+        ++thread_index)
+    {
+        int thread_count = thread_counts[thread_index];
+        platform_work_queue *queue = (platform_work_queue *)calloc(1, sizeof(platform_work_queue));
+        linux_make_queue(queue, thread_count - 1);
+
+        game_memory memory = bench_allocate_game_memory(queue);
+
+        printf("  %d thread%s", thread_count, (thread_count == 1) ? " " : "s");
+        for(int resolution_index = 0;
+            resolution_index < (int)ArrayCount(resolutions);
+            ++resolution_index)
+        {
+            int width = resolutions[resolution_index][0];
+            int height = resolutions[resolution_index][1];
+            game_offscreen_buffer buffer = bench_allocate_buffer(width, height, width*4);
+            game_offscreen_buffer expected = bench_allocate_buffer(width, height, width*4);
+
+            uint64 best_cycles = (uint64)-1;
+            for(int repeat = 0;
+                repeat < repeat_count;
+                ++repeat)
+            {
+                uint64 start = read_cpu_timer();
+                game_update_render(&memory, &buffer, repeat, repeat);
+                uint64 elapsed = read_cpu_timer() - start;
+                if(elapsed < best_cycles)
+                {
+                    best_cycles = elapsed;
+                }
+            }
+
+            // NOTE: The tiles must stitch back into exactly the untiled image.
+            render_weird_gradient_scalar(&expected, repeat_count - 1, repeat_count - 1);
+            if(memcmp(expected.memory, buffer.memory, height*width*4) != 0)
+            {
+                printf("  FAILED tiled output mismatch");
+                Result = false;
+            }
+
+            printf("  %dx%d: %6.3f", width, height,
+                   (real64)best_cycles / (real64)(width*height));
+            free(buffer.memory);
+            free(expected.memory);
+        }
+        printf("\n");
+        bench_free_game_memory(&memory);
+    }
+
+    return(Result);
+}
+
+internal bool32
+bench_render_group_tiling(void)
+{
+    bool32 Result = true;
+
+    // NOTE: Commands that straddle tile edges and the buffer edges must come
+    // out of the tiled rasterizer exactly as from a single untiled pass.
+    platform_work_queue *queue = (platform_work_queue *)calloc(1, sizeof(platform_work_queue));
+    linux_make_queue(queue, 3);
+    game_memory tiled_memory = bench_allocate_game_memory(queue);
+    game_memory serial_memory = bench_allocate_game_memory(0);
+
+    uint32 bitmap_pixels[37*29];
+    loaded_bitmap bitmap = {};
+    bitmap.width = 37;
+    bitmap.height = 29;
+    bitmap.pitch = bitmap.width*sizeof(uint32);
+    bitmap.memory = bitmap_pixels;
+    for(int pixel_index = 0;
+        pixel_index < (int)ArrayCount(bitmap_pixels);
+        ++pixel_index)
+    {
+        uint32 alpha = (pixel_index*7) & 0xFF;
+        uint32 gray = alpha / 2;
+        bitmap_pixels[pixel_index] = (alpha << 24) | (gray << 16) | (gray << 8) | gray;
+    }
+
+    int width = 1000;
+    int height = 333;
+    game_offscreen_buffer tiled = bench_allocate_buffer(width, height, width*4);
+    game_offscreen_buffer serial = bench_allocate_buffer(width, height, width*4);
+
+    tile_cache *caches[] = {(tile_cache *)calloc(1, sizeof(tile_cache)),
+                            (tile_cache *)calloc(1, sizeof(tile_cache))};
+    game_memory *memories[] = {&tiled_memory, &serial_memory};
+    game_offscreen_buffer *targets[] = {&tiled, &serial};
+    for(int pass = 0;
+        pass < 2;
+        ++pass)
+    {
+        memory_arena arena;
+        initialize_arena(&arena, Megabytes(1), memories[pass]->transient_storage);
+        render_group *group = allocate_render_group(&arena, Kilobytes(4));
+        push_clear(group, 0xFF202020);
+        push_gradient(group, 3, -7);
+        push_rectangle(group, -10, 50, 300, 70, 0xFFFF0000);
+        push_rectangle(group, 250, 60, 1200, 400, 0xFF00FF00);
+        push_bitmap(group, &bitmap, 240, 50);
+        push_bitmap(group, &bitmap, -5, -5);
+        push_bitmap(group, &bitmap, 990, 320);
+        tiled_render_group_to_output(memories[pass], caches[pass], group, targets[pass]);
+    }
+
+    if(memcmp(tiled.memory, serial.memory, height*width*4) != 0)
+    {
+        printf("render group: FAILED tiled output differs from untiled output\n");
+        Result = false;
+    }
+    else
+    {
+        printf("render group: tiled output matches untiled output\n");
+    }
+
+    // NOTE: Same commands again must leave nothing dirty, and moving one
+    // small rectangle must only dirty the tiles it covered or now covers.
+    int frame_rects[][4] = {{-10, 50, 300, 70}, {-10, 50, 300, 70}, {600, 10, 700, 20}};
+    int expected_dirty[] = {-1, 0, -1};
+    for(int frame = 0;
+        frame < (int)ArrayCount(frame_rects);
+        ++frame)
+    {
+        memory_arena arena;
+        initialize_arena(&arena, Megabytes(1), tiled_memory.transient_storage);
+        render_group *group = allocate_render_group(&arena, Kilobytes(4));
+        push_clear(group, 0xFF202020);
+        push_rectangle(group, frame_rects[frame][0], frame_rects[frame][1],
+                       frame_rects[frame][2], frame_rects[frame][3], 0xFFFF0000);
+        tiled_render_group_to_output(&tiled_memory, caches[0], group, &tiled);
+
+        int dirty_pixels = 0;
+        for(int rect_index = 0;
+            rect_index < tiled.dirty_rect_count;
+            ++rect_index)
+        {
+            game_rect *rect = tiled.dirty_rects + rect_index;
+            dirty_pixels += (rect->max_x - rect->min_x)*(rect->max_y - rect->min_y);
+        }
+        printf("dirty rects: frame %d, %d rects, %d%% of the buffer\n", frame,
+               tiled.dirty_rect_count, (100*dirty_pixels) / (width*height));
+        if((expected_dirty[frame] == 0) && (tiled.dirty_rect_count != 0))
+        {
+            printf("dirty rects: FAILED unchanged frame reported dirty\n");
+            Result = false;
+        }
+        if(frame == 2)
+        {
+            // NOTE: The old rect covered tiles 0-1 of rows 0 and 1, the new
+            // one covers tile 2 of row 0, so row 0 is one run up to 768.
+            game_rect *first = tiled.dirty_rects;
+            game_rect *second = tiled.dirty_rects + 1;
+            if((tiled.dirty_rect_count != 2) ||
+               (first->min_x != 0) || (first->min_y != 0) ||
+               (first->max_x != 768) || (first->max_y != 64) ||
+               (second->min_x != 0) || (second->min_y != 64) ||
+               (second->max_x != 512) || (second->max_y != 128))
+            {
+                printf("dirty rects: FAILED moved rectangle dirtied the wrong tiles\n");
+                Result = false;
+            }
+        }
+    }
+
+    // NOTE: Wider than MAX_TILE_COUNT tiles can cover, so the tiles have to
+    // widen as well as grow taller.
+    int wide_width = MAX_TILE_COUNT*TILE_WIDTH + 1000;
+    int wide_height = 3;
+    game_offscreen_buffer wide_tiled = bench_allocate_buffer(wide_width, wide_height, wide_width*4);
+    game_offscreen_buffer wide_serial = bench_allocate_buffer(wide_width, wide_height, wide_width*4);
+    game_offscreen_buffer *wide_targets[] = {&wide_tiled, &wide_serial};
+    for(int pass = 0;
+        pass < 2;
+        ++pass)
+    {
+        memory_arena arena;
+        initialize_arena(&arena, Megabytes(1), memories[pass]->transient_storage);
+        render_group *group = allocate_render_group(&arena, Kilobytes(4));
+        push_clear(group, 0xFF202020);
+        push_gradient(group, 3, -7);
+        push_rectangle(group, 65000, 0, 66000, 2, 0xFFFF0000);
+        tiled_render_group_to_output(memories[pass], caches[pass], group, wide_targets[pass]);
+    }
+    if((caches[0]->tile_width*MAX_TILE_COUNT < wide_width) ||
+       (memcmp(wide_tiled.memory, wide_serial.memory, wide_height*wide_width*4) != 0))
+    {
+        printf("render group: FAILED wide target\n");
+        Result = false;
+    }
+    else
+    {
+        printf("render group: %d wide target in %d-pixel tiles\n",
+               wide_width, caches[0]->tile_width);
+    }
+
+    free(wide_tiled.memory);
+    free(wide_serial.memory);
+    free(tiled.memory);
+    free(serial.memory);
+    free(caches[0]);
+    free(caches[1]);
+    bench_free_game_memory(&tiled_memory);
+    bench_free_game_memory(&serial_memory);
+
+    return(Result);
+}
+
+internal bool32
+bench_frame_telemetry(void)
+{
+    bool32 Result = true;
+
+    // NOTE: Frames of 1us..2000us against a 1ms target, so the exact
+    // percentiles are known for both the session and the recent window.
+    frame_telemetry *telemetry = (frame_telemetry *)malloc(sizeof(frame_telemetry));
+    telemetry_init(telemetry, 1000000);
+
+    int frame_count = 2000;
+    uint64 begin = read_cpu_timer();
+    for(int frame = 1;
+        frame <= frame_count;
+        ++frame)
+    {
+        telemetry_record_frame(telemetry, frame*1000LL,
+                               telemetry_missed_deadlines(frame*1000LL, 1000000));
+    }
+    uint64 cycles = read_cpu_timer() - begin;
+    printf("frame telemetry: %.1f cycles/record\n", (real64)cycles / (real64)frame_count);
+
+    // NOTE: A frame missed as many deadlines as whole periods it ran over,
+    // so one of 1.5 periods missed one, and one of exactly 2 also just one.
+    if((telemetry_missed_deadlines(1000000, 1000000) != 0) ||
+       (telemetry_missed_deadlines(1500000, 1000000) != 1) ||
+       (telemetry_missed_deadlines(2000000, 1000000) != 1) ||
+       (telemetry_missed_deadlines(2000001, 1000000) != 2))
+    {
+        printf("frame telemetry: FAILED missed deadline count\n");
+        Result = false;
+    }
+
+    telemetry_summary session = telemetry_summarize(telemetry);
+    telemetry_summary recent = telemetry_summarize_recent(telemetry);
+
+    int64 session_exact[] = {1000000, 1900000, 1980000};
+    int64 session_p[] = {session.p50_frame_ns, session.p95_frame_ns, session.p99_frame_ns};
+    for(int index = 0;
+        index < (int)ArrayCount(session_exact);
+        ++index)
+    {
+        // NOTE: Histogram percentiles are a bucket's upper edge, so they may
+        // only ever overestimate, by at most one sub-bucket, and never past
+        // the max.
+        if((session_p[index] < session_exact[index]) ||
+           (session_p[index] > session_exact[index] + session_exact[index] / 8 + 1000) ||
+           (session_p[index] > session.max_frame_ns))
+        {
+            printf("frame telemetry: FAILED session percentile %lld, expected ~%lld\n",
+                   (long long)session_p[index], (long long)session_exact[index]);
+            Result = false;
+        }
+    }
+    if((session.frame_count != 2000) || (session.missed_deadline_count != 1000) ||
+       (session.max_frame_ns != 2000000) || (session.mean_frame_ns != 1000500))
+    {
+        printf("frame telemetry: FAILED session totals\n");
+        Result = false;
+    }
+
+    // NOTE: The ring holds frames 977..2000.
+    if((recent.frame_count != 1024) || (recent.missed_deadline_count != 1000) ||
+       (recent.p50_frame_ns != 1488000) || (recent.p95_frame_ns != 1949000) ||
+       (recent.p99_frame_ns != 1990000) || (recent.max_frame_ns != 2000000))
+    {
+        printf("frame telemetry: FAILED recent percentiles\n");
+        Result = false;
+    }
+
+    // NOTE: One frame over three periods: it missed three deadlines, and
+    // the session total and the recent window count it the same way.
+    telemetry_record_frame(telemetry, 3500000, telemetry_missed_deadlines(3500000, 1000000));
+    session = telemetry_summarize(telemetry);
+    recent = telemetry_summarize_recent(telemetry);
+    if((session.missed_deadline_count != 1003) ||
+       (recent.missed_deadline_count != session.missed_deadline_count))
+    {
+        printf("frame telemetry: FAILED long frame missed %llu in the session, %llu recently\n",
+               (unsigned long long)session.missed_deadline_count,
+               (unsigned long long)recent.missed_deadline_count);
+        Result = false;
+    }
+
+    // NOTE: More xruns than the log holds, cycling through the causes; the
+    // counts stay exact and the report ends on the newest one.
+    audio_xrun_log *xruns = (audio_xrun_log *)malloc(sizeof(audio_xrun_log));
+    zero_size(sizeof(*xruns), xruns);
+    uint32 xrun_count = AUDIO_XRUN_LOG_SIZE + 6;
+    for(uint32 xrun_index = 0;
+        xrun_index < xrun_count;
+        ++xrun_index)
+    {
+        telemetry_record_xrun(xruns, (audio_xrun_cause)(xrun_index % AudioXrunCause_count),
+                              (xrun_index + 1)*1000000LL);
+    }
+    telemetry_record_audio(telemetry, 48000, 1200, 1000, xruns);
+
+    char report[1024];
+    telemetry_format_report(telemetry, report, sizeof(report));
+    fputs(report, stdout);
+
+    char newest[64];
+    snprintf(newest, sizeof(newest), "xrun %u: device underrun at 0.070s", xrun_count);
+    if((xruns->event_count != xrun_count) ||
+       (xruns->cause_counts[AudioXrunCause_suspend] != xrun_count / AudioXrunCause_count) ||
+       (telemetry_underrun_count(xruns) != 36) ||
+       !strstr(report, newest))
+    {
+        printf("frame telemetry: FAILED xrun log\n");
+        Result = false;
+    }
+
+    free(xruns);
+    free(telemetry);
+
+    return(Result);
+}
+
+// NOTE: A simulated device at 48kHz, drained by 60Hz frames that jitter
+// by up to +-4ms. From the old fixed SamplesPerSecond/15 the controller must
+// come down to just above the jitter, and stay there without xruns; then a
+// single 40ms frame must push it back up.
+internal bool32
+bench_audio_latency(void)
+{
+    bool32 Result = true;
+
+    int32 const samples_per_second = 48000;
+    audio_latency_controller controller;
+    audio_latency_init(&controller, samples_per_second, samples_per_second / 100,
+                       samples_per_second / 4, samples_per_second / 15);
+
+    uint32 random = 12345;
+    uint32 xrun_count = 0;
+    uint32 settled_xrun_count = 0;
+    int32 queued = controller.target_sample_count;
+    int32 max_settled_target = 0;
+    int const frame_count = 6000;
+    for(int frame = 0;
+        frame < frame_count + 1;
+        ++frame)
+    {
+        random = random*1664525 + 1013904223;
+        int32 elapsed = 800 + (int32)((random >> 16) % 385) - 192;
+        if(frame == frame_count)
+        {
+            elapsed = samples_per_second / 25;
+        }
+
+        queued -= elapsed;
+        if(queued < 0)
+        {
+            ++xrun_count;
+            if(frame >= frame_count / 2)
+            {
+                ++settled_xrun_count;
+            }
+            queued = 0;
+        }
+
+        int32 target = audio_latency_update(&controller, queued, xrun_count);
+        if((frame >= frame_count / 2) && (frame < frame_count) && (target > max_settled_target))
+        {
+            max_settled_target = target;
+        }
+        if(queued < target)
+        {
+            queued = target;
+        }
+    }
+
+    // NOTE: The frames are 16.7ms +-4ms, so anything between one frame plus
+    // the jitter and half the initial 66ms is a sensible place to settle.
+    int32 settled_max = samples_per_second / 30;
+    // NOTE: The one xrun allowed once settled is the 40ms frame's.
+    printf("audio latency: settled at %.1fms max, %u xruns in the first half, "
+           "%.1fms after a 40ms frame\n",
+           1000.0*max_settled_target / samples_per_second, xrun_count - settled_xrun_count,
+           1000.0*controller.target_sample_count / samples_per_second);
+    if((max_settled_target > settled_max) || (settled_xrun_count != 1))
+    {
+        printf("audio latency: FAILED did not settle without xruns\n");
+        Result = false;
+    }
+    if(controller.target_sample_count <= max_settled_target)
+    {
+        printf("audio latency: FAILED did not grow after an xrun\n");
+        Result = false;
+    }
+
+    return(Result);
+}
+
+#if HANDMADE_PROFILE
+internal bool32
+bench_timed_block(void)
+{
+    // NOTE: Nested so the exclusive bookkeeping on the parent is included.
+    int block_count = 1000000;
+    uint64 best_cycles = (uint64)-1;
+    for(int repeat = 0;
+        repeat < 8;
+        ++repeat)
+    {
+        uint64 start = read_cpu_timer();
+        {
+            TIMED_BLOCK("bench_timed_block_outer");
+            for(int block = 0;
+                block < block_count;
+                ++block)
+            {
+                TIMED_BLOCK("bench_timed_block_inner");
+            }
+        }
+        uint64 elapsed = read_cpu_timer() - start;
+        if(elapsed < best_cycles)
+        {
+            best_cycles = elapsed;
+        }
+    }
+
+    // NOTE: Two timer reads are the floor, and under some hypervisors
+    // they are most of the cost.
+    uint64 timer_start = read_cpu_timer();
+    for(int block = 0;
+        block < block_count;
+        ++block)
+    {
+        read_cpu_timer();
+        read_cpu_timer();
+    }
+    uint64 timer_cycles = read_cpu_timer() - timer_start;
+
+    printf("timed block: %.1f cycles/block, %.1f of them reading the timer\n",
+           (real64)best_cycles / (real64)block_count,
+           (real64)timer_cycles / (real64)block_count);
+
+    static char report[16384];
+    debug_format_report(report, sizeof(report), 1);
+    fputs(report, stdout);
+
+    // NOTE: The platforms reset the records after each report, so the next
+    // one starts from nothing.
+    bool32 Result = true;
+    debug_reset_records();
+    debug_format_report(report, sizeof(report), 1);
+    if(strstr(report, "bench_timed_block_inner"))
+    {
+        printf("timed block: FAILED records survived the reset\n");
+        Result = false;
+    }
+
+    return(Result);
+}
+
+internal bool32
+bench_trace_capture(void)
+{
+    bool32 Result = true;
+
+    // NOTE: Only the ratio matters for the timestamps.
+    GlobalDebugState.cpu_timer_frequency = 3000000000ULL;
+
+    platform_work_queue *queue = (platform_work_queue *)calloc(1, sizeof(platform_work_queue));
+    linux_make_queue(queue, 3);
+    game_memory memory = bench_allocate_game_memory(queue);
+    game_offscreen_buffer buffer = bench_allocate_buffer(1920, 1080, 1920*4);
+
+    // NOTE: This thread plays the trace writer too; every block is closed
+    // before the capture stops, so begins and ends have to pair up.
+    char const *file_name = "handmade_bench_trace.json";
+    debug_start_trace(file_name);
+    debug_update_trace();
+    for(int frame = 0;
+        frame < 4;
+        ++frame)
+    {
+        game_update_render(&memory, &buffer, frame, frame);
+        debug_update_trace();
+    }
+    debug_stop_trace();
+    debug_update_trace();
+    if(debug_trace_in_progress())
+    {
+        printf("trace capture: FAILED still in progress after stop\n");
+        Result = false;
+    }
+
+    FILE *file = fopen(file_name, "rb");
+    if(file)
+    {
+        int begin_count = 0;
+        int end_count = 0;
+        char line[512];
+        while(fgets(line, sizeof(line), file))
+        {
+            if(strstr(line, "\"ph\":\"B\"")) {++begin_count;}
+            if(strstr(line, "\"ph\":\"E\"")) {++end_count;}
+        }
+        fclose(file);
+
+        printf("trace capture: %d begin, %d end events\n", begin_count, end_count);
+        if(!begin_count || (begin_count != end_count))
+        {
+            printf("trace capture: FAILED unbalanced events\n");
+            Result = false;
+        }
+    }
+    else
+    {
+        printf("trace capture: FAILED no trace file\n");
+        Result = false;
+    }
+    remove(file_name);
+
+    free(buffer.memory);
+    bench_free_game_memory(&memory);
+
+    return(Result);
+}
+#endif
+
+// NOTE: The sinks that stand in for a sound card. A paced sink on a
+// simulated clock, a WAV file that has to read back as exactly what was
+// mixed, and how many times faster than real time the mixer fills each.
+internal bool32
+bench_sound_sinks(void)
+{
+    bool32 Result = true;
+
+    unsigned int const samples_per_second = 48000;
+    uint32 const period_size = 480;
+    linux_sound_sink sink;
+    linux_parse_sound_sink(&sink, "null:realtime");
+    linux_open_sound_sink(&sink, samples_per_second, 2, period_size);
+    int16 silence[2*2*period_size] = {};
+
+    // NOTE: Two periods up front, then only as much as has played; after a
+    // long gap everything it had is gone and the lead is back to two.
+    int64 const start_ns = 1000000000LL;
+    uint32 room_first = linux_get_sound_sink_room(&sink, start_ns, 100000);
+    linux_write_sound_sink(&sink, silence, room_first, start_ns);
+    uint32 room_full = linux_get_sound_sink_room(&sink, start_ns + 1000000, 100000);
+    uint32 room_later = linux_get_sound_sink_room(&sink, start_ns + 5000000, 100000);
+    uint64 delay_later = linux_get_sound_sink_delay(&sink, start_ns + 5000000);
+    uint32 room_gap = linux_get_sound_sink_room(&sink, start_ns + 500000000, 100000);
+    if((room_first != 2*period_size) || (room_full != 48) || (room_later != 240) ||
+       (delay_later != 720) || (room_gap != 2*period_size))
+    {
+        printf("sound sinks: FAILED paced sink took %u, %u, %u, %u frames\n",
+               room_first, room_full, room_later, room_gap);
+        Result = false;
+    }
+
+    // NOTE: Two hundred hours in, past where elapsed ns times the rate
+    // overflows 64 bits, the delay must still be what was queued ahead.
+    int64 const long_run_ns = 200LL*3600*1000000000LL;
+    uint64 long_run_frame_count = 200ULL*3600*samples_per_second;
+    sink.frame_count = long_run_frame_count + 720;
+    uint64 delay_long_run = linux_get_sound_sink_delay(&sink, start_ns + long_run_ns);
+    if(delay_long_run != 720)
+    {
+        printf("sound sinks: FAILED delay of %llu frames after 200 hours\n",
+               (unsigned long long)delay_long_run);
+        Result = false;
+    }
+
+    // NOTE: Ten seconds of the full mixer, in 60Hz frames.
+    uint32 const frame_sample_count = samples_per_second / 60;
+    int const frame_count = 600;
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    int16 *expected = (int16 *)malloc(frame_count*frame_sample_count*2*sizeof(int16));
+    int16 *samples = (int16 *)malloc(frame_sample_count*2*sizeof(int16));
+    bench_fill_mixer(mixer);
+    audio_ring_regions regions = get_contiguous_audio_regions(expected,
+                                                              frame_count*frame_sample_count);
+    mix_audio(mixer, &regions, samples_per_second);
+
+    char path[] = "/tmp/handmade_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+    char device[64];
+    snprintf(device, sizeof(device), "wav:%s", path);
+
+    char const *names[] = {"null", device};
+    for(int sink_index = 0;
+        sink_index < (int)ArrayCount(names);
+        ++sink_index)
+    {
+        linux_parse_sound_sink(&sink, names[sink_index]);
+        sink.paced = false;
+        if(!linux_open_sound_sink(&sink, samples_per_second, 2, period_size))
+        {
+            Result = false;
+            continue;
+        }
+
+        bench_fill_mixer(mixer);
+        regions = get_contiguous_audio_regions(samples, frame_sample_count);
+        int64 start = bench_get_ns();
+        for(int frame_index = 0;
+            frame_index < frame_count;
+            ++frame_index)
+        {
+            mix_audio(mixer, &regions, samples_per_second);
+            linux_write_sound_sink(&sink, samples, frame_sample_count, 0);
+        }
+        real64 elapsed_ns = (real64)(bench_get_ns() - start);
+        linux_close_sound_sink(&sink);
+        printf("sound sinks: %-4s %6.1fx real time, %d voices\n",
+               (sink.type == LINUX_SOUND_SINK_WAV) ? "wav" : "null",
+               (real64)frame_count*1e9 / 60.0 / elapsed_ns, MAX_AUDIO_VOICE_COUNT);
+    }
+
+    // NOTE: The file has to be a plain 16-bit stereo WAV of exactly the
+    // samples a single mix into memory gives.
+    memory_index data_size = frame_count*frame_sample_count*2*sizeof(int16);
+    uint8 *file = (uint8 *)malloc(LINUX_WAV_HEADER_SIZE + data_size + 1);
+    FILE *wav = fopen(path, "rb");
+    memory_index file_size = wav ? fread(file, 1, LINUX_WAV_HEADER_SIZE + data_size + 1, wav) : 0;
+    if(wav)
+    {
+        fclose(wav);
+    }
+    unlink(path);
+    uint8 header[LINUX_WAV_HEADER_SIZE];
+    linux_make_wav_header(header, samples_per_second, 2, (uint32)data_size);
+    if((file_size != LINUX_WAV_HEADER_SIZE + data_size) ||
+       (memcmp(file, header, LINUX_WAV_HEADER_SIZE) != 0) ||
+       (memcmp(file + LINUX_WAV_HEADER_SIZE, expected, data_size) != 0) ||
+       (header[22] != 2) || (header[24] != 0x80) || (header[25] != 0xBB))
+    {
+        printf("sound sinks: FAILED the WAV file is not what was mixed\n");
+        Result = false;
+    }
+
+    free(file);
+    free(samples);
+    free(expected);
+    free(mixer);
+
+    return(Result);
+}
+
+// NOTE: The effects chain. Every kernel has to match the scalar one, for
+// any number of stages and any chunk length, across chunks; then a tone
+// through each kind of filter, on a bus and on the master, has to come out
+// at the level the filter is meant to give it. Then the cost per frame of
+// a full chain.
+internal real32
+bench_filtered_tone_level(audio_mixer *mixer, uint32 bus_index, audio_filter_type type,
+                          int tone_hz, int16 *samples)
+{
+    int const samples_per_second = 48000;
+    initialize_audio_mixer(mixer);
+    uint32 voice_id = play_sine_voice(mixer, tone_hz, 0.25f, 0.0f);
+    set_audio_voice_bus(mixer, voice_id, bus_index);
+    audio_biquad biquad = make_audio_biquad(type, 1000.0f, 0.7071f, 2.0f, samples_per_second);
+    set_audio_bus_filter(mixer, bus_index, 0, biquad);
+    set_audio_bus_filter(mixer, bus_index, 1, (type == AudioFilter_peaking) ?
+                         make_audio_biquad(type, 1000.0f, 0.7071f, 1.0f, samples_per_second) :
+                         biquad);
+
+    audio_ring_regions regions = get_contiguous_audio_regions(samples, samples_per_second / 2);
+    mix_audio(mixer, &regions, samples_per_second);
+
+    // NOTE: The level once the filter has settled, as a fraction of the
+    // tone's own.
+    int peak = 0;
+    for(int sample_index = 2*samples_per_second / 4;
+        sample_index < samples_per_second;
+        ++sample_index)
+    {
+        int value = samples[sample_index];
+        peak = (value > peak) ? value : ((-value > peak) ? -value : peak);
+    }
+    real32 Result = (real32)peak / (0.25f*32768.0f);
+
+    return(Result);
+}
+
+struct bench_filter_kernel
+{
+    char const *name;
+    filter_audio_kernel *kernel;
+    bool32 available;
+};
+
+struct bench_filter_response
+{
+    audio_filter_type type;
+    int tone_hz;
+    real32 min_level;
+    real32 max_level;
+};
+
+internal bool32
+bench_audio_filters(void)
+{
+    bool32 Result = true;
+
+    cpu_features features = get_cpu_features();
+    bench_filter_kernel kernels[] =
+    {
+        {"scalar", filter_audio_scalar, true},
+        {"sse2", filter_audio_sse2, features.sse2},
+        {"avx2", filter_audio_avx2, features.avx2},
+    };
+
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    real32 *input_left = (real32 *)malloc(AUDIO_MIXER_CHUNK_FRAME_COUNT*sizeof(real32));
+    real32 *input_right = (real32 *)malloc(AUDIO_MIXER_CHUNK_FRAME_COUNT*sizeof(real32));
+    real32 *expected = (real32 *)malloc(2*AUDIO_MIXER_CHUNK_FRAME_COUNT*sizeof(real32));
+    real32 *actual = (real32 *)malloc(2*AUDIO_MIXER_CHUNK_FRAME_COUNT*sizeof(real32));
+
+    int const frame_counts[] = {1, 2, 3, 4, 5, 7, 64, 1021, AUDIO_MIXER_CHUNK_FRAME_COUNT};
+    uint32 random = 4321;
+    int mismatch_count = 0;
+    for(uint32 biquad_count = 1;
+        biquad_count <= MAX_AUDIO_BIQUAD_COUNT;
+        ++biquad_count)
+    {
+        audio_filter_chain chains[ArrayCount(kernels)];
+        initialize_audio_mixer(mixer);
+        for(uint32 stage_index = 0;
+            stage_index < biquad_count;
+            ++stage_index)
+        {
+            audio_filter_type type = (audio_filter_type)(stage_index % 3);
+            real32 hz = 200.0f + 1500.0f*stage_index;
+            real32 q = 0.5f + 0.3f*stage_index;
+            set_audio_bus_filter(mixer, 0, stage_index, make_audio_biquad(type, hz, q, 1.5f, 48000));
+        }
+        for(int kernel_index = 0;
+            kernel_index < (int)ArrayCount(kernels);
+            ++kernel_index)
+        {
+            chains[kernel_index] = mixer->buses[0].filters;
+        }
+
+        for(int count_index = 0;
+            count_index < (int)ArrayCount(frame_counts);
+            ++count_index)
+        {
+            int frame_count = frame_counts[count_index];
+            for(int frame_index = 0;
+                frame_index < frame_count;
+                ++frame_index)
+            {
+                random = random*1664525 + 1013904223;
+                input_left[frame_index] = (real32)(int32)random / 2147483648.0f;
+                input_right[frame_index] = (real32)(int32)(random*69069) / 2147483648.0f;
+            }
+
+            for(int kernel_index = 0;
+                kernel_index < (int)ArrayCount(kernels);
+                ++kernel_index)
+            {
+                bench_filter_kernel *kernel = kernels + kernel_index;
+                if(!kernel->available)
+                {
+                    continue;
+                }
+                real32 *output = (kernel_index == 0) ? expected : actual;
+                memcpy(output, input_left, frame_count*sizeof(real32));
+                memcpy(output + frame_count, input_right, frame_count*sizeof(real32));
+                kernel->kernel(chains + kernel_index, output, output + frame_count, frame_count);
+
+                for(int sample_index = 0;
+                    (kernel_index > 0) && (sample_index < 2*frame_count);
+                    ++sample_index)
+                {
+                    if(actual[sample_index] != expected[sample_index])
+                    {
+                        ++mismatch_count;
+                    }
+                }
+                for(uint32 lane = 0;
+                    (kernel_index > 0) && (lane < 2*biquad_count);
+                    ++lane)
+                {
+                    if((chains[kernel_index].z1[lane] != chains[0].z1[lane]) ||
+                       (chains[kernel_index].z2[lane] != chains[0].z2[lane]))
+                    {
+                        ++mismatch_count;
+                    }
+                }
+            }
+        }
+    }
+    if(mismatch_count)
+    {
+        printf("audio filters: FAILED %d samples do not match scalar\n", mismatch_count);
+        Result = false;
+    }
+
+    // NOTE: Two stages of each, with the cutoff or center at 1kHz. The
+    // second peaking stage has a gain of 1, and does nothing.
+    int16 *samples = (int16 *)malloc(48000*2*sizeof(int16));
+    bench_filter_response responses[] =
+    {
+        {AudioFilter_low_pass, 100, 0.98f, 1.01f},
+        {AudioFilter_low_pass, 10000, 0.0f, 0.001f},
+        {AudioFilter_high_pass, 100, 0.0f, 0.001f},
+        {AudioFilter_high_pass, 10000, 0.98f, 1.01f},
+        {AudioFilter_peaking, 1000, 1.97f, 2.02f},
+        {AudioFilter_peaking, 100, 0.98f, 1.03f},
+    };
+    for(int response_index = 0;
+        response_index < (int)ArrayCount(responses);
+        ++response_index)
+    {
+        bench_filter_response *response = responses + response_index;
+        for(uint32 bus_index = 0;
+            bus_index < 2;
+            ++bus_index)
+        {
+            real32 level = bench_filtered_tone_level(mixer, bus_index, response->type,
+                                                     response->tone_hz, samples);
+            if((level < response->min_level) || (level > response->max_level))
+            {
+                printf("audio filters: FAILED %dHz through filter %d on bus %u came out at %.4f\n",
+                       response->tone_hz, response->type, bus_index, level);
+                Result = false;
+            }
+        }
+    }
+
+    int const repeat_count = 200;
+    printf("audio filters (%d biquads, ns per frame, best of %d chunks)\n",
+           MAX_AUDIO_BIQUAD_COUNT, repeat_count);
+    for(int kernel_index = 0;
+        kernel_index < (int)ArrayCount(kernels);
+        ++kernel_index)
+    {
+        bench_filter_kernel *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s unavailable\n", kernel->name);
+            continue;
+        }
+
+        audio_filter_chain chain = mixer->buses[0].filters;
+        for(uint32 stage_index = chain.biquad_count;
+            stage_index < MAX_AUDIO_BIQUAD_COUNT;
+            ++stage_index)
+        {
+            set_filter_chain_stage(&chain, stage_index,
+                                   make_audio_biquad(AudioFilter_low_pass, 5000.0f, 0.7071f, 1.0f,
+                                                     48000));
+        }
+        chain.biquad_count = MAX_AUDIO_BIQUAD_COUNT;
+
+        real64 best_ns = 1e30;
+        for(int repeat = 0;
+            repeat < repeat_count;
+            ++repeat)
+        {
+            int64 start = bench_get_ns();
+            kernel->kernel(&chain, input_left, input_right, AUDIO_MIXER_CHUNK_FRAME_COUNT);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+        }
+        printf("  %-8s %6.2f\n", kernel->name, best_ns / AUDIO_MIXER_CHUNK_FRAME_COUNT);
+    }
+
+    free(samples);
+    free(actual);
+    free(expected);
+    free(input_right);
+    free(input_left);
+    free(mixer);
+
+    return(Result);
+}
+
+// NOTE: The game's whole sound path, frame by frame the way the platforms
+// call it: the test tone through the game's bus filters must come out
+// exactly as from a mixer set up the same way by hand.
+internal bool32
+bench_game_sound(void)
+{
+    bool32 Result = true;
+
+    int const samples_per_second = 48000;
+    int const frame_sample_count = samples_per_second / 60;
+    int const frame_count = 600;
+    game_memory memory = bench_allocate_game_memory(0);
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    initialize_audio_mixer(mixer);
+    play_sine_voice(mixer, 256, 3000.0f / 32768.0f, 0.0f);
+    set_game_audio_filters(mixer, samples_per_second);
+
+    memory_index frame_size = frame_sample_count*2*sizeof(int16);
+    int16 *expected = (int16 *)malloc(frame_size);
+    int16 *samples = (int16 *)malloc(frame_size);
+    game_sound_output_buffer sound_buffer = {};
+    sound_buffer.samples_per_second = samples_per_second;
+    int64 total_ns = 0;
+    int mismatch_count = 0;
+    for(int frame = 0;
+        frame < frame_count;
+        ++frame)
+    {
+        audio_ring_regions regions = get_contiguous_audio_regions(expected, frame_sample_count);
+        mix_audio(mixer, &regions, samples_per_second);
+
+        sound_buffer.regions = get_contiguous_audio_regions(samples, frame_sample_count);
+        int64 start = bench_get_ns();
+        game_get_sound_samples(&memory, &sound_buffer, 256);
+        total_ns += bench_get_ns() - start;
+
+        if(memcmp(expected, samples, frame_size) != 0)
+        {
+            ++mismatch_count;
+        }
+    }
+
+    printf("game sound: %.3f ns/sample",
+           (real64)total_ns / (real64)(frame_count*frame_sample_count));
+    if(mismatch_count)
+    {
+        printf(", FAILED %d of %d frames differ from the mixer", mismatch_count, frame_count);
+        Result = false;
+    }
+    printf("\n");
+
+    free(expected);
+    free(samples);
+    free(mixer);
+    bench_free_game_memory(&memory);
+
+    return(Result);
+}
+
+// NOTE: Sounds streamed out of mapped WAV files: a stereo file at the
+// mixing rate has to come out of every kernel as exactly its own samples
+// and then stop, a mono ramp at 44.1kHz has to stay a ramp through the
+// interpolation, and the prefetch hints have to run ahead of the voice.
+// Then the cost of the mix per voice, with the file in the page cache.
+global_variable uint64 BenchPrefetchOffset;
+global_variable uint64 BenchPrefetchSize;
+global_variable int BenchPrefetchCount;
+
+internal void
+bench_prefetch_file(platform_mapped_file *file, uint64 offset, uint64 size)
+{
+    BenchPrefetchOffset = offset;
+    BenchPrefetchSize = size;
+    ++BenchPrefetchCount;
+}
+
+internal bool32
+bench_write_wav(char *path, unsigned int samples_per_second, unsigned int channel_count,
+                int16 *samples, uint32 frame_count)
+{
+    uint32 data_size = frame_count*channel_count*sizeof(int16);
+    uint8 header[LINUX_WAV_HEADER_SIZE];
+    linux_make_wav_header(header, samples_per_second, channel_count, data_size);
+    int fd = mkstemp(path);
+    bool32 Result = ((fd >= 0) && linux_write_all(fd, header, sizeof(header)) &&
+                     linux_write_all(fd, samples, data_size));
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+
+    return(Result);
+}
+
+internal bool32
+bench_streamed_sound(void)
+{
+    bool32 Result = true;
+
+    int const samples_per_second = 48000;
+    uint32 const frame_count = 3*samples_per_second + 7;
+    int16 *source = (int16 *)malloc(frame_count*2*sizeof(int16));
+    uint32 random = 1234;
+    for(uint32 sample_index = 0;
+        sample_index < 2*frame_count;
+        ++sample_index)
+    {
+        random = random*1664525 + 1013904223;
+        source[sample_index] = (int16)(random >> 16);
+    }
+    source[0] = -32768;
+    source[1] = 32767;
+
+    char path[] = "/tmp/handmade_bench_XXXXXX";
+    audio_sound sound = {};
+    if(!bench_write_wav(path, samples_per_second, 2, source, frame_count) ||
+       !load_wav(&sound, linux_map_file(path)) ||
+       (sound.channel_count != 2) || (sound.frame_count != frame_count) ||
+       (sound.samples_per_second != samples_per_second) ||
+       ((uint8 *)sound.samples != (uint8 *)sound.file.contents + LINUX_WAV_HEADER_SIZE))
+    {
+        printf("streamed sound: FAILED could not load a 16-bit stereo WAV file\n");
+        Result = false;
+    }
+    unlink(path);
+
+    // NOTE: Same header, 8 bits per sample: not something we play.
+    uint8 header[LINUX_WAV_HEADER_SIZE + 4] = {};
+    linux_make_wav_header(header, samples_per_second, 2, 4);
+    header[34] = 8;
+    audio_sound rejected;
+    platform_mapped_file header_file = {header, sizeof(header)};
+    if(load_wav(&rejected, header_file) || rejected.samples)
+    {
+        printf("streamed sound: FAILED loaded an 8-bit WAV file\n");
+        Result = false;
+    }
+
+    audio_mixer *mixer = (audio_mixer *)malloc(sizeof(audio_mixer));
+    uint32 const mix_frame_count = frame_count + 1000;
+    int16 *expected = (int16 *)malloc(mix_frame_count*2*sizeof(int16));
+    int16 *samples = (int16 *)malloc(mix_frame_count*2*sizeof(int16));
+    cpu_features features = get_cpu_features();
+    bench_mixer_kernels kernels[] =
+    {
+        {"scalar", mix_sine_voice_scalar, output_mixed_samples_scalar, true},
+        {"sse2", mix_sine_voice_sse2, output_mixed_samples_sse2, features.sse2},
+        {"avx2", mix_sine_voice_avx2, output_mixed_samples_avx2, features.avx2},
+    };
+    mix_pcm_voice_kernel *pcm_kernels[] =
+    {
+        mix_pcm_voice_scalar, mix_pcm_voice_sse2, mix_pcm_voice_avx2,
+    };
+
+    int const voice_count = 64;
+    printf("streamed sound (ns per voice per frame, %d voices, best of 5 seconds)\n",
+           voice_count);
+    for(int kernel_index = 0;
+        sound.samples && (kernel_index < (int)ArrayCount(kernels));
+        ++kernel_index)
+    {
+        bench_mixer_kernels *kernel = kernels + kernel_index;
+        if(!kernel->available)
+        {
+            printf("  %-8s unavailable\n", kernel->name);
+            continue;
+        }
+        mix_sine_voice_ = kernel->mix_sine_voice;
+        mix_pcm_voice_ = pcm_kernels[kernel_index];
+        output_mixed_samples_ = kernel->output_mixed_samples;
+
+        initialize_audio_mixer(mixer);
+        uint32 voice_id = play_sound_voice(mixer, &sound, 1.0f, 0.0f, false);
+        audio_ring_regions regions = get_contiguous_audio_regions(samples, mix_frame_count);
+        mix_audio(mixer, &regions, samples_per_second);
+        if(kernel_index == 0)
+        {
+            memcpy(expected, source, frame_count*2*sizeof(int16));
+            memset(expected + 2*frame_count, 0, (mix_frame_count - frame_count)*2*sizeof(int16));
+        }
+        if((memcmp(expected, samples, mix_frame_count*2*sizeof(int16)) != 0) ||
+           get_audio_voice(mixer, voice_id) || (mixer->free_voice_count != MAX_AUDIO_VOICE_COUNT))
+        {
+            printf("  %-8s FAILED does not play the file as it is, then stop\n", kernel->name);
+            Result = false;
+            continue;
+        }
+
+        // NOTE: Voices spread over the file, so they do not all read the
+        // same cache lines.
+        initialize_audio_mixer(mixer);
+        for(int voice_index = 0;
+            voice_index < voice_count;
+            ++voice_index)
+        {
+            uint32 id = play_sound_voice(mixer, &sound, 0.01f, 0.0f, true);
+            get_audio_voice(mixer, id)->position = ((uint64)(voice_index*frame_count / voice_count)
+                                                    << 32);
+        }
+        real64 best_ns = 1e30;
+        for(int repeat = 0;
+            repeat < 5;
+            ++repeat)
+        {
+            regions = get_contiguous_audio_regions(samples, samples_per_second);
+            int64 start = bench_get_ns();
+            mix_audio(mixer, &regions, samples_per_second);
+            real64 elapsed = (real64)(bench_get_ns() - start);
+            if(elapsed < best_ns)
+            {
+                best_ns = elapsed;
+            }
+        }
+        printf("  %-8s %6.3f\n", kernel->name, best_ns / ((real64)voice_count*samples_per_second));
+    }
+    mix_sine_voice_ = 0;
+    mix_pcm_voice_ = 0;
+    output_mixed_samples_ = 0;
+
+    // NOTE: The first window is asked for as soon as the voice starts, the
+    // next one not until the voice is half way through it, and a looping
+    // voice near the end asks for its start again.
+    initialize_audio_mixer(mixer);
+    uint32 stream_voice_id = play_sound_voice(mixer, &sound, 1.0f, 0.0f, true);
+    audio_voice *stream_voice = get_audio_voice(mixer, stream_voice_id);
+    BenchPrefetchCount = 0;
+    stream_audio_voices(mixer, bench_prefetch_file);
+    bool32 first_ok = ((BenchPrefetchCount == 1) &&
+                       (BenchPrefetchOffset == LINUX_WAV_HEADER_SIZE) &&
+                       (BenchPrefetchSize == (uint64)samples_per_second*4));
+    stream_voice->position = (uint64)(samples_per_second/4) << 32;
+    stream_audio_voices(mixer, bench_prefetch_file);
+    bool32 early_ok = (BenchPrefetchCount == 1);
+    stream_voice->position = (uint64)(samples_per_second/2) << 32;
+    stream_audio_voices(mixer, bench_prefetch_file);
+    bool32 next_ok = ((BenchPrefetchCount == 2) &&
+                      (BenchPrefetchOffset ==
+                       LINUX_WAV_HEADER_SIZE + (uint64)samples_per_second*4) &&
+                      (BenchPrefetchSize == (uint64)samples_per_second*2));
+    stream_voice->position = (uint64)(frame_count - 1000) << 32;
+    stream_audio_voices(mixer, bench_prefetch_file);
+    bool32 loop_ok = ((BenchPrefetchCount == 4) &&
+                      (BenchPrefetchOffset == LINUX_WAV_HEADER_SIZE) &&
+                      (BenchPrefetchSize == (uint64)(samples_per_second - 1000)*4));
+    if(!first_ok || !early_ok || !next_ok || !loop_ok)
+    {
+        printf("streamed sound: FAILED prefetch hints %d %d %d %d\n",
+               first_ok, early_ok, next_ok, loop_ok);
+        Result = false;
+    }
+
+    // NOTE: A mono ramp at 44.1kHz, stepped through at 48kHz: the
+    // interpolated output has to lie on the same ramp, in both channels,
+    // for as many frames as the ramp lasts at the new rate.
+    uint32 const ramp_frame_count = 30000;
+    int16 *ramp = (int16 *)malloc(ramp_frame_count*sizeof(int16));
+    for(uint32 frame_index = 0;
+        frame_index < ramp_frame_count;
+        ++frame_index)
+    {
+        ramp[frame_index] = (int16)(2*frame_index - ramp_frame_count);
+    }
+    char ramp_path[] = "/tmp/handmade_bench_XXXXXX";
+    audio_sound ramp_sound = {};
+    bench_write_wav(ramp_path, 44100, 1, ramp, ramp_frame_count);
+    load_wav(&ramp_sound, linux_map_file(ramp_path));
+    unlink(ramp_path);
+
+    initialize_audio_mixer(mixer);
+    play_sound_voice(mixer, &ramp_sound, 1.0f, 0.0f, false);
+    audio_ring_regions regions = get_contiguous_audio_regions(samples, mix_frame_count);
+    mix_audio(mixer, &regions, samples_per_second);
+    uint32 played_count = (uint32)(((uint64)ramp_frame_count*48000 + 44099) / 44100);
+    int bad_count = 0;
+    for(uint32 frame_index = 0;
+        frame_index < played_count + 100;
+        ++frame_index)
+    {
+        real64 t = (real64)frame_index*44100.0 / 48000.0;
+        real64 ideal = ((t < ramp_frame_count - 1) ?
+                        (2.0*t - ramp_frame_count) : ramp[ramp_frame_count - 1]);
+        if(frame_index >= played_count)
+        {
+            ideal = 0.0;
+        }
+        int16 value = samples[2*frame_index];
+        if((fabs((real64)value - ideal) > 1.0) || (value != samples[2*frame_index + 1]))
+        {
+            ++bad_count;
+        }
+    }
+    if(!ramp_sound.samples || bad_count || (mixer->free_voice_count != MAX_AUDIO_VOICE_COUNT))
+    {
+        printf("streamed sound: FAILED %d interpolated frames are off the ramp\n", bad_count);
+        Result = false;
+    }
+
+    linux_unmap_file(&ramp_sound.file);
+    linux_unmap_file(&sound.file);
+    free(ramp);
+    free(samples);
+    free(expected);
+    free(mixer);
+    free(source);
+
+    return(Result);
+}
+
+int
+main(int argc, char **argv)
+{
+    bool32 passed = true;
+    passed &= bench_render_weird_gradient();
+    passed &= bench_tiled_game_update_render();
+    passed &= bench_render_group_tiling();
+    passed &= bench_frame_telemetry();
+    passed &= bench_audio_latency();
+    passed &= bench_mix_sine_voice();
+    passed &= bench_audio_mixer();
+    passed &= bench_audio_ring();
+    passed &= bench_streamed_sound();
+    passed &= bench_audio_filters();
+    passed &= bench_game_sound();
+    passed &= bench_resampler();
+    passed &= bench_sample_writers();
+    passed &= bench_sample_ring();
+    passed &= bench_sound_sinks();
+#if HANDMADE_PROFILE
+    passed &= bench_timed_block();
+    passed &= bench_trace_capture();
+#endif
+
+    return(passed ? 0 : 1);
+}
@@ -0,0 +1,270 @@
+#include "handmade_debug.h"
+
+#if HANDMADE_PROFILE
+
+#include <stdio.h>
+#include <stdarg.h>
+
+// NOTE: The per-thread tables are read and cleared without any locking, so
+// these must only be called between frames, from outside every block, while
+// the workers are idle (that is, after complete_all_work).
+
+internal void
+debug_format_report(char *buffer, memory_index size, uint64 frame_count)
+{
+    uint64 cpu_timer_frequency = GlobalDebugState.cpu_timer_frequency;
+    real64 ms_per_cycle = cpu_timer_frequency ? (1000.0 / (real64)cpu_timer_frequency) : 0.0;
+    real64 per_frame = frame_count ? (1.0 / (real64)frame_count) : 1.0;
+
+    char *at = buffer;
+    char *end = buffer + size;
+    at += snprintf(at, end - at, "%-32s %8s %3s %12s %12s %9s %9s  (per frame, %llu frames)\n",
+                   "block", "hits", "thr", "incl cy", "excl cy", "incl ms", "excl ms",
+                   (unsigned long long)frame_count);
+    if(at > end) {at = end;}
+
+    uint32 thread_count = GlobalDebugState.thread_count;
+    if(thread_count > MAX_DEBUG_THREAD_COUNT)
+    {
+        thread_count = MAX_DEBUG_THREAD_COUNT;
+    }
+
+    for(uint32 record_index = 1;
+        (record_index < MAX_DEBUG_RECORD_COUNT) && (at < end);
+        ++record_index)
+    {
+        // NOTE: Worker blocks sum over every thread that ran them, so they
+        // can add up to more than the frame.
+        debug_record total = {};
+        uint32 hit_thread_count = 0;
+        for(uint32 thread_index = 0;
+            thread_index < thread_count;
+            ++thread_index)
+        {
+            debug_thread_table *table = GlobalDebugState.threads[thread_index];
+            if(table)
+            {
+                debug_record *record = table->records + record_index;
+                if(record->hit_count)
+                {
+                    total.cycles_inclusive += record->cycles_inclusive;
+                    total.cycles_exclusive += record->cycles_exclusive;
+                    total.hit_count += record->hit_count;
+                    ++hit_thread_count;
+                }
+            }
+        }
+
+        if(total.hit_count)
+        {
+            debug_record_info *info = GlobalDebugState.record_infos + record_index;
+            real64 inclusive = (real64)total.cycles_inclusive*per_frame;
+            real64 exclusive = (real64)total.cycles_exclusive*per_frame;
+            at += snprintf(at, end - at, "%-32s %8.1f %3u %12.0f %12.0f %9.3f %9.3f  %s:%d\n",
+                           info->block_name, (real64)total.hit_count*per_frame,
+                           hit_thread_count, inclusive, exclusive,
+                           inclusive*ms_per_cycle, exclusive*ms_per_cycle,
+                           info->file_name, info->line_number);
+            if(at > end) {at = end;}
+        }
+    }
+}
+
+internal void
+debug_reset_records(void)
+{
+    uint32 thread_count = GlobalDebugState.thread_count;
+    for(uint32 thread_index = 0;
+        (thread_index < thread_count) && (thread_index < MAX_DEBUG_THREAD_COUNT);
+        ++thread_index)
+    {
+        debug_thread_table *table = GlobalDebugState.threads[thread_index];
+        if(table)
+        {
+            zero_size(sizeof(table->records), table->records);
+        }
+    }
+}
+
+//
+// NOTE: Trace capture. debug_start_trace and debug_stop_trace only flip a
+// flag and may be called from anywhere; the file belongs to the trace
+// writer thread, which calls debug_update_trace every few milliseconds.
+//
+
+struct debug_trace_writer
+{
+    FILE *file;
+    uint64 begin_clock;
+    uint64 event_count;
+    uint32 named_thread_count;
+};
+
+global_variable debug_trace_writer GlobalDebugTraceWriter;
+
+internal void
+debug_start_trace(char const *file_name)
+{
+    if(!GlobalDebugState.trace_requested)
+    {
+        snprintf(GlobalDebugState.trace_file_name, sizeof(GlobalDebugState.trace_file_name),
+                 "%s", file_name);
+        CompletePreviousWritesBeforeFutureWrites;
+        GlobalDebugState.trace_requested = true;
+    }
+}
+
+internal void
+debug_stop_trace(void)
+{
+    GlobalDebugState.trace_requested = false;
+}
+
+// NOTE: True until the writer has closed the file after a stop.
+internal bool32
+debug_trace_in_progress(void)
+{
+    return(GlobalDebugState.trace_requested || GlobalDebugState.is_tracing ||
+           (GlobalDebugTraceWriter.file != 0));
+}
+
+internal void
+debug_write_trace_event(debug_trace_writer *writer, char const *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fputs(writer->event_count++ ? ",\n" : "\n", writer->file);
+    vfprintf(writer->file, format, args);
+    va_end(args);
+}
+
+internal void
+debug_drain_trace_events(debug_trace_writer *writer)
+{
+    real64 us_per_cycle = 1000000.0 / (real64)GlobalDebugState.cpu_timer_frequency;
+    uint32 thread_count = GlobalDebugState.thread_count;
+    if(thread_count > MAX_DEBUG_THREAD_COUNT)
+    {
+        thread_count = MAX_DEBUG_THREAD_COUNT;
+    }
+
+    for(uint32 thread_index = 0;
+        thread_index < thread_count;
+        ++thread_index)
+    {
+        debug_thread_table *table = GlobalDebugState.threads[thread_index];
+        if(!table)
+        {
+            // NOTE: Registered, but the pointer is not stored yet.
+            continue;
+        }
+
+        if(thread_index >= writer->named_thread_count)
+        {
+            debug_write_trace_event(writer, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                                    "\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                                    thread_index, thread_index);
+            writer->named_thread_count = thread_index + 1;
+        }
+
+        uint32 read_count = table->event_read_count;
+        uint32 write_count = table->event_write_count;
+        CompletePreviousReadsBeforeFutureReads;
+        for(;
+            read_count != write_count;
+            ++read_count)
+        {
+            debug_event *event = table->events + (read_count % DEBUG_EVENT_RING_SIZE);
+
+            // NOTE: Late end events of blocks from before this capture.
+            if(event->clock >= writer->begin_clock)
+            {
+                debug_record_info *info = GlobalDebugState.record_infos + event->record_index;
+                debug_write_trace_event(writer, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                                        "\"pid\":1,\"tid\":%u}",
+                                        info->block_name,
+                                        (event->type == DebugEventType_begin_block) ? 'B' : 'E',
+                                        (real64)(event->clock - writer->begin_clock)*us_per_cycle,
+                                        thread_index);
+            }
+        }
+
+        CompletePreviousReadsBeforeFutureReads;
+        table->event_read_count = read_count;
+    }
+}
+
+internal void
+debug_update_trace(void)
+{
+    debug_trace_writer *writer = &GlobalDebugTraceWriter;
+
+    if(GlobalDebugState.trace_requested && !writer->file)
+    {
+        writer->file = fopen(GlobalDebugState.trace_file_name, "wb");
+        if(!writer->file)
+        {
+            GlobalDebugState.trace_requested = false;
+            return;
+        }
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", writer->file);
+        writer->event_count = 0;
+        writer->named_thread_count = 0;
+
+        // NOTE: Whatever is still in the rings belongs to an older capture.
+        uint32 thread_count = GlobalDebugState.thread_count;
+        for(uint32 thread_index = 0;
+            (thread_index < thread_count) && (thread_index < MAX_DEBUG_THREAD_COUNT);
+            ++thread_index)
+        {
+            debug_thread_table *table = GlobalDebugState.threads[thread_index];
+            if(table)
+            {
+                table->event_read_count = table->event_write_count;
+                table->dropped_event_count = 0;
+            }
+        }
+
+        writer->begin_clock = read_cpu_timer();
+        CompletePreviousWritesBeforeFutureWrites;
+        GlobalDebugState.is_tracing = true;
+    }
+
+    if(writer->file)
+    {
+        bool32 stopping = !GlobalDebugState.trace_requested;
+        if(stopping)
+        {
+            GlobalDebugState.is_tracing = false;
+        }
+
+        debug_drain_trace_events(writer);
+
+        if(stopping)
+        {
+            uint32 dropped_event_count = 0;
+            uint32 thread_count = GlobalDebugState.thread_count;
+            for(uint32 thread_index = 0;
+                (thread_index < thread_count) && (thread_index < MAX_DEBUG_THREAD_COUNT);
+                ++thread_index)
+            {
+                debug_thread_table *table = GlobalDebugState.threads[thread_index];
+                if(table)
+                {
+                    dropped_event_count += table->dropped_event_count;
+                }
+            }
+
+            fprintf(writer->file, "\n],\"otherData\":{\"dropped_events\":\"%u\"}}\n",
+                    dropped_event_count);
+            fclose(writer->file);
+            writer->file = 0;
+        }
+        else
+        {
+            fflush(writer->file);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,217 @@
+#if !defined(HANDMADE_DEBUG_H)
+
+/* NOTE:
+
+   Scoped cycle-count instrumentation:
+
+     TIMED_FUNCTION();
+     TIMED_BLOCK("present");
+
+   1) Each block site gets a fixed slot (from __COUNTER__, which is unique
+      across the whole unity build) in a per-thread table, so recording is
+      two rdtsc's and a few adds into memory nothing else writes. No locks,
+      no atomics.
+
+   2) Blocks nest. Time spent in a child is taken out of its parent's
+      exclusive count, and recursion does not count the same cycles twice
+      in the inclusive count.
+
+   3) A thread's table lives in its TLS and is registered the first time
+      the thread enters a block, so threads that run blocks must live as
+      long as the process (all of ours do).
+
+   4) While a trace is being captured, every block also drops a begin and
+      an end event into its thread's ring. A background thread owned by the
+      platform streams the rings out as a Chrome trace-event JSON file
+      (chrome://tracing, ui.perfetto.dev). When the writer falls behind,
+      events are dropped and counted; the rings never grow.
+
+   5) Only built with HANDMADE_PROFILE=1; otherwise the macros expand to
+      nothing.
+*/
+
+#if !defined(HANDMADE_PROFILE)
+#define HANDMADE_PROFILE 0
+#endif
+
+#if HANDMADE_PROFILE
+
+// NOTE: Slot 0 is the root, whatever runs outside of any block.
+#define MAX_DEBUG_RECORD_COUNT 256
+#define MAX_DEBUG_THREAD_COUNT 64
+#define DEBUG_EVENT_RING_SIZE (1 << 14)
+
+struct debug_record
+{
+    uint64 cycles_inclusive;
+    uint64 cycles_exclusive;
+    uint64 hit_count;
+};
+
+struct debug_record_info
+{
+    char const *block_name;
+    char const *file_name;
+    int line_number;
+};
+
+enum debug_event_type
+{
+    DebugEventType_begin_block,
+    DebugEventType_end_block,
+};
+
+struct debug_event
+{
+    uint64 clock;
+    uint32 record_index;
+    uint32 type;
+};
+
+// NOTE: The events are a single-producer ring: only the owning thread
+// writes event_write_count and only the trace writer event_read_count.
+struct debug_thread_table
+{
+    bool32 is_registered;
+    uint32 open_record_index;
+    debug_record records[MAX_DEBUG_RECORD_COUNT];
+
+    uint32 volatile event_write_count;
+    uint32 volatile event_read_count;
+    uint32 volatile dropped_event_count;
+    debug_event events[DEBUG_EVENT_RING_SIZE];
+};
+
+struct debug_state
+{
+    uint32 volatile thread_count;
+    debug_thread_table *threads[MAX_DEBUG_THREAD_COUNT];
+    debug_record_info record_infos[MAX_DEBUG_RECORD_COUNT];
+
+    // NOTE: Set by the platform at startup, used to turn cycles into time.
+    uint64 cpu_timer_frequency;
+
+    // NOTE: trace_requested is flipped by whoever starts and stops the
+    // capture; is_tracing only by the trace writer, once the file is open.
+    bool32 volatile trace_requested;
+    bool32 volatile is_tracing;
+    char trace_file_name[256];
+};
+
+global_variable debug_state GlobalDebugState;
+static thread_local debug_thread_table GlobalDebugThreadTable;
+
+internal void
+debug_register_thread(debug_thread_table *table)
+{
+    uint32 thread_index = atomic_add_u32(&GlobalDebugState.thread_count, 1);
+    Assert(thread_index < MAX_DEBUG_THREAD_COUNT);
+    if(thread_index < MAX_DEBUG_THREAD_COUNT)
+    {
+        GlobalDebugState.threads[thread_index] = table;
+    }
+    table->is_registered = true;
+}
+
+inline void
+debug_record_event(debug_thread_table *table, uint64 clock,
+                   uint32 record_index, debug_event_type type)
+{
+    uint32 write_count = table->event_write_count;
+    if((write_count - table->event_read_count) < DEBUG_EVENT_RING_SIZE)
+    {
+        debug_event *event = table->events + (write_count % DEBUG_EVENT_RING_SIZE);
+        event->clock = clock;
+        event->record_index = record_index;
+        event->type = type;
+
+        CompletePreviousWritesBeforeFutureWrites;
+        table->event_write_count = write_count + 1;
+    }
+    else
+    {
+        ++table->dropped_event_count;
+    }
+}
+
+struct timed_block
+{
+    uint64 start_cycles;
+    uint64 old_cycles_inclusive;
+    uint32 record_index;
+    uint32 parent_index;
+    bool32 is_traced;
+
+    timed_block(uint32 record_index_, char const *block_name,
+                char const *file_name, int line_number)
+    {
+        Assert(record_index_ < MAX_DEBUG_RECORD_COUNT);
+        debug_thread_table *table = &GlobalDebugThreadTable;
+        if(!table->is_registered)
+        {
+            debug_register_thread(table);
+        }
+
+        record_index = record_index_;
+        parent_index = table->open_record_index;
+        table->open_record_index = record_index;
+
+        debug_record *record = table->records + record_index;
+        if(!record->hit_count)
+        {
+            // NOTE: Every thread writes the same values here, so the race
+            // is harmless.
+            debug_record_info *info = GlobalDebugState.record_infos + record_index;
+            info->block_name = block_name;
+            info->file_name = file_name;
+            info->line_number = line_number;
+        }
+        old_cycles_inclusive = record->cycles_inclusive;
+
+        start_cycles = read_cpu_timer();
+
+        // NOTE: A block that started before the capture did must not emit
+        // an end event either.
+        is_traced = GlobalDebugState.is_tracing;
+        if(is_traced)
+        {
+            debug_record_event(table, start_cycles, record_index, DebugEventType_begin_block);
+        }
+    }
+
+    ~timed_block()
+    {
+        uint64 end_cycles = read_cpu_timer();
+        uint64 elapsed = end_cycles - start_cycles;
+
+        debug_thread_table *table = &GlobalDebugThreadTable;
+        table->open_record_index = parent_index;
+
+        debug_record *record = table->records + record_index;
+        record->cycles_inclusive = old_cycles_inclusive + elapsed;
+        record->cycles_exclusive += elapsed;
+        ++record->hit_count;
+
+        table->records[parent_index].cycles_exclusive -= elapsed;
+
+        if(is_traced)
+        {
+            debug_record_event(table, end_cycles, record_index, DebugEventType_end_block);
+        }
+    }
+};
+
+#define TIMED_BLOCK__(name, counter) timed_block TimedBlock_##counter((counter) + 1, name, __FILE__, __LINE__)
+#define TIMED_BLOCK_(name, counter) TIMED_BLOCK__(name, counter)
+#define TIMED_BLOCK(name) TIMED_BLOCK_(name, __COUNTER__)
+#define TIMED_FUNCTION() TIMED_BLOCK(__FUNCTION__)
+
+#else
+
+#define TIMED_BLOCK(name)
+#define TIMED_FUNCTION()
+
+#endif
+
+#define HANDMADE_DEBUG_H
+#endif
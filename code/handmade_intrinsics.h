@@ -0,0 +1,131 @@
+#if !defined(HANDMADE_INTRINSICS_H)
+
+//
+// NOTE: Compiler-specific wrappers for the handful of x86 intrinsics the game
+// layer needs (cycle counter, cpuid and SIMD target selection).
+//
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+
+// NOTE: GCC and clang only let us use AVX2/AVX-512 intrinsics inside functions
+// that are explicitly compiled for that target; MSVC always allows them.
+#if defined(_MSC_VER)
+#define HANDMADE_TARGET(name)
+#else
+#define HANDMADE_TARGET(name) __attribute__((target(name)))
+#endif
+
+// NOTE: x86 does not reorder stores with stores or loads with loads, so
+// these only have to stop the compiler from doing it.
+#if defined(_MSC_VER)
+#define CompletePreviousWritesBeforeFutureWrites _WriteBarrier()
+#define CompletePreviousReadsBeforeFutureReads _ReadBarrier()
+#else
+#define CompletePreviousWritesBeforeFutureWrites __asm__ __volatile__("" ::: "memory")
+#define CompletePreviousReadsBeforeFutureReads __asm__ __volatile__("" ::: "memory")
+#endif
+
+// NOTE: Returns the value from before the add.
+inline uint32
+atomic_add_u32(uint32 volatile *value, uint32 addend)
+{
+#if defined(_MSC_VER)
+    return((uint32)_InterlockedExchangeAdd((long volatile *)value, (long)addend));
+#else
+    return(__sync_fetch_and_add(value, addend));
+#endif
+}
+
+inline uint32
+find_most_significant_set_bit(uint64 value)
+{
+    Assert(value);
+#if defined(_MSC_VER)
+    unsigned long Result;
+    _BitScanReverse64(&Result, value);
+    return((uint32)Result);
+#else
+    return(63 - __builtin_clzll(value));
+#endif
+}
+
+inline uint64
+read_cpu_timer(void)
+{
+    return(__rdtsc());
+}
+
+inline real32
+square_root(real32 value)
+{
+    real32 Result = _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(value)));
+    return(Result);
+}
+
+struct cpu_features
+{
+    bool32 sse2;
+    bool32 avx2;
+    bool32 avx512;
+};
+
+internal void
+cpuid(uint32 leaf, uint32 subleaf, uint32 *registers)
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *)registers, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+internal uint64
+read_xcr0(void)
+{
+#if defined(_MSC_VER)
+    return(_xgetbv(0));
+#else
+    uint32 eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return(((uint64)edx << 32) | eax);
+#endif
+}
+
+internal cpu_features
+get_cpu_features(void)
+{
+    cpu_features Result = {};
+
+    uint32 registers[4];
+    cpuid(0, 0, registers);
+    uint32 max_leaf = registers[0];
+
+    cpuid(1, 0, registers);
+    Result.sse2 = (registers[3] & (1 << 26)) != 0;
+
+    // NOTE: The CPU supporting AVX is not enough, the OS also has to save
+    // the YMM (and for AVX-512 the ZMM/opmask) state on context switches.
+    bool32 osxsave = (registers[2] & (1 << 27)) != 0;
+    bool32 avx = (registers[2] & (1 << 28)) != 0;
+    uint64 xcr0 = osxsave ? read_xcr0() : 0;
+    bool32 ymm_enabled = (xcr0 & 0x6) == 0x6;
+    bool32 zmm_enabled = (xcr0 & 0xE6) == 0xE6;
+
+    if(max_leaf >= 7)
+    {
+        cpuid(7, 0, registers);
+        Result.avx2 = avx && ymm_enabled && ((registers[1] & (1 << 5)) != 0);
+        Result.avx512 = Result.avx2 && zmm_enabled && ((registers[1] & (1 << 16)) != 0);
+    }
+
+    return(Result);
+}
+
+#define HANDMADE_INTRINSICS_H
+#endif
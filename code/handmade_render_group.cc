@@ -0,0 +1,693 @@
+#include "handmade_render_group.h"
+
+// NOTE: Every gradient kernel below must produce exactly the same bits as
+// render_weird_gradient_scalar; the wide ones only differ in how many pixels
+// they write per step, and fall back to the scalar math for the row tail.
+typedef void render_weird_gradient_kernel(game_offscreen_buffer *buffer,
+                                          int blue_offset, int green_offset);
+
+internal void
+render_weird_gradient_scalar (game_offscreen_buffer *buffer,
+                              int blue_offset, int green_offset)
+{
+    uint8 *row = (uint8 *)buffer->memory;
+    for(int y = 0;
+        y < buffer->height;
+        ++y)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(int x = 0;
+            x < buffer->width;
+            ++x)
+        {
+            uint8 blue = (x + blue_offset);
+            uint8 green = (y + green_offset);
+
+            *pixel++ = ((green << 8) | blue);
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+internal void
+render_weird_gradient_sse2 (game_offscreen_buffer *buffer,
+                            int blue_offset, int green_offset)
+{
+    __m128i byte_mask = _mm_set1_epi32(0xFF);
+    __m128i blue_step = _mm_set1_epi32(4);
+    __m128i first_blue = _mm_setr_epi32(blue_offset + 0, blue_offset + 1,
+                                        blue_offset + 2, blue_offset + 3);
+
+    uint8 *row = (uint8 *)buffer->memory;
+    for(int y = 0;
+        y < buffer->height;
+        ++y)
+    {
+        uint8 green = (y + green_offset);
+        __m128i green_bits = _mm_set1_epi32(green << 8);
+        __m128i blue = first_blue;
+
+        uint32 *pixel = (uint32 *)row;
+        int x = 0;
+        for(;
+            x + 4 <= buffer->width;
+            x += 4)
+        {
+            __m128i color = _mm_or_si128(_mm_and_si128(blue, byte_mask), green_bits);
+            _mm_storeu_si128((__m128i *)pixel, color);
+            blue = _mm_add_epi32(blue, blue_step);
+            pixel += 4;
+        }
+
+        for(;
+            x < buffer->width;
+            ++x)
+        {
+            uint8 tail_blue = (x + blue_offset);
+            *pixel++ = ((green << 8) | tail_blue);
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+HANDMADE_TARGET("avx2") internal void
+render_weird_gradient_avx2 (game_offscreen_buffer *buffer,
+                            int blue_offset, int green_offset)
+{
+    __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    __m256i blue_step = _mm256_set1_epi32(8);
+    __m256i first_blue = _mm256_add_epi32(_mm256_set1_epi32(blue_offset),
+                                          _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    uint8 *row = (uint8 *)buffer->memory;
+    for(int y = 0;
+        y < buffer->height;
+        ++y)
+    {
+        uint8 green = (y + green_offset);
+        __m256i green_bits = _mm256_set1_epi32(green << 8);
+        __m256i blue = first_blue;
+
+        uint32 *pixel = (uint32 *)row;
+        int x = 0;
+        for(;
+            x + 8 <= buffer->width;
+            x += 8)
+        {
+            __m256i color = _mm256_or_si256(_mm256_and_si256(blue, byte_mask), green_bits);
+            _mm256_storeu_si256((__m256i *)pixel, color);
+            blue = _mm256_add_epi32(blue, blue_step);
+            pixel += 8;
+        }
+
+        for(;
+            x < buffer->width;
+            ++x)
+        {
+            uint8 tail_blue = (x + blue_offset);
+            *pixel++ = ((green << 8) | tail_blue);
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+HANDMADE_TARGET("avx512f") internal void
+render_weird_gradient_avx512 (game_offscreen_buffer *buffer,
+                              int blue_offset, int green_offset)
+{
+    __m512i byte_mask = _mm512_set1_epi32(0xFF);
+    __m512i blue_step = _mm512_set1_epi32(16);
+    __m512i first_blue = _mm512_add_epi32(_mm512_set1_epi32(blue_offset),
+                                          _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                                            8, 9, 10, 11, 12, 13, 14, 15));
+
+    uint8 *row = (uint8 *)buffer->memory;
+    for(int y = 0;
+        y < buffer->height;
+        ++y)
+    {
+        uint8 green = (y + green_offset);
+        __m512i green_bits = _mm512_set1_epi32(green << 8);
+        __m512i blue = first_blue;
+
+        uint32 *pixel = (uint32 *)row;
+        int x = 0;
+        for(;
+            x + 16 <= buffer->width;
+            x += 16)
+        {
+            __m512i color = _mm512_or_si512(_mm512_and_si512(blue, byte_mask), green_bits);
+            _mm512_storeu_si512((void *)pixel, color);
+            blue = _mm512_add_epi32(blue, blue_step);
+            pixel += 16;
+        }
+
+        for(;
+            x < buffer->width;
+            ++x)
+        {
+            uint8 tail_blue = (x + blue_offset);
+            *pixel++ = ((green << 8) | tail_blue);
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+internal render_weird_gradient_kernel *
+select_render_weird_gradient_kernel(cpu_features features)
+{
+    render_weird_gradient_kernel *Result = render_weird_gradient_scalar;
+    if(features.avx512)
+    {
+        Result = render_weird_gradient_avx512;
+    }
+    else if(features.avx2)
+    {
+        Result = render_weird_gradient_avx2;
+    }
+    else if(features.sse2)
+    {
+        Result = render_weird_gradient_sse2;
+    }
+
+    return(Result);
+}
+
+global_variable render_weird_gradient_kernel *render_weird_gradient_ = 0;
+
+internal void
+render_weird_gradient (game_offscreen_buffer *buffer,
+                       int blue_offset, int green_offset)
+{
+    TIMED_FUNCTION();
+    render_weird_gradient_(buffer, blue_offset, green_offset);
+}
+
+internal void
+draw_rectangle(game_offscreen_buffer *buffer,
+               int min_x, int min_y, int max_x, int max_y, uint32 color)
+{
+    if(min_x < 0)
+    {
+        min_x = 0;
+    }
+    if(min_y < 0)
+    {
+        min_y = 0;
+    }
+    if(max_x > buffer->width)
+    {
+        max_x = buffer->width;
+    }
+    if(max_y > buffer->height)
+    {
+        max_y = buffer->height;
+    }
+
+    uint8 *row = ((uint8 *)buffer->memory +
+                  min_y*buffer->pitch + min_x*sizeof(uint32));
+    for(int y = min_y;
+        y < max_y;
+        ++y)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(int x = min_x;
+            x < max_x;
+            ++x)
+        {
+            *pixel++ = color;
+        }
+
+        row += buffer->pitch;
+    }
+}
+
+internal void
+draw_bitmap(game_offscreen_buffer *buffer, loaded_bitmap *bitmap, int x, int y)
+{
+    int min_x = x;
+    int min_y = y;
+    int max_x = x + bitmap->width;
+    int max_y = y + bitmap->height;
+
+    int source_offset_x = 0;
+    int source_offset_y = 0;
+    if(min_x < 0)
+    {
+        source_offset_x = -min_x;
+        min_x = 0;
+    }
+    if(min_y < 0)
+    {
+        source_offset_y = -min_y;
+        min_y = 0;
+    }
+    if(max_x > buffer->width)
+    {
+        max_x = buffer->width;
+    }
+    if(max_y > buffer->height)
+    {
+        max_y = buffer->height;
+    }
+
+    uint8 *source_row = ((uint8 *)bitmap->memory +
+                         source_offset_y*bitmap->pitch + source_offset_x*sizeof(uint32));
+    uint8 *dest_row = ((uint8 *)buffer->memory +
+                       min_y*buffer->pitch + min_x*sizeof(uint32));
+    for(int dest_y = min_y;
+        dest_y < max_y;
+        ++dest_y)
+    {
+        uint32 *dest = (uint32 *)dest_row;
+        uint32 *source = (uint32 *)source_row;
+        for(int dest_x = min_x;
+            dest_x < max_x;
+            ++dest_x)
+        {
+            // NOTE: Premultiplied alpha, so this is source + (1 - alpha)*dest
+            // per channel.
+            uint32 s = *source++;
+            uint32 d = *dest;
+            uint32 inv_alpha = 255 - (s >> 24);
+
+            uint32 rb = (((d & 0x00FF00FF)*inv_alpha) >> 8) & 0x00FF00FF;
+            uint32 ag = (((d >> 8) & 0x00FF00FF)*inv_alpha) & 0xFF00FF00;
+            *dest++ = s + (rb | ag);
+        }
+
+        dest_row += buffer->pitch;
+        source_row += bitmap->pitch;
+    }
+}
+
+internal render_group *
+allocate_render_group(memory_arena *arena, uint32 max_push_buffer_size)
+{
+    render_group *Result = PushStruct(arena, render_group);
+    Result->push_buffer_base = (uint8 *)PushSize(arena, max_push_buffer_size);
+    Assert(((memory_index)Result->push_buffer_base & 7) == 0);
+
+    Result->max_push_buffer_size = max_push_buffer_size;
+    Result->push_buffer_size = 0;
+
+    return(Result);
+}
+
+#define PushRenderElement(group, type) (type *)push_render_element_(group, sizeof(type), RenderGroupEntryType_##type)
+inline void *
+push_render_element_(render_group *group, uint32 size, render_group_entry_type type)
+{
+    void *Result = 0;
+
+    uint32 entry_size = (size + 7) & ~7;
+    uint32 total_size = sizeof(render_group_entry_header) + entry_size;
+
+    if((group->push_buffer_size + total_size) <= group->max_push_buffer_size)
+    {
+        render_group_entry_header *header =
+            (render_group_entry_header *)(group->push_buffer_base + group->push_buffer_size);
+        header->type = type;
+        header->size = entry_size;
+        Result = (uint8 *)header + sizeof(*header);
+        zero_size(entry_size, Result);
+        group->push_buffer_size += total_size;
+    }
+    else
+    {
+        InvalidCodePath;
+    }
+
+    return(Result);
+}
+
+inline void
+push_clear(render_group *group, uint32 color)
+{
+    render_entry_clear *entry = PushRenderElement(group, render_entry_clear);
+    if(entry)
+    {
+        entry->color = color;
+    }
+}
+
+inline void
+push_rectangle(render_group *group, int min_x, int min_y, int max_x, int max_y, uint32 color)
+{
+    render_entry_rectangle *entry = PushRenderElement(group, render_entry_rectangle);
+    if(entry)
+    {
+        entry->min_x = min_x;
+        entry->min_y = min_y;
+        entry->max_x = max_x;
+        entry->max_y = max_y;
+        entry->color = color;
+    }
+}
+
+inline void
+push_bitmap(render_group *group, loaded_bitmap *bitmap, int x, int y)
+{
+    render_entry_bitmap *entry = PushRenderElement(group, render_entry_bitmap);
+    if(entry)
+    {
+        entry->bitmap = bitmap;
+        entry->x = x;
+        entry->y = y;
+    }
+}
+
+inline void
+push_gradient(render_group *group, int blue_offset, int green_offset)
+{
+    render_entry_gradient *entry = PushRenderElement(group, render_entry_gradient);
+    if(entry)
+    {
+        entry->blue_offset = blue_offset;
+        entry->green_offset = green_offset;
+    }
+}
+
+// NOTE: target may be a tile of the real output; origin_x/origin_y say where
+// its top left pixel sits in output coordinates.
+internal void
+render_group_to_output(render_group *group, game_offscreen_buffer *target,
+                       int origin_x, int origin_y)
+{
+    for(uint32 base_address = 0;
+        base_address < group->push_buffer_size;
+        )
+    {
+        render_group_entry_header *header = (render_group_entry_header *)
+            (group->push_buffer_base + base_address);
+        base_address += sizeof(*header) + header->size;
+
+        void *data = (uint8 *)header + sizeof(*header);
+        switch(header->type)
+        {
+            case RenderGroupEntryType_render_entry_clear:
+            {
+                render_entry_clear *entry = (render_entry_clear *)data;
+                draw_rectangle(target, 0, 0, target->width, target->height, entry->color);
+            } break;
+
+            case RenderGroupEntryType_render_entry_rectangle:
+            {
+                render_entry_rectangle *entry = (render_entry_rectangle *)data;
+                draw_rectangle(target,
+                               entry->min_x - origin_x, entry->min_y - origin_y,
+                               entry->max_x - origin_x, entry->max_y - origin_y,
+                               entry->color);
+            } break;
+
+            case RenderGroupEntryType_render_entry_bitmap:
+            {
+                render_entry_bitmap *entry = (render_entry_bitmap *)data;
+                draw_bitmap(target, entry->bitmap, entry->x - origin_x, entry->y - origin_y);
+            } break;
+
+            case RenderGroupEntryType_render_entry_gradient:
+            {
+                render_entry_gradient *entry = (render_entry_gradient *)data;
+                render_weird_gradient(target,
+                                      entry->blue_offset + origin_x,
+                                      entry->green_offset + origin_y);
+            } break;
+
+            InvalidDefaultCase;
+        }
+    }
+}
+
+struct tile_render_work
+{
+    render_group *group;
+    game_offscreen_buffer tile;
+    int origin_x;
+    int origin_y;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(do_tile_render_work)
+{
+    TIMED_FUNCTION();
+    tile_render_work *work = (tile_render_work *)data;
+    render_group_to_output(work->group, &work->tile, work->origin_x, work->origin_y);
+}
+
+inline uint64
+hash_bytes(uint64 hash, void *data, memory_index size)
+{
+    // NOTE: FNV-1a
+    uint8 *byte = (uint8 *)data;
+    while(size--)
+    {
+        hash ^= *byte++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return(hash);
+}
+
+// NOTE: Folds every command whose bounds overlap the tile into one hash, in
+// submission order; commands outside the tile cannot change its pixels.
+internal uint64
+hash_tile_commands(render_group *group, game_rect tile)
+{
+    uint64 Result = 0xcbf29ce484222325ULL;
+
+    for(uint32 base_address = 0;
+        base_address < group->push_buffer_size;
+        )
+    {
+        render_group_entry_header *header = (render_group_entry_header *)
+            (group->push_buffer_base + base_address);
+        base_address += sizeof(*header) + header->size;
+
+        void *data = (uint8 *)header + sizeof(*header);
+        game_rect bounds = tile;
+        switch(header->type)
+        {
+            case RenderGroupEntryType_render_entry_clear:
+            case RenderGroupEntryType_render_entry_gradient:
+            {
+            } break;
+
+            case RenderGroupEntryType_render_entry_rectangle:
+            {
+                render_entry_rectangle *entry = (render_entry_rectangle *)data;
+                bounds.min_x = entry->min_x;
+                bounds.min_y = entry->min_y;
+                bounds.max_x = entry->max_x;
+                bounds.max_y = entry->max_y;
+            } break;
+
+            case RenderGroupEntryType_render_entry_bitmap:
+            {
+                render_entry_bitmap *entry = (render_entry_bitmap *)data;
+                bounds.min_x = entry->x;
+                bounds.min_y = entry->y;
+                bounds.max_x = entry->x + entry->bitmap->width;
+                bounds.max_y = entry->y + entry->bitmap->height;
+            } break;
+
+            InvalidDefaultCase;
+        }
+
+        if((bounds.min_x < tile.max_x) && (bounds.max_x > tile.min_x) &&
+           (bounds.min_y < tile.max_y) && (bounds.max_y > tile.min_y))
+        {
+            // NOTE: Entries are zeroed when pushed, so the padding hashes
+            // the same every frame.
+            Result = hash_bytes(Result, header, sizeof(*header) + header->size);
+        }
+    }
+
+    return(Result);
+}
+
+internal void
+add_dirty_rect(game_offscreen_buffer *target, game_rect rect)
+{
+    // NOTE: Rows of dirty tiles arrive top to bottom as horizontal runs; a
+    // run that exactly continues a rect from the row above extends it.
+    for(int rect_index = 0;
+        rect_index < target->dirty_rect_count;
+        ++rect_index)
+    {
+        game_rect *dirty = target->dirty_rects + rect_index;
+        if((dirty->min_x == rect.min_x) && (dirty->max_x == rect.max_x) &&
+           (dirty->max_y == rect.min_y))
+        {
+            dirty->max_y = rect.max_y;
+            return;
+        }
+    }
+
+    if(target->dirty_rect_count < MAX_DIRTY_RECT_COUNT)
+    {
+        target->dirty_rects[target->dirty_rect_count++] = rect;
+    }
+    else
+    {
+        // NOTE: Too fragmented to be worth presenting piecewise, so collapse
+        // everything into one bounding rect.
+        game_rect *bounds = target->dirty_rects;
+        for(int rect_index = 1;
+            rect_index < target->dirty_rect_count;
+            ++rect_index)
+        {
+            game_rect *dirty = target->dirty_rects + rect_index;
+            if(dirty->min_x < bounds->min_x) {bounds->min_x = dirty->min_x;}
+            if(dirty->min_y < bounds->min_y) {bounds->min_y = dirty->min_y;}
+            if(dirty->max_x > bounds->max_x) {bounds->max_x = dirty->max_x;}
+            if(dirty->max_y > bounds->max_y) {bounds->max_y = dirty->max_y;}
+        }
+        if(rect.min_x < bounds->min_x) {bounds->min_x = rect.min_x;}
+        if(rect.min_y < bounds->min_y) {bounds->min_y = rect.min_y;}
+        if(rect.max_x > bounds->max_x) {bounds->max_x = rect.max_x;}
+        if(rect.max_y > bounds->max_y) {bounds->max_y = rect.max_y;}
+        target->dirty_rect_count = 1;
+    }
+}
+
+internal void
+tiled_render_group_to_output(game_memory *memory, tile_cache *cache,
+                             render_group *group, game_offscreen_buffer *target)
+{
+    TIMED_FUNCTION();
+
+    if(!render_weird_gradient_)
+    {
+        // NOTE: Picked once, on the first frame, from what cpuid reports.
+        // This has to happen here on the main thread before any tile runs.
+        render_weird_gradient_ = select_render_weird_gradient_kernel(get_cpu_features());
+    }
+
+    int tile_width = TILE_WIDTH;
+    int tile_height = TILE_HEIGHT;
+    int tile_count_x = (target->width + tile_width - 1) / tile_width;
+    int tile_count_y = (target->height + tile_height - 1) / tile_height;
+    // NOTE: Taller tiles first, since rows are what the dirty rects merge
+    // along; once a tile spans the whole height, a target wider than
+    // MAX_TILE_COUNT tiles can only fit by widening them.
+    while(tile_count_x*tile_count_y > MAX_TILE_COUNT)
+    {
+        if(tile_count_y > 1)
+        {
+            tile_height *= 2;
+            tile_count_y = (target->height + tile_height - 1) / tile_height;
+        }
+        else
+        {
+            tile_width *= 2;
+            tile_count_x = (target->width + tile_width - 1) / tile_width;
+        }
+    }
+
+    // NOTE: If the target is not the buffer we drew last frame, nothing in
+    // it can be trusted and every tile has to be drawn.
+    bool32 cache_valid = (!target->lost_contents &&
+                          (cache->memory == target->memory) &&
+                          (cache->width == target->width) &&
+                          (cache->height == target->height) &&
+                          (cache->pitch == target->pitch) &&
+                          (cache->tile_width == tile_width) &&
+                          (cache->tile_height == tile_height));
+    cache->memory = target->memory;
+    cache->width = target->width;
+    cache->height = target->height;
+    cache->pitch = target->pitch;
+    cache->tile_width = tile_width;
+    cache->tile_height = tile_height;
+
+    target->dirty_rect_count = 0;
+
+    tile_render_work work_array[MAX_TILE_COUNT];
+    int work_count = 0;
+    for(int tile_y = 0;
+        tile_y < tile_count_y;
+        ++tile_y)
+    {
+        game_rect run = {};
+        bool32 in_run = false;
+        for(int tile_x = 0;
+            tile_x < tile_count_x;
+            ++tile_x)
+        {
+            game_rect tile = {};
+            tile.min_x = tile_x*tile_width;
+            tile.min_y = tile_y*tile_height;
+            tile.max_x = tile.min_x + tile_width;
+            tile.max_y = tile.min_y + tile_height;
+            if(tile.max_x > target->width)
+            {
+                tile.max_x = target->width;
+            }
+            if(tile.max_y > target->height)
+            {
+                tile.max_y = target->height;
+            }
+
+            uint64 hash = hash_tile_commands(group, tile);
+            uint64 *cached_hash = cache->tile_hashes + tile_y*tile_count_x + tile_x;
+            bool32 tile_dirty = !cache_valid || (*cached_hash != hash);
+            *cached_hash = hash;
+
+            if(tile_dirty)
+            {
+                // NOTE: A tile is just a window into the parent buffer: it
+                // keeps the parent's pitch, and its origin moves every
+                // command into tile space so nothing is visible across tile
+                // edges.
+                tile_render_work *work = work_array + work_count++;
+                work->group = group;
+                work->tile.memory = ((uint8 *)target->memory +
+                                     tile.min_y*target->pitch + tile.min_x*sizeof(uint32));
+                work->tile.width = tile.max_x - tile.min_x;
+                work->tile.height = tile.max_y - tile.min_y;
+                work->tile.pitch = target->pitch;
+                work->origin_x = tile.min_x;
+                work->origin_y = tile.min_y;
+
+                if(memory->render_queue)
+                {
+                    memory->add_entry(memory->render_queue, do_tile_render_work, work);
+                }
+                else
+                {
+                    do_tile_render_work(0, work);
+                }
+
+                if(in_run)
+                {
+                    run.max_x = tile.max_x;
+                }
+                else
+                {
+                    run = tile;
+                    in_run = true;
+                }
+            }
+            else if(in_run)
+            {
+                add_dirty_rect(target, run);
+                in_run = false;
+            }
+        }
+
+        if(in_run)
+        {
+            add_dirty_rect(target, run);
+        }
+    }
+
+    if(memory->render_queue)
+    {
+        memory->complete_all_work(memory->render_queue);
+    }
+}
@@ -0,0 +1,99 @@
+#if !defined(HANDMADE_RENDER_GROUP_H)
+
+/* NOTE:
+
+   1) The game layer never writes pixels directly any more; it pushes
+      commands into a render_group and the rasterizer executes them later
+      into a game_offscreen_buffer.
+
+   2) All coordinates in the commands are in pixels of the final output
+      buffer, with the origin at the top left. The rasterizer is free to
+      execute the buffer in any tile order, on any thread, so commands must
+      never point at memory that goes away before the frame is done.
+
+   3) Colors are 32-bit, Memory Order BB GG RR AA, same as the output, and
+      bitmaps are premultiplied alpha.
+*/
+
+struct loaded_bitmap
+{
+    int width;
+    int height;
+    int pitch;
+    void *memory;
+};
+
+enum render_group_entry_type
+{
+    RenderGroupEntryType_render_entry_clear,
+    RenderGroupEntryType_render_entry_rectangle,
+    RenderGroupEntryType_render_entry_bitmap,
+    RenderGroupEntryType_render_entry_gradient,
+};
+
+// NOTE: size is the size of the entry that follows the header, padded so
+// that every header and entry in the push buffer stays 8-byte aligned.
+struct render_group_entry_header
+{
+    render_group_entry_type type;
+    uint32 size;
+};
+
+struct render_entry_clear
+{
+    uint32 color;
+};
+
+struct render_entry_rectangle
+{
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    uint32 color;
+};
+
+struct render_entry_bitmap
+{
+    loaded_bitmap *bitmap;
+    int x;
+    int y;
+};
+
+struct render_entry_gradient
+{
+    int blue_offset;
+    int green_offset;
+};
+
+struct render_group
+{
+    uint32 max_push_buffer_size;
+    uint32 push_buffer_size;
+    uint8 *push_buffer_base;
+};
+
+// NOTE: 256x64 pixels is 64k, so a tile's rows stay resident in L2 while
+// it is being filled, and 1080p already yields ~130 tiles to balance over
+// the cores.
+#define TILE_WIDTH 256
+#define TILE_HEIGHT 64
+#define MAX_TILE_COUNT 256
+
+// NOTE: A hash of every command that touched each tile last frame. A tile
+// whose hash did not change is neither re-rendered nor reported dirty. This
+// assumes a bitmap's pixels never change behind the same pointer.
+struct tile_cache
+{
+    void *memory;
+    int width;
+    int height;
+    int pitch;
+
+    int tile_width;
+    int tile_height;
+    uint64 tile_hashes[MAX_TILE_COUNT];
+};
+
+#define HANDMADE_RENDER_GROUP_H
+#endif
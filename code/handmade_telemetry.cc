@@ -0,0 +1,326 @@
+#include "handmade_telemetry.h"
+
+#include <stdio.h>
+
+internal void
+telemetry_init(frame_telemetry *telemetry, int64 target_frame_ns)
+{
+    zero_size(sizeof(*telemetry), telemetry);
+    telemetry->target_frame_ns = target_frame_ns;
+}
+
+inline uint32
+telemetry_bucket_index(int64 frame_ns)
+{
+    uint64 us = (frame_ns > 0) ? (uint64)frame_ns / 1000 : 0;
+
+    uint32 Result = (uint32)us;
+    if(us >= TELEMETRY_SUB_BUCKET_COUNT)
+    {
+        // NOTE: us has its top bit at 'octave'; the next three bits pick
+        // one of the 8 sub-buckets of that power of two.
+        uint32 octave = find_most_significant_set_bit(us);
+        Result = ((octave - 2)*TELEMETRY_SUB_BUCKET_COUNT +
+                  (uint32)((us >> (octave - 3)) - TELEMETRY_SUB_BUCKET_COUNT));
+    }
+
+    if(Result >= TELEMETRY_BUCKET_COUNT)
+    {
+        Result = TELEMETRY_BUCKET_COUNT - 1;
+    }
+
+    return(Result);
+}
+
+inline int64
+telemetry_bucket_upper_ns(uint32 index)
+{
+    int64 Result = (index + 1)*1000LL;
+    if(index >= TELEMETRY_SUB_BUCKET_COUNT)
+    {
+        uint32 octave = index / TELEMETRY_SUB_BUCKET_COUNT + 2;
+        uint32 sub_bucket = index % TELEMETRY_SUB_BUCKET_COUNT;
+        Result = ((int64)(TELEMETRY_SUB_BUCKET_COUNT + sub_bucket + 1) << (octave - 3))*1000LL;
+    }
+
+    return(Result);
+}
+
+// NOTE: A frame that ran over N target periods missed N deadlines, not
+// just one. Every platform counts them this way, which is also what
+// telemetry_summarize_recent counts from the raw frame times.
+inline uint64
+telemetry_missed_deadlines(int64 frame_ns, int64 target_frame_ns)
+{
+    uint64 Result = 0;
+    if(frame_ns > target_frame_ns)
+    {
+        Result = (uint64)((frame_ns - 1) / target_frame_ns);
+    }
+
+    return(Result);
+}
+
+internal void
+telemetry_record_frame(frame_telemetry *telemetry, int64 frame_ns, uint64 missed_deadlines)
+{
+    uint64 frame_index = telemetry->frame_count;
+    telemetry->ring[frame_index % TELEMETRY_RING_SIZE] = frame_ns;
+    ++telemetry->histogram[telemetry_bucket_index(frame_ns)];
+
+    telemetry->missed_deadline_count += missed_deadlines;
+    telemetry->total_frame_ns += frame_ns;
+    if(frame_ns > telemetry->max_frame_ns)
+    {
+        telemetry->max_frame_ns = frame_ns;
+    }
+
+    CompletePreviousWritesBeforeFutureWrites;
+    telemetry->frame_count = frame_index + 1;
+}
+
+internal void
+telemetry_record_audio(frame_telemetry *telemetry, int32 samples_per_second,
+                       int32 latency_sample_count, int32 delay_sample_count,
+                       audio_xrun_log *xruns)
+{
+    telemetry->audio_samples_per_second = samples_per_second;
+    telemetry->audio_latency_sample_count = latency_sample_count;
+    telemetry->audio_delay_sample_count = delay_sample_count;
+    telemetry->audio_xruns = xruns;
+}
+
+internal void
+telemetry_record_xrun(audio_xrun_log *log, audio_xrun_cause cause, int64 time_ns)
+{
+    uint32 event_index = log->event_count;
+    audio_xrun_event *event = log->events + (event_index % AUDIO_XRUN_LOG_SIZE);
+    event->time_ns = time_ns;
+    event->cause = cause;
+    log->cause_counts[cause] = log->cause_counts[cause] + 1;
+
+    CompletePreviousWritesBeforeFutureWrites;
+    log->event_count = event_index + 1;
+}
+
+// NOTE: The xruns the latency controller should back off from: the ones
+// where we were too slow. A suspend or a device error would happen at any
+// latency.
+internal uint32
+telemetry_underrun_count(audio_xrun_log *log)
+{
+    uint32 Result = (log->cause_counts[AudioXrunCause_late_frame] +
+                     log->cause_counts[AudioXrunCause_device_underrun]);
+
+    return(Result);
+}
+
+// NOTE: Whole-session numbers, percentiles from the histogram (each one is
+// the upper edge of the bucket it falls in, but never more than the max).
+internal telemetry_summary
+telemetry_summarize(frame_telemetry *telemetry)
+{
+    telemetry_summary Result = {};
+
+    Result.frame_count = telemetry->frame_count;
+    CompletePreviousReadsBeforeFutureReads;
+    Result.missed_deadline_count = telemetry->missed_deadline_count;
+    Result.max_frame_ns = telemetry->max_frame_ns;
+    if(Result.frame_count)
+    {
+        Result.mean_frame_ns = telemetry->total_frame_ns / (int64)Result.frame_count;
+
+        uint64 p50_rank = (Result.frame_count*50 + 99) / 100;
+        uint64 p95_rank = (Result.frame_count*95 + 99) / 100;
+        uint64 p99_rank = (Result.frame_count*99 + 99) / 100;
+        uint64 seen = 0;
+        for(uint32 bucket_index = 0;
+            bucket_index < TELEMETRY_BUCKET_COUNT;
+            ++bucket_index)
+        {
+            uint64 previous_seen = seen;
+            seen += telemetry->histogram[bucket_index];
+            int64 upper_ns = telemetry_bucket_upper_ns(bucket_index);
+            if((previous_seen < p50_rank) && (seen >= p50_rank)) {Result.p50_frame_ns = upper_ns;}
+            if((previous_seen < p95_rank) && (seen >= p95_rank)) {Result.p95_frame_ns = upper_ns;}
+            if((previous_seen < p99_rank) && (seen >= p99_rank)) {Result.p99_frame_ns = upper_ns;}
+        }
+
+        // NOTE: The top bucket's edge can be past every frame there was.
+        if(Result.p50_frame_ns > Result.max_frame_ns) {Result.p50_frame_ns = Result.max_frame_ns;}
+        if(Result.p95_frame_ns > Result.max_frame_ns) {Result.p95_frame_ns = Result.max_frame_ns;}
+        if(Result.p99_frame_ns > Result.max_frame_ns) {Result.p99_frame_ns = Result.max_frame_ns;}
+    }
+
+    return(Result);
+}
+
+// NOTE: Exact numbers over the frames still in the ring.
+internal telemetry_summary
+telemetry_summarize_recent(frame_telemetry *telemetry)
+{
+    telemetry_summary Result = {};
+
+    int64 frames[TELEMETRY_RING_SIZE];
+    uint64 end = telemetry->frame_count;
+    CompletePreviousReadsBeforeFutureReads;
+    uint64 begin = (end > TELEMETRY_RING_SIZE) ? (end - TELEMETRY_RING_SIZE) : 0;
+    for(uint64 frame_index = begin;
+        frame_index < end;
+        ++frame_index)
+    {
+        frames[frame_index - begin] = telemetry->ring[frame_index % TELEMETRY_RING_SIZE];
+    }
+
+    // NOTE: Whatever the recording thread wrote since we read 'end' may
+    // have overwritten the oldest entries we copied, so drop those.
+    CompletePreviousReadsBeforeFutureReads;
+    uint64 new_end = telemetry->frame_count;
+    uint64 overwritten = (new_end > end) ? (new_end - end) : 0;
+    int64 *first = frames;
+    uint64 count = end - begin;
+    if(begin + TELEMETRY_RING_SIZE < end + overwritten)
+    {
+        uint64 skip = (end + overwritten) - (begin + TELEMETRY_RING_SIZE);
+        skip = (skip > count) ? count : skip;
+        first += skip;
+        count -= skip;
+    }
+
+    Result.frame_count = count;
+    if(count)
+    {
+        int64 total_ns = 0;
+        for(uint64 index = 0;
+            index < count;
+            ++index)
+        {
+            // NOTE: Insertion sort, only ever run on demand over 1k frames.
+            int64 frame_ns = first[index];
+            total_ns += frame_ns;
+            Result.missed_deadline_count += telemetry_missed_deadlines(frame_ns,
+                                                                       telemetry->target_frame_ns);
+
+            uint64 insert = index;
+            while(insert && (first[insert - 1] > frame_ns))
+            {
+                first[insert] = first[insert - 1];
+                --insert;
+            }
+            first[insert] = frame_ns;
+        }
+
+        Result.mean_frame_ns = total_ns / (int64)count;
+        Result.p50_frame_ns = first[((count*50 + 99) / 100) - 1];
+        Result.p95_frame_ns = first[((count*95 + 99) / 100) - 1];
+        Result.p99_frame_ns = first[((count*99 + 99) / 100) - 1];
+        Result.max_frame_ns = first[count - 1];
+    }
+
+    return(Result);
+}
+
+internal int
+telemetry_format_summary(char *buffer, memory_index size, char const *label,
+                         telemetry_summary summary)
+{
+    return(snprintf(buffer, size,
+                    "%s: %llu frames, %llu missed, mean %.3fms, "
+                    "p50 %.3fms, p95 %.3fms, p99 %.3fms, max %.3fms\n",
+                    label,
+                    (unsigned long long)summary.frame_count,
+                    (unsigned long long)summary.missed_deadline_count,
+                    summary.mean_frame_ns / 1000000.0,
+                    summary.p50_frame_ns / 1000000.0,
+                    summary.p95_frame_ns / 1000000.0,
+                    summary.p99_frame_ns / 1000000.0,
+                    summary.max_frame_ns / 1000000.0));
+}
+
+global_variable char const *audio_xrun_cause_names[AudioXrunCause_count] =
+{
+    "late frame",
+    "device underrun",
+    "suspend",
+    "device error",
+};
+
+#define TELEMETRY_REPORTED_XRUN_COUNT 4
+
+// NOTE: The counts by cause, then the last few xruns, each with the time it
+// happened on the platform's clock.
+internal int
+telemetry_format_xruns(audio_xrun_log *log, char *buffer, memory_index size)
+{
+    uint32 end = log->event_count;
+    CompletePreviousReadsBeforeFutureReads;
+    uint32 begin = 0;
+    if(end > TELEMETRY_REPORTED_XRUN_COUNT)
+    {
+        begin = end - TELEMETRY_REPORTED_XRUN_COUNT;
+    }
+    audio_xrun_event events[TELEMETRY_REPORTED_XRUN_COUNT];
+    for(uint32 event_index = begin;
+        event_index < end;
+        ++event_index)
+    {
+        events[event_index - begin] = log->events[event_index % AUDIO_XRUN_LOG_SIZE];
+    }
+
+    // NOTE: Same as the frame ring: drop what got overwritten while we copied.
+    CompletePreviousReadsBeforeFutureReads;
+    uint32 new_end = log->event_count;
+    uint32 valid_begin = begin;
+    if(new_end - begin > AUDIO_XRUN_LOG_SIZE)
+    {
+        valid_begin = new_end - AUDIO_XRUN_LOG_SIZE;
+        valid_begin = (valid_begin > end) ? end : valid_begin;
+    }
+
+    int used = snprintf(buffer, size, "audio xruns: %u late frame, %u device underrun, "
+                        "%u suspend, %u device error\n",
+                        log->cause_counts[AudioXrunCause_late_frame],
+                        log->cause_counts[AudioXrunCause_device_underrun],
+                        log->cause_counts[AudioXrunCause_suspend],
+                        log->cause_counts[AudioXrunCause_device_error]);
+    for(uint32 event_index = valid_begin;
+        (event_index < end) && (used > 0) && ((memory_index)used < size);
+        ++event_index)
+    {
+        audio_xrun_event event = events[event_index - begin];
+        char const *cause_name = ((event.cause < AudioXrunCause_count) ?
+                                  audio_xrun_cause_names[event.cause] : "?");
+        used += snprintf(buffer + used, size - used, "  xrun %u: %s at %.3fs\n",
+                         event_index + 1, cause_name, event.time_ns / 1000000000.0);
+    }
+
+    return(used);
+}
+
+internal void
+telemetry_format_report(frame_telemetry *telemetry, char *buffer, memory_index size)
+{
+    int used = telemetry_format_summary(buffer, size, "session",
+                                        telemetry_summarize(telemetry));
+    if((used > 0) && ((memory_index)used < size))
+    {
+        used += telemetry_format_summary(buffer + used, size - used, "recent",
+                                         telemetry_summarize_recent(telemetry));
+    }
+
+    int32 samples_per_second = telemetry->audio_samples_per_second;
+    audio_xrun_log *xruns = telemetry->audio_xruns;
+    if(samples_per_second && (used > 0) && ((memory_index)used < size))
+    {
+        real64 ms_per_sample = 1000.0 / (real64)samples_per_second;
+        used += snprintf(buffer + used, size - used,
+                         "audio: latency %.1fms (%d samples), delay %.1fms\n",
+                         telemetry->audio_latency_sample_count*ms_per_sample,
+                         telemetry->audio_latency_sample_count,
+                         telemetry->audio_delay_sample_count*ms_per_sample);
+    }
+    if(xruns && (used > 0) && ((memory_index)used < size))
+    {
+        telemetry_format_xruns(xruns, buffer + used, size - used);
+    }
+}
@@ -0,0 +1,90 @@
+#if !defined(HANDMADE_TELEMETRY_H)
+
+/* NOTE:
+
+   Always-on frame timing, fed once per frame by the platform layer.
+
+   1) Recording is a handful of stores: the frame time goes into a ring of
+      the most recent frames and bumps one bucket of a log-scale histogram
+      that covers the whole session.
+
+   2) Only the frame thread records. Reports may be taken from any thread;
+      they read the ring without locking and throw away whatever got
+      overwritten while they were copying it.
+
+   3) Histogram buckets are 1us wide below 8us, and then every power of two
+      is split into 8 buckets, so percentiles are exact to within 12.5%.
+
+   4) The platform also reports where its audio latency controller has
+      settled, once per frame, so the report shows it next to the frames.
+
+   5) Every xrun the platform sees goes into an audio_xrun_log with its
+      cause and the time it happened: a late frame (the game did not top
+      the sound up in time) is our fault and something to fix, a suspend
+      is the device's and not. One thread records into a log, any thread
+      may read it, the same way as the frame ring.
+*/
+
+#define TELEMETRY_RING_SIZE 1024
+#define TELEMETRY_SUB_BUCKET_COUNT 8
+#define TELEMETRY_BUCKET_COUNT (TELEMETRY_SUB_BUCKET_COUNT*24)
+
+enum audio_xrun_cause
+{
+    AudioXrunCause_late_frame,
+    AudioXrunCause_device_underrun,
+    AudioXrunCause_suspend,
+    AudioXrunCause_device_error,
+
+    AudioXrunCause_count,
+};
+
+#define AUDIO_XRUN_LOG_SIZE 64
+
+struct audio_xrun_event
+{
+    int64 time_ns;
+    uint32 cause;
+};
+
+struct audio_xrun_log
+{
+    // NOTE: event_count is also the ring's write index.
+    uint32 volatile event_count;
+    uint32 volatile cause_counts[AudioXrunCause_count];
+    audio_xrun_event events[AUDIO_XRUN_LOG_SIZE];
+};
+
+struct frame_telemetry
+{
+    int64 target_frame_ns;
+
+    // NOTE: frame_count is also the ring's write index.
+    uint64 volatile frame_count;
+    uint64 missed_deadline_count;
+    int64 max_frame_ns;
+    int64 total_frame_ns;
+
+    uint32 histogram[TELEMETRY_BUCKET_COUNT];
+    int64 ring[TELEMETRY_RING_SIZE];
+
+    // NOTE: Zero samples_per_second means the platform has no sound.
+    int32 audio_samples_per_second;
+    int32 audio_latency_sample_count;
+    int32 audio_delay_sample_count;
+    audio_xrun_log *audio_xruns;
+};
+
+struct telemetry_summary
+{
+    uint64 frame_count;
+    uint64 missed_deadline_count;
+    int64 mean_frame_ns;
+    int64 p50_frame_ns;
+    int64 p95_frame_ns;
+    int64 p99_frame_ns;
+    int64 max_frame_ns;
+};
+
+#define HANDMADE_TELEMETRY_H
+#endif
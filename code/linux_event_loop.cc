@@ -0,0 +1,111 @@
+/*
+ * One epoll set per thread that waits on more than one thing: the main thread's X connection and
+ * frame timer, the sound thread's PCM descriptors and its stop request. Each registered fd
+ * carries a tag, and an index for sources like ALSA that hand out several descriptors; callers
+ * switch on the tag, so whatever is ready gets serviced straight from the loop that owns it.
+ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define LINUX_MAX_READY_EVENT_COUNT 16
+
+/* the clock every thread times its waits and timestamps its events on */
+static int64
+linux_get_monotonic_ns (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+struct linux_event_loop
+{
+    int epoll_fd;
+    int ready_count;
+    struct epoll_event ready[LINUX_MAX_READY_EVENT_COUNT];
+};
+
+static bool
+linux_init_event_loop (linux_event_loop * loop)
+{
+    loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    loop->ready_count = 0;
+    if (loop->epoll_fd < 0) {
+        fprintf (stderr, "epoll_create1 failed: %s\n", strerror (errno));
+        return false;
+    }
+    return true;
+}
+
+static void
+linux_free_event_loop (linux_event_loop * loop)
+{
+    if (loop->epoll_fd >= 0) {
+        close (loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+/* level triggered, so anything left unread simply shows up again on the next wait */
+static bool
+linux_add_event_fd (linux_event_loop * loop, int fd, uint32 events, uint32 tag, uint32 index)
+{
+    struct epoll_event event = { };
+    event.events = events;
+    event.data.u64 = ((uint64) tag << 32) | index;
+    if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        fprintf (stderr, "epoll_ctl failed for fd %d: %s\n", fd, strerror (errno));
+        return false;
+    }
+    return true;
+}
+
+/* events of 0 keeps the fd in the set but stops it from waking us */
+static bool
+linux_modify_event_fd (linux_event_loop * loop, int fd, uint32 events, uint32 tag, uint32 index)
+{
+    struct epoll_event event = { };
+    event.events = events;
+    event.data.u64 = ((uint64) tag << 32) | index;
+    if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        fprintf (stderr, "epoll_ctl failed for fd %d: %s\n", fd, strerror (errno));
+        return false;
+    }
+    return true;
+}
+
+static bool
+linux_remove_event_fd (linux_event_loop * loop, int fd)
+{
+    if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_DEL, fd, 0) < 0) {
+        fprintf (stderr, "epoll_ctl failed for fd %d: %s\n", fd, strerror (errno));
+        return false;
+    }
+    return true;
+}
+
+/* blocks for up to timeout_ms (-1 forever, 0 not at all), returns how many fds are ready, or -1
+   on an error other than an interrupted wait */
+static int
+linux_wait_for_events (linux_event_loop * loop, int timeout_ms)
+{
+    int count = epoll_wait (loop->epoll_fd, loop->ready, LINUX_MAX_READY_EVENT_COUNT, timeout_ms);
+    if (count < 0) {
+        count = (errno == EINTR) ? 0 : -1;
+    }
+    loop->ready_count = (count > 0) ? count : 0;
+    return count;
+}
+
+static uint32
+linux_event_tag (struct epoll_event *event)
+{
+    return (uint32) (event->data.u64 >> 32);
+}
+
+static uint32
+linux_event_index (struct epoll_event *event)
+{
+    return (uint32) event->data.u64;
+}
@@ -0,0 +1,62 @@
+/*
+ * Linux implementation of the file mapping services declared in handmade.h. Files are mapped
+ * read-only and nothing is read when they are: the pages come from the page cache as they are
+ * touched, and linux_prefetch_file only starts the reads for a range, it never waits on them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* a file that is not there is not an error, the game just goes without it */
+static platform_mapped_file
+linux_map_file (char const *file_name)
+{
+    platform_mapped_file file = { };
+    int fd = open (file_name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return file;
+    }
+
+    struct stat status;
+    if (fstat (fd, &status) == 0 && status.st_size > 0) {
+        void *contents = mmap (0, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (contents != MAP_FAILED) {
+            file.contents = contents;
+            file.size = status.st_size;
+        }
+    }
+    if (!file.contents) {
+        fprintf (stderr, "could not map '%s': %s\n", file_name, strerror (errno));
+    }
+
+    /* the mapping keeps its own reference to the file */
+    close (fd);
+    return file;
+}
+
+static void
+linux_unmap_file (platform_mapped_file * file)
+{
+    if (file->contents) {
+        munmap (file->contents, file->size);
+    }
+    file->contents = 0;
+    file->size = 0;
+}
+
+/* MADV_WILLNEED on a file mapping queues readahead for the range and returns */
+static void
+linux_prefetch_file (platform_mapped_file * file, uint64 offset, uint64 size)
+{
+    if (file->contents && offset < file->size) {
+        size = (size > file->size - offset) ? file->size - offset : size;
+        uint64 page_size = (uint64) sysconf (_SC_PAGESIZE);
+        uint64 start = offset & ~(page_size - 1);
+        madvise ((uint8 *) file->contents + start, offset + size - start, MADV_WILLNEED);
+    }
+}
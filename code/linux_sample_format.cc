@@ -0,0 +1,125 @@
+/*
+ * Conversion from the game's interleaved S16 samples to whatever sample format the sound device
+ * ended up with. One writer per format, specialized at compile time so the inner loop has no
+ * per-sample branches; the backend picks the writer once, when the format is negotiated.
+ *
+ * Writers take a count of values (frames * channels) and may assume nothing about alignment.
+ */
+
+#include <string.h>
+
+enum linux_sample_format
+{
+    LINUX_SAMPLE_S16_LE,
+    LINUX_SAMPLE_S24_3LE,
+    LINUX_SAMPLE_S32_LE,
+    LINUX_SAMPLE_FLOAT_LE,
+    LINUX_SAMPLE_U8,
+    LINUX_SAMPLE_FORMAT_COUNT
+};
+
+typedef void linux_sample_writer (void *dest, int16 * source, long value_count);
+
+template <linux_sample_format format> static void linux_write_samples (void *dest, int16 * source,
+                                                                       long value_count);
+
+template <> void
+linux_write_samples <LINUX_SAMPLE_S16_LE> (void *dest, int16 * source, long value_count)
+{
+    memcpy (dest, source, value_count * sizeof (int16));
+}
+
+/* the 16 bits go to the top of the 24: [0, low, high] */
+template <> void
+linux_write_samples <LINUX_SAMPLE_S24_3LE> (void *dest, int16 * source, long value_count)
+{
+    uint8 *out = (uint8 *) dest;
+    for (long index = 0; index < value_count; index++) {
+        uint16 value = (uint16) source[index];
+        out[0] = 0;
+        out[1] = (uint8) value;
+        out[2] = (uint8) (value >> 8);
+        out += 3;
+    }
+}
+
+template <> void
+linux_write_samples <LINUX_SAMPLE_S32_LE> (void *dest, int16 * source, long value_count)
+{
+    int32 *out = (int32 *) dest;
+    __m128i zero = _mm_setzero_si128 ();
+    long index = 0;
+    for (; index + 8 <= value_count; index += 8) {
+        __m128i value = _mm_loadu_si128 ((__m128i *) (source + index));
+        /* interleaving zeros below each value is the same as shifting it up by 16 */
+        _mm_storeu_si128 ((__m128i *) (out + index), _mm_unpacklo_epi16 (zero, value));
+        _mm_storeu_si128 ((__m128i *) (out + index + 4), _mm_unpackhi_epi16 (zero, value));
+    }
+    for (; index < value_count; index++) {
+        out[index] = (int32) ((uint32) (uint16) source[index] << 16);
+    }
+}
+
+template <> void
+linux_write_samples <LINUX_SAMPLE_FLOAT_LE> (void *dest, int16 * source, long value_count)
+{
+    real32 *out = (real32 *) dest;
+    __m128 scale = _mm_set1_ps (1.0f / 32768.0f);
+    long index = 0;
+    for (; index + 8 <= value_count; index += 8) {
+        __m128i value = _mm_loadu_si128 ((__m128i *) (source + index));
+        /* sign-extend by putting each value in the top half and shifting it back down */
+        __m128i low = _mm_srai_epi32 (_mm_unpacklo_epi16 (value, value), 16);
+        __m128i high = _mm_srai_epi32 (_mm_unpackhi_epi16 (value, value), 16);
+        _mm_storeu_ps (out + index, _mm_mul_ps (_mm_cvtepi32_ps (low), scale));
+        _mm_storeu_ps (out + index + 4, _mm_mul_ps (_mm_cvtepi32_ps (high), scale));
+    }
+    for (; index < value_count; index++) {
+        out[index] = (real32) source[index] * (1.0f / 32768.0f);
+    }
+}
+
+template <> void
+linux_write_samples <LINUX_SAMPLE_U8> (void *dest, int16 * source, long value_count)
+{
+    uint8 *out = (uint8 *) dest;
+    __m128i bias = _mm_set1_epi8 ((char) 0x80);
+    long index = 0;
+    for (; index + 16 <= value_count; index += 16) {
+        __m128i low = _mm_srai_epi16 (_mm_loadu_si128 ((__m128i *) (source + index)), 8);
+        __m128i high = _mm_srai_epi16 (_mm_loadu_si128 ((__m128i *) (source + index + 8)), 8);
+        __m128i value = _mm_xor_si128 (_mm_packs_epi16 (low, high), bias);
+        _mm_storeu_si128 ((__m128i *) (out + index), value);
+    }
+    for (; index < value_count; index++) {
+        out[index] = (uint8) ((source[index] >> 8) + 128);
+    }
+}
+
+struct linux_sample_format_info
+{
+    const char *name;
+    int bytes_per_sample;
+    linux_sample_writer *write;
+};
+
+static linux_sample_format_info linux_sample_formats[LINUX_SAMPLE_FORMAT_COUNT] = {
+    {"S16_LE", 2, linux_write_samples <LINUX_SAMPLE_S16_LE>},
+    {"S24_3LE", 3, linux_write_samples <LINUX_SAMPLE_S24_3LE>},
+    {"S32_LE", 4, linux_write_samples <LINUX_SAMPLE_S32_LE>},
+    {"FLOAT_LE", 4, linux_write_samples <LINUX_SAMPLE_FLOAT_LE>},
+    {"U8", 1, linux_write_samples <LINUX_SAMPLE_U8>},
+};
+
+/* converts as many of frame_count frames as fit in a dest of dest_frame_count frames, and returns
+   how many that was. a transfer bigger than the device's own buffer goes over in pieces */
+static uint32
+linux_convert_frames (linux_sample_writer * write, void *dest, uint32 dest_frame_count,
+                      int16 * source, uint32 frame_count, unsigned int channel_count)
+{
+    if (frame_count > dest_frame_count) {
+        frame_count = dest_frame_count;
+    }
+    write (dest, source, (long) frame_count * channel_count);
+    return frame_count;
+}
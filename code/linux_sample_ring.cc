@@ -0,0 +1,125 @@
+/*
+ * Lock-free single-producer/single-consumer ring of interleaved S16 frames, between the game
+ * thread that synthesizes sound and the audio thread that feeds the device.
+ *
+ * Only the producer writes write_count and only the consumer read_count. Both count frames and
+ * are free running, so filled = write_count - read_count even across the 32-bit wrap, and the
+ * capacity is a power of two so a count maps to a slot with a mask. The contents are published
+ * by the barrier before the count is stored, the same way the work queue publishes its entries.
+ *
+ * Either side asks for up to two contiguous regions (the second one when the ring wraps), fills
+ * or drains them in place, then commits how many frames it actually used.
+ */
+
+struct linux_sample_ring
+{
+    int16 *samples;
+    uint32 capacity;               /* in frames, power of two */
+    uint32 channel_count;
+
+    uint32 volatile write_count;
+    uint32 volatile read_count;
+};
+
+struct linux_sample_ring_region
+{
+    int16 *samples;
+    uint32 frame_count;
+};
+
+/* the capacity is rounded up to a power of two */
+static bool
+linux_init_sample_ring (linux_sample_ring * ring, uint32 min_capacity, uint32 channel_count)
+{
+    uint32 capacity = 1;
+    while (capacity < min_capacity) {
+        capacity *= 2;
+    }
+
+    ring->samples = (int16 *) calloc (capacity * channel_count, sizeof (int16));
+    ring->capacity = capacity;
+    ring->channel_count = channel_count;
+    ring->write_count = 0;
+    ring->read_count = 0;
+
+    return ring->samples != NULL;
+}
+
+static void
+linux_free_sample_ring (linux_sample_ring * ring)
+{
+    free (ring->samples);
+    ring->samples = 0;
+}
+
+/* a snapshot: from the producer it can only grow, from the consumer it can only shrink */
+static uint32
+linux_sample_ring_filled (linux_sample_ring * ring)
+{
+    return ring->write_count - ring->read_count;
+}
+
+/* splits frame_count frames starting at count into the part before the end of the ring and the
+   part that wraps to the start, returns how many regions were used */
+static int
+linux_get_sample_ring_regions (linux_sample_ring * ring, uint32 count, uint32 frame_count,
+                               linux_sample_ring_region * regions)
+{
+    /* the split is the game's own, which counts in stereo frames */
+    Assert (ring->channel_count == 2);
+    audio_ring_regions split = get_audio_ring_regions (ring->samples, ring->capacity,
+                                                       count & (ring->capacity - 1), frame_count);
+
+    int region_count = 0;
+    for (int split_index = 0; split_index < 2; split_index++) {
+        if (split.sample_count[split_index]) {
+            regions[region_count].samples = split.samples[split_index];
+            regions[region_count].frame_count = split.sample_count[split_index];
+            region_count++;
+        }
+    }
+
+    return region_count;
+}
+
+/* producer: up to frame_count free frames, clamped to the free space */
+static int
+linux_begin_sample_ring_write (linux_sample_ring * ring, uint32 frame_count,
+                               linux_sample_ring_region * regions)
+{
+    uint32 write_count = ring->write_count;
+    uint32 free_count = ring->capacity - (write_count - ring->read_count);
+    if (frame_count > free_count) {
+        frame_count = free_count;
+    }
+    return linux_get_sample_ring_regions (ring, write_count, frame_count, regions);
+}
+
+static void
+linux_end_sample_ring_write (linux_sample_ring * ring, uint32 frame_count)
+{
+    CompletePreviousWritesBeforeFutureWrites;
+    ring->write_count = ring->write_count + frame_count;
+}
+
+/* consumer: up to frame_count queued frames, clamped to what has been published */
+static int
+linux_begin_sample_ring_read (linux_sample_ring * ring, uint32 frame_count,
+                              linux_sample_ring_region * regions)
+{
+    uint32 read_count = ring->read_count;
+    uint32 filled = ring->write_count - read_count;
+    CompletePreviousReadsBeforeFutureReads;
+    if (frame_count > filled) {
+        frame_count = filled;
+    }
+    return linux_get_sample_ring_regions (ring, read_count, frame_count, regions);
+}
+
+static void
+linux_end_sample_ring_read (linux_sample_ring * ring, uint32 frame_count)
+{
+    /* done reading the slots before the producer may reuse them */
+    CompletePreviousReadsBeforeFutureReads;
+    ring->read_count = ring->read_count + frame_count;
+}
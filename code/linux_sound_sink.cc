@@ -0,0 +1,196 @@
+/*
+ * Sound sinks that are not a sound card, so the whole sound path runs on machines without one.
+ * HANDMADE_SOUND_DEVICE picks them by name instead of an ALSA device:
+ *
+ *   null            takes whatever it is given, as fast as it comes: for measuring generation
+ *   null:realtime   takes frames at the stream rate, like a device would
+ *   wav:<path>      records what it is given to a 16-bit PCM WAV file, at the stream rate
+ *
+ * A paced sink keeps LINUX_SINK_LEAD_PERIODS periods queued ahead of the time it has been
+ * running, the way the sound thread keeps the device buffer; everything here takes the time
+ * as a parameter, so it can be driven from a simulated clock too.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define LINUX_SINK_LEAD_PERIODS 2
+#define LINUX_WAV_HEADER_SIZE 44
+
+enum linux_sound_sink_type
+{
+    LINUX_SOUND_SINK_ALSA,
+    LINUX_SOUND_SINK_NULL,
+    LINUX_SOUND_SINK_WAV,
+};
+
+struct linux_sound_sink
+{
+    linux_sound_sink_type type;
+    bool paced;                    /* takes frames at samples_per_second, not as fast as it can */
+    const char *path;              /* wav only */
+
+    unsigned int samples_per_second;
+    unsigned int channel_count;
+    uint32 period_size;
+    int fd;
+
+    uint64 frame_count;            /* every frame taken so far */
+    int64 start_ns;                /* when the first one was, paced sinks only */
+};
+
+/* false for anything that names an ALSA device */
+static bool
+linux_parse_sound_sink (linux_sound_sink * sink, const char *device)
+{
+    sink->type = LINUX_SOUND_SINK_ALSA;
+    sink->paced = true;
+    sink->path = 0;
+    sink->fd = -1;
+    if (strcmp (device, "null") == 0) {
+        sink->type = LINUX_SOUND_SINK_NULL;
+        sink->paced = false;
+    }
+    else if (strcmp (device, "null:realtime") == 0) {
+        sink->type = LINUX_SOUND_SINK_NULL;
+    }
+    else if (strncmp (device, "wav:", 4) == 0 && device[4]) {
+        sink->type = LINUX_SOUND_SINK_WAV;
+        sink->path = device + 4;
+    }
+    return sink->type != LINUX_SOUND_SINK_ALSA;
+}
+
+static void
+linux_put_le (uint8 * dest, uint32 value, int byte_count)
+{
+    for (int byte_index = 0; byte_index < byte_count; byte_index++) {
+        dest[byte_index] = (uint8) (value >> (8 * byte_index));
+    }
+}
+
+/* data_size is patched in on close; until then a reader sees an empty file, not a broken one */
+static void
+linux_make_wav_header (uint8 * header, unsigned int samples_per_second,
+                       unsigned int channel_count, uint32 data_size)
+{
+    uint32 block_align = channel_count * sizeof (int16);
+    memcpy (header, "RIFF", 4);
+    linux_put_le (header + 4, 36 + data_size, 4);
+    memcpy (header + 8, "WAVEfmt ", 8);
+    linux_put_le (header + 16, 16, 4);
+    linux_put_le (header + 20, 1, 2);   /* PCM */
+    linux_put_le (header + 22, channel_count, 2);
+    linux_put_le (header + 24, samples_per_second, 4);
+    linux_put_le (header + 28, samples_per_second * block_align, 4);
+    linux_put_le (header + 32, block_align, 2);
+    linux_put_le (header + 34, 16, 2);
+    memcpy (header + 36, "data", 4);
+    linux_put_le (header + 40, data_size, 4);
+}
+
+static bool
+linux_write_all (int fd, const void *data, size_t size)
+{
+    const uint8 *source = (const uint8 *) data;
+    while (size) {
+        ssize_t res = write (fd, source, size);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+        source += res;
+        size -= res;
+    }
+    return true;
+}
+
+static bool
+linux_open_sound_sink (linux_sound_sink * sink, unsigned int samples_per_second,
+                       unsigned int channel_count, uint32 period_size)
+{
+    sink->samples_per_second = samples_per_second;
+    sink->channel_count = channel_count;
+    sink->period_size = period_size;
+    sink->frame_count = 0;
+    sink->start_ns = 0;
+
+    if (sink->type == LINUX_SOUND_SINK_WAV) {
+        sink->fd = open (sink->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        uint8 header[LINUX_WAV_HEADER_SIZE];
+        linux_make_wav_header (header, samples_per_second, channel_count, 0);
+        if (sink->fd < 0 || !linux_write_all (sink->fd, header, sizeof (header))) {
+            fprintf (stderr, "could not write '%s': %s\n", sink->path, strerror (errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+linux_close_sound_sink (linux_sound_sink * sink)
+{
+    if (sink->fd >= 0) {
+        /* a WAV file tops out at 4GB; past that the sizes just say as much as fits */
+        uint64 data_size = sink->frame_count * sink->channel_count * sizeof (int16);
+        if (data_size > 0xFFFFFFFF - 36) {
+            data_size = 0xFFFFFFFF - 36;
+        }
+        uint8 header[LINUX_WAV_HEADER_SIZE];
+        linux_make_wav_header (header, sink->samples_per_second, sink->channel_count,
+                               (uint32) data_size);
+        if (pwrite (sink->fd, header, sizeof (header), 0) != (ssize_t) sizeof (header)) {
+            fprintf (stderr, "could not finish '%s': %s\n", sink->path, strerror (errno));
+        }
+        close (sink->fd);
+        sink->fd = -1;
+    }
+}
+
+/* frames taken but not yet played, as far as a paced sink's clock goes */
+static uint64
+linux_get_sound_sink_delay (linux_sound_sink * sink, int64 now_ns)
+{
+    uint64 delay = 0;
+    if (sink->paced && sink->frame_count) {
+        /* whole seconds apart, so the product cannot overflow however long the sink runs */
+        uint64 elapsed_ns = (uint64) (now_ns - sink->start_ns);
+        uint64 played = (elapsed_ns / 1000000000LL) * sink->samples_per_second
+            + (elapsed_ns % 1000000000LL) * sink->samples_per_second / 1000000000LL;
+        delay = (sink->frame_count > played) ? sink->frame_count - played : 0;
+    }
+    return delay;
+}
+
+/* how many frames the sink takes right now, at most max_frame_count */
+static uint32
+linux_get_sound_sink_room (linux_sound_sink * sink, int64 now_ns, uint32 max_frame_count)
+{
+    uint32 room = max_frame_count;
+    if (sink->paced) {
+        uint64 lead = LINUX_SINK_LEAD_PERIODS * sink->period_size;
+        uint64 delay = linux_get_sound_sink_delay (sink, now_ns);
+        room = (delay < lead) ? (uint32) (lead - delay) : 0;
+        room = (room > max_frame_count) ? max_frame_count : room;
+    }
+    return room;
+}
+
+/* returns how many frames it took, or a negative error */
+static int64
+linux_write_sound_sink (linux_sound_sink * sink, int16 * samples, uint32 frame_count,
+                        int64 now_ns)
+{
+    if (frame_count && !sink->frame_count) {
+        sink->start_ns = now_ns;
+    }
+    size_t size = frame_count * sink->channel_count * sizeof (int16);
+    if (sink->type == LINUX_SOUND_SINK_WAV && !linux_write_all (sink->fd, samples, size)) {
+        return -errno;
+    }
+    sink->frame_count += frame_count;
+    return frame_count;
+}
@@ -0,0 +1,118 @@
+/*
+ * Linux implementation of the platform work queue declared in handmade.h: a fixed ring of
+ * entries filled by the main thread and drained by a pool of persistent pthreads.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+struct platform_work_queue_entry
+{
+    platform_work_queue_callback *callback;
+    void *data;
+};
+
+struct platform_work_queue
+{
+    uint32 volatile completion_goal;
+    uint32 volatile completion_count;
+
+    uint32 volatile next_entry_to_write;
+    uint32 volatile next_entry_to_read;
+    sem_t semaphore;
+
+    platform_work_queue_entry entries[512];
+};
+
+static void
+linux_add_entry (platform_work_queue * queue, platform_work_queue_callback * callback, void *data)
+{
+    /* only the main thread adds entries, so we do not need to interlock the write index */
+    uint32 new_next_entry_to_write = (queue->next_entry_to_write + 1) % ArrayCount (queue->entries);
+    Assert (new_next_entry_to_write != queue->next_entry_to_read);
+    platform_work_queue_entry *entry = queue->entries + queue->next_entry_to_write;
+    entry->callback = callback;
+    entry->data = data;
+    ++queue->completion_goal;
+    __sync_synchronize ();        /* publish the entry before the index */
+    queue->next_entry_to_write = new_next_entry_to_write;
+    sem_post (&queue->semaphore);
+}
+
+static bool
+linux_do_next_work_queue_entry (platform_work_queue * queue)
+{
+    bool we_should_sleep = false;
+
+    uint32 original_next_entry_to_read = queue->next_entry_to_read;
+    uint32 new_next_entry_to_read = (original_next_entry_to_read + 1) % ArrayCount (queue->entries);
+    if (original_next_entry_to_read != queue->next_entry_to_write) {
+        uint32 index = __sync_val_compare_and_swap (&queue->next_entry_to_read,
+                                                    original_next_entry_to_read,
+                                                    new_next_entry_to_read);
+        if (index == original_next_entry_to_read) {
+            platform_work_queue_entry entry = queue->entries[index];
+            entry.callback (queue, entry.data);
+            __sync_fetch_and_add (&queue->completion_count, 1);
+        }
+    }
+    else {
+        we_should_sleep = true;
+    }
+
+    return we_should_sleep;
+}
+
+/* the barrier: the calling thread helps out until every queued entry has completed */
+static void
+linux_complete_all_work (platform_work_queue * queue)
+{
+    while (queue->completion_goal != queue->completion_count) {
+        linux_do_next_work_queue_entry (queue);
+    }
+
+    queue->completion_goal = 0;
+    queue->completion_count = 0;
+}
+
+static void *
+linux_work_queue_thread_proc (void *parameter)
+{
+    platform_work_queue *queue = (platform_work_queue *) parameter;
+
+    for (;;) {
+        if (linux_do_next_work_queue_entry (queue)) {
+            sem_wait (&queue->semaphore);
+        }
+    }
+
+    return 0;
+}
+
+static void
+linux_make_queue (platform_work_queue * queue, uint32 thread_count)
+{
+    queue->completion_goal = 0;
+    queue->completion_count = 0;
+    queue->next_entry_to_write = 0;
+    queue->next_entry_to_read = 0;
+    sem_init (&queue->semaphore, 0, 0);
+
+    for (uint32 thread_index = 0; thread_index < thread_count; ++thread_index) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init (&attr);
+        pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+        pthread_create (&thread, &attr, linux_work_queue_thread_proc, queue);
+        pthread_attr_destroy (&attr);
+    }
+}
+
+/* one worker per core besides the main thread, which joins in at the barrier */
+static uint32
+linux_get_worker_thread_count (void)
+{
+    long core_count = sysconf (_SC_NPROCESSORS_ONLN);
+    return (core_count > 1) ? (uint32) (core_count - 1) : 0;
+}
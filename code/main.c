@@ -2,14 +2,28 @@
 #include <X11/Xutil.h>
 #include <X11/Xresource.h>
 #include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
 
 #include <stdio.h>
 #include <stdlib.h>                /* getenv(), etc. */
 #include <unistd.h>                /* sleep(), etc.  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "handmade.h"
+#include "handmade.cc"
+#include "linux_work_queue.cc"
+#include "linux_mapped_file.cc"
+#include "linux_event_loop.cc"
+#include "alsa.c"
 
 // http://stackoverflow.com/questions/8592292/how-to-quit-the-blocking-of-xlibs-xnextevent
 
@@ -18,37 +32,6 @@
  */
 #include "icon.bmp"
 
-#ifndef timeradd
-#define timeradd(_a, _b, _res)              \
-      do {                          \
-              (_res)->tv_usec = (_a)->tv_usec + (_b)->tv_usec;  \
-              (_res)->tv_sec = (_a)->tv_sec + (_b)->tv_sec; \
-              if ((_res)->tv_usec >= 1000000)           \
-                {                           \
-                            (_res)->tv_usec -= 1000000;         \
-                            (_res)->tv_sec++;               \
-                          }                         \
-            } while (0)
-#endif
-
-#ifndef timersub
-#define timersub(_a, _b, _res)              \
-      do {                          \
-              (_res)->tv_usec = (_a)->tv_usec - (_b)->tv_usec;  \
-              (_res)->tv_sec = (_a)->tv_sec - (_b)->tv_sec; \
-              if ((_res)->tv_usec < 0) {                \
-                        (_res)->tv_usec += 1000000;         \
-                        (_res)->tv_sec--;                   \
-                      }                         \
-            } while (0)
-#endif
-
-void
-show_timeval (const char *str, struct timeval *tv)
-{
-    fprintf (stdout, "%s: %ld.%06ld\n", str, tv->tv_sec, tv->tv_usec);
-}
-
 int
 set_window_hints (Display * display, Window win)
 {
@@ -167,213 +150,695 @@ create_context (Display * display, Window win)
     return context;
 }
 
-static XImage *
-create_image (Display * display, Visual * visual, uint8_t * image, int width, int height,
-              int x_offset, int y_offset)
+/*
+ * The Linux counterpart of win32_offscreen_buffer: one buffer that lives across frames and is
+ * only reallocated when ConfigureNotify reports a new window size.
+ *
+ * With MIT-SHM the pixels live in a SysV shared memory segment that the X server maps as well,
+ * so the game renders straight into what the server reads and a present is a single small
+ * request. Without it (remote display, Xvfb without SHM) the pixels live in an anonymous
+ * mapping wrapped by a plain XImage and go out with XPutImage.
+ */
+struct linux_offscreen_buffer
+{
+    XImage *image;
+    bool use_shm;
+    XShmSegmentInfo shm_info;
+    int shm_completion_type;
+    bool present_pending;        /* the server may still be reading the segment */
+    bool lost_contents;
+    void *memory;
+    memory_index memory_size;
+    int width;
+    int height;
+    int pitch;
+};
+
+static bool shm_attach_failed;
+
+static int
+shm_attach_error_handler (Display * display, XErrorEvent * event)
+{
+    shm_attach_failed = true;
+    return 0;
+}
+
+static void
+linux_free_offscreen_buffer (Display * display, linux_offscreen_buffer * buffer)
+{
+    if (buffer->image) {
+        if (buffer->use_shm) {
+            XShmDetach (display, &buffer->shm_info);
+            XSync (display, False);
+            shmdt (buffer->shm_info.shmaddr);
+        }
+        else {
+            munmap (buffer->memory, buffer->memory_size);
+        }
+        buffer->image->data = 0;    /* the pixels are not XDestroyImage's to free */
+        XDestroyImage (buffer->image);
+        buffer->image = 0;
+        buffer->memory = 0;
+    }
+}
+
+static bool
+linux_create_shm_image (Display * display, Visual * visual, linux_offscreen_buffer * buffer,
+                        int width, int height)
+{
+    XImage *image = XShmCreateImage (display, visual, 24, ZPixmap, 0, &buffer->shm_info, width,
+                                     height);
+    if (!image) {
+        return false;
+    }
+
+    buffer->shm_info.shmid = shmget (IPC_PRIVATE, image->bytes_per_line * image->height,
+                                     IPC_CREAT | 0600);
+    if (buffer->shm_info.shmid < 0) {
+        XDestroyImage (image);
+        return false;
+    }
+    buffer->shm_info.shmaddr = image->data = (char *) shmat (buffer->shm_info.shmid, 0, 0);
+    buffer->shm_info.readOnly = False;
+
+    /* mark the segment for removal now, it goes away once both we and the server detached */
+    shmctl (buffer->shm_info.shmid, IPC_RMID, 0);
+
+    /* the server attaches by id, so it must not be told about a segment we could not map */
+    if (buffer->shm_info.shmaddr == (char *) -1) {
+        image->data = 0;
+        XDestroyImage (image);
+        return false;
+    }
+
+    /* the extension can be present and still fail to attach, e.g. on a remote display, and we
+       only find out through an asynchronous X error. the error may also have come from another
+       request with the server attached after all, so detach it too, under the same handler */
+    shm_attach_failed = false;
+    XErrorHandler previous_handler = XSetErrorHandler (shm_attach_error_handler);
+    XShmAttach (display, &buffer->shm_info);
+    XSync (display, False);
+    bool attach_failed = shm_attach_failed;
+    if (attach_failed) {
+        XShmDetach (display, &buffer->shm_info);
+        XSync (display, False);
+    }
+    XSetErrorHandler (previous_handler);
+
+    if (attach_failed) {
+        shmdt (buffer->shm_info.shmaddr);
+        image->data = 0;
+        XDestroyImage (image);
+        return false;
+    }
+
+    buffer->image = image;
+    buffer->memory = image->data;
+    buffer->memory_size = image->bytes_per_line * image->height;
+    buffer->pitch = image->bytes_per_line;
+    return true;
+}
+
+static bool
+linux_create_mapped_image (Display * display, Visual * visual, linux_offscreen_buffer * buffer,
+                           int width, int height)
 {
     int bytes_per_pixel = 4;
-    uint32_t pitch = width * bytes_per_pixel;
-    uint32_t *buffer = (uint32_t *) calloc (width * height, bytes_per_pixel);
-    uint8_t *row = (uint8_t *) buffer;
-    for (int j = 0; j < height; j++) {
-        uint32_t *pixel = (uint32_t *) row;
-        for (int i = 0; i < width; i++) {
-            uint8_t blue = (i + x_offset);
-            uint8_t green = (j + y_offset);
-            *pixel++ = (green << 8) | blue;
+    buffer->pitch = width * bytes_per_pixel;
+    buffer->memory_size = buffer->pitch * height;
+    buffer->memory = mmap (0, buffer->memory_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer->memory == MAP_FAILED) {
+        buffer->memory = 0;
+        return false;
+    }
+
+    buffer->image = XCreateImage (display, visual, 24 /* depth */ ,
+                                  ZPixmap /* format */ , 0 /* offset */ ,
+                                  (char *) buffer->memory, width, height, 32 /* bitmap pad */ ,
+                                  buffer->pitch);
+    if (!buffer->image) {
+        munmap (buffer->memory, buffer->memory_size);
+        buffer->memory = 0;
+        return false;
+    }
+    return true;
+}
+
+static bool
+linux_resize_offscreen_buffer (Display * display, Visual * visual,
+                               linux_offscreen_buffer * buffer, int width, int height)
+{
+    linux_free_offscreen_buffer (display, buffer);
+
+    if (buffer->use_shm && !linux_create_shm_image (display, visual, buffer, width, height)) {
+        fprintf (stdout, "MIT-SHM attach failed, falling back to XPutImage\n");
+        buffer->use_shm = false;
+    }
+    if (!buffer->use_shm && !linux_create_mapped_image (display, visual, buffer, width, height)) {
+        fprintf (stderr, "could not allocate a %d by %d offscreen buffer\n", width, height);
+        return false;
+    }
+
+    buffer->width = width;
+    buffer->height = height;
+    buffer->present_pending = false;
+    buffer->lost_contents = true;
+    return true;
+}
+
+static Bool
+is_shm_completion (Display * display, XEvent * event, XPointer arg)
+{
+    return event->type == *(int *) arg;
+}
+
+/* we must not touch the segment while the server is still copying the last frame out of it */
+static void
+linux_wait_for_present (Display * display, linux_offscreen_buffer * buffer)
+{
+    if (buffer->present_pending) {
+        TIMED_FUNCTION ();
+        XEvent event;
+        XIfEvent (display, &event, is_shm_completion, (XPointer) & buffer->shm_completion_type);
+        buffer->present_pending = false;
+    }
+}
+
+static void
+linux_put_rect (Display * display, Window win, GC context, linux_offscreen_buffer * buffer,
+                int x, int y, int width, int height, bool send_event)
+{
+    if (buffer->use_shm) {
+        XShmPutImage (display, win, context, buffer->image, x, y, x, y, width, height,
+                      send_event);
+        buffer->present_pending |= send_event;
+    }
+    else {
+        XPutImage (display, win, context, buffer->image, x, y, x, y, width, height);
+    }
+}
+
+static void
+render_and_present (Display * display, Window win, GC context, game_memory * memory,
+                    linux_offscreen_buffer * buffer, int x_offset, int y_offset, bool present_all)
+{
+    if (!buffer->image) {
+        return;
+    }
+
+    linux_wait_for_present (display, buffer);
+
+    game_offscreen_buffer offscreen_buffer = { };
+    offscreen_buffer.memory = buffer->memory;
+    offscreen_buffer.width = buffer->width;
+    offscreen_buffer.height = buffer->height;
+    offscreen_buffer.pitch = buffer->pitch;
+    offscreen_buffer.lost_contents = buffer->lost_contents;
+    buffer->lost_contents = false;
+    game_update_render (memory, &offscreen_buffer, x_offset, y_offset);
+
+    TIMED_BLOCK ("present");
+    if (present_all) {
+        linux_put_rect (display, win, context, buffer, 0, 0, buffer->width, buffer->height, true);
+    }
+    else {
+        /* only send the regions the renderer reports as changed since the previous frame */
+        int rect_count = offscreen_buffer.dirty_rect_count;
+        for (int rect_index = 0; rect_index < rect_count; rect_index++) {
+            game_rect *rect = offscreen_buffer.dirty_rects + rect_index;
+            /* completions arrive in order, so only the last put needs to report back */
+            linux_put_rect (display, win, context, buffer, rect->min_x, rect->min_y,
+                            rect->max_x - rect->min_x, rect->max_y - rect->min_y,
+                            rect_index == rect_count - 1);
+        }
+    }
+    XFlush (display);
+}
+
+/*
+ * Frame pacing. Deadlines are absolute CLOCK_MONOTONIC times, so wall clock adjustments do not
+ * move them and rounding errors do not accumulate from frame to frame. Waiting is done in two
+ * steps: a timerfd armed for the deadline minus a calibrated margin wakes us up while we are
+ * also waiting on the X connection, and the last stretch is spent spinning on the clock.
+ *
+ * With HANDMADE_FRAME_CLOCK=audio the deadlines follow the sound device instead: every frame
+ * goes with a device frame position, one frame's worth of samples after the last, and the
+ * deadline is pulled towards the time the device will get there. Frames then come exactly as
+ * fast as the sound is played, so the two never drift apart however long the session runs.
+ */
+struct linux_frame_pacer
+{
+    int64 period_ns;
+    int64 frame_begin_ns;
+    int64 next_deadline_ns;
+    int64 spin_margin_ns;        /* how much earlier than the deadline the timer fires */
+    int timer_fd;
+
+    /* audio clock only */
+    linux_sound_output *audio_clock;
+    real64 frame_sample_count;   /* device frames per game frame */
+    real64 next_frame_position;  /* the device frame the next deadline belongs with */
+    bool audio_clock_locked;
+    uint32 audio_clock_resync_count;
+    int64 audio_clock_error_ns;  /* how far off the audio clock the last deadline was */
+};
+
+#if HANDMADE_PROFILE
+/* the TSC ticks at a constant rate on anything we care about, but nothing tells us which one, so
+   count how many ticks go by against CLOCK_MONOTONIC */
+static uint64
+linux_estimate_cpu_timer_frequency (void)
+{
+    int64 begin_ns = linux_get_monotonic_ns ();
+    uint64 begin_cycles = read_cpu_timer ();
+
+    struct timespec wait = { 0, 50 * 1000000 };
+    while (nanosleep (&wait, &wait) < 0 && errno == EINTR) {
+    }
+
+    uint64 end_cycles = read_cpu_timer ();
+    int64 end_ns = linux_get_monotonic_ns ();
+
+    return (uint64) ((real64) (end_cycles - begin_cycles) * 1e9 / (real64) (end_ns - begin_ns));
+}
+#endif
+
+static struct timespec
+linux_ns_to_timespec (int64 ns)
+{
+    struct timespec result;
+    result.tv_sec = ns / 1000000000LL;
+    result.tv_nsec = ns % 1000000000LL;
+    return result;
+}
+
+/* measure how late the kernel wakes us from an absolute sleep and keep the worst case (plus
+   some slack) as the margin we spin away instead of sleeping */
+static int64
+linux_calibrate_spin_margin (void)
+{
+    int64 worst_oversleep_ns = 0;
+    for (int sample_index = 0; sample_index < 32; sample_index++) {
+        int64 deadline_ns = linux_get_monotonic_ns () + 500000;
+        struct timespec deadline = linux_ns_to_timespec (deadline_ns);
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR) {
+        }
+        int64 oversleep_ns = linux_get_monotonic_ns () - deadline_ns;
+        if (oversleep_ns > worst_oversleep_ns) {
+            worst_oversleep_ns = oversleep_ns;
+        }
+    }
+
+    int64 margin_ns = worst_oversleep_ns + worst_oversleep_ns / 2 + 20000;
+    if (margin_ns < 50000) {
+        margin_ns = 50000;
+    }
+    if (margin_ns > 2000000) {
+        margin_ns = 2000000;
+    }
+    return margin_ns;
+}
+
+static void
+linux_arm_frame_timer (linux_frame_pacer * pacer)
+{
+    struct itimerspec timer = { };
+    timer.it_value = linux_ns_to_timespec (pacer->next_deadline_ns - pacer->spin_margin_ns);
+    timerfd_settime (pacer->timer_fd, TFD_TIMER_ABSTIME, &timer, 0);
+}
+
+static bool
+linux_init_frame_pacer (linux_frame_pacer * pacer, int frequency)
+{
+    pacer->timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (pacer->timer_fd < 0) {
+        fprintf (stderr, "timerfd_create - %s\n", strerror (errno));
+        return false;
+    }
+
+    pacer->period_ns = 1000000000LL / frequency;
+    pacer->spin_margin_ns = linux_calibrate_spin_margin ();
+    printf ("frame period %ld us, spin margin %ld us\n", (long) (pacer->period_ns / 1000),
+            (long) (pacer->spin_margin_ns / 1000));
+
+    pacer->frame_begin_ns = linux_get_monotonic_ns ();
+    pacer->next_deadline_ns = pacer->frame_begin_ns + pacer->period_ns;
+    linux_arm_frame_timer (pacer);
+    return true;
+}
+
+/* only when the sound device has a clock: from then on linux_finish_frame follows it */
+static void
+linux_use_audio_clock (linux_frame_pacer * pacer, linux_sound_output * sound_output)
+{
+    pacer->audio_clock = sound_output;
+    pacer->frame_sample_count = (real64) sound_output->samples_per_second * pacer->period_ns / 1e9;
+    pacer->audio_clock_locked = false;
+    printf ("frame clock: audio, %.2f device frames per frame\n", pacer->frame_sample_count);
+}
+
+/* moves the next deadline a quarter of the way towards when the device will play its frame, and
+   never by more than a 32nd of a period at once: a clock read that jitters by a period barely
+   moves the frames, while any steady drift between the two crystals is soaked up for good */
+static void
+linux_follow_audio_clock (linux_frame_pacer * pacer)
+{
+    uint64 position;
+    int64 time_ns;
+    if (!linux_get_audio_clock (pacer->audio_clock, &position, &time_ns)) {
+        pacer->audio_clock_locked = false;
+        return;
+    }
+
+    real64 ns_per_sample = 1e9 / (real64) pacer->audio_clock->samples_per_second;
+    pacer->next_frame_position += pacer->frame_sample_count;
+    int64 audio_deadline_ns = time_ns + (int64) ((pacer->next_frame_position - (real64) position)
+                                                 * ns_per_sample);
+    int64 error_ns = audio_deadline_ns - pacer->next_deadline_ns;
+    if (!pacer->audio_clock_locked || error_ns > pacer->period_ns / 2
+        || error_ns < -pacer->period_ns / 2) {
+        /* the first read, or the position jumped because an xrun threw away what was queued:
+           keep the deadline, and measure which device frame goes with it again */
+        pacer->next_frame_position = (real64) position
+            + (real64) (pacer->next_deadline_ns - time_ns) / ns_per_sample;
+        if (pacer->audio_clock_locked) {
+            pacer->audio_clock_resync_count++;
         }
-        row += pitch;
+        pacer->audio_clock_locked = true;
+        error_ns = 0;
+    }
+    pacer->audio_clock_error_ns = error_ns;
+
+    int64 max_step_ns = pacer->period_ns / 32;
+    int64 step_ns = error_ns / 4;
+    step_ns = (step_ns > max_step_ns) ? max_step_ns : step_ns;
+    step_ns = (step_ns < -max_step_ns) ? -max_step_ns : step_ns;
+    pacer->next_deadline_ns += step_ns;
+}
+
+/* called once the timerfd fired: burn the remaining margin on the clock, then move on to the
+   next deadline. returns the duration of the frame that just ended; how many deadlines that
+   missed is counted from the duration, the same way on every platform */
+static int64
+linux_finish_frame (linux_frame_pacer * pacer)
+{
+    /* EAGAIN only means we got here before the timer fired, and the spin below still holds the
+       frame to its deadline */
+    uint64 expirations;
+    if (read (pacer->timer_fd, &expirations, sizeof (expirations)) < 0 && errno != EAGAIN) {
+        fprintf (stderr, "timerfd read - %s\n", strerror (errno));
+    }
+
+    int64 now_ns = linux_get_monotonic_ns ();
+    while (now_ns < pacer->next_deadline_ns) {
+        now_ns = linux_get_monotonic_ns ();
+    }
+
+    int64 frame_ns = now_ns - pacer->frame_begin_ns;
+    pacer->frame_begin_ns = now_ns;
+    pacer->next_deadline_ns += pacer->period_ns;
+    if (pacer->next_deadline_ns <= now_ns) {
+        /* we are more than a whole frame late: do not try to catch up with a burst of frames,
+           start a fresh schedule from now */
+        pacer->next_deadline_ns = now_ns + pacer->period_ns;
+        pacer->audio_clock_locked = false;
+    }
+    if (pacer->audio_clock) {
+        linux_follow_audio_clock (pacer);
+    }
+    linux_arm_frame_timer (pacer);
+
+    return frame_ns;
+}
+
+static void
+linux_print_telemetry (frame_telemetry * telemetry, linux_frame_pacer * pacer)
+{
+    char report[1024];
+    telemetry_format_report (telemetry, report, sizeof (report));
+    fputs (report, stdout);
+    if (pacer->audio_clock) {
+        printf ("frame clock: %s, %+.3fms off the audio clock, %u resyncs\n",
+                pacer->audio_clock_locked ? "locked to audio" : "waiting for audio",
+                pacer->audio_clock_error_ns / 1e6, pacer->audio_clock_resync_count);
     }
-    return XCreateImage (display, visual, 24 /* depth */ ,
-                         ZPixmap /* format */ , 0 /* offset */ ,
-                         (char *) buffer, width, height, 32 /* bitmap pad */ ,
-                         0);
+    fflush (stdout);
+}
+
+#if HANDMADE_PROFILE
+/* prints what the timed blocks recorded since the last call, then starts over. only call this
+   between frames, the worker threads must be idle */
+static void
+linux_print_profile (uint64 frame_count)
+{
+    static char report[16384];
+    debug_format_report (report, sizeof (report), frame_count);
+    fputs (report, stdout);
+    fflush (stdout);
+    debug_reset_records ();
 }
 
+/* owns the trace file: streams the per-thread event rings out while a capture is running */
+static void *
+linux_trace_writer_thread_proc (void *arg)
+{
+    for (;;) {
+        debug_update_trace ();
+        struct timespec wait = { 0, 10 * 1000000 };
+        nanosleep (&wait, 0);
+    }
+    return 0;
+}
+
+static void
+linux_start_trace_writer (void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create (&thread, &attr, linux_trace_writer_thread_proc, 0);
+    pthread_attr_destroy (&attr);
+}
+
+static void
+linux_toggle_trace (void)
+{
+    if (GlobalDebugState.trace_requested) {
+        debug_stop_trace ();
+        printf ("trace capture stopped\n");
+    }
+    else {
+        debug_start_trace ("handmade_trace.json");
+        printf ("trace capture started, writing handmade_trace.json\n");
+    }
+}
+
+/* the writer may still be draining the rings when we want to exit */
+static void
+linux_finish_trace (void)
+{
+    debug_stop_trace ();
+    while (debug_trace_in_progress ()) {
+        struct timespec wait = { 0, 1000000 };
+        nanosleep (&wait, 0);
+    }
+}
+#endif
+
 int
-main_loop (Display * display, Window win, GC context, int width, int height, int frequency)
+main_loop (Display * display, Window win, GC context, game_memory * memory,
+           linux_sound_output * sound_output, int width, int height, int frequency)
 {
     Visual *visual = DefaultVisual (display, DefaultScreen (display));
 
-    if (visual->class != TrueColor) {
+    /* Xlib renames the field to c_class when compiled as C++, which we are since we pull in
+       the game layer */
+    if (visual->c_class != TrueColor) {
         fprintf (stderr, "Cannot handle not true color visual\n");
         return 1;
     }
 
     int x_offset = 0;
     int y_offset = 0;
+    int tone_hz = 256;
 
-    XImage *image = create_image (display, visual, 0, width, height,
-                                  x_offset, y_offset);
-    XPutImage (display, win, context, image, 0, 0, 0, 0, width, height);
-    XDestroyImage (image);
-    XFlush (display);
+    /* prefer MIT-SHM; without it (remote display, Xvfb without SHM) we keep using XPutImage */
+    linux_offscreen_buffer buffer = { };
+    if (XShmQueryExtension (display)) {
+        buffer.use_shm = true;
+        buffer.shm_completion_type = XShmGetEventBase (display) + ShmCompletion;
+    }
+    else {
+        fprintf (stdout, "MIT-SHM not available, falling back to XPutImage\n");
+    }
+    if (!linux_resize_offscreen_buffer (display, visual, &buffer, width, height)) {
+        return 1;
+    }
 
-    struct timeval interval_tv;    // this is how long the frame should last. This is a
-    // constant
-    interval_tv.tv_sec = 0;
-    interval_tv.tv_usec = 1000000 / frequency;
+    render_and_present (display, win, context, memory, &buffer, x_offset, y_offset, true);
 
-    struct timeval begin_tv;    // this is the beginning of the frame
-    gettimeofday (&begin_tv, 0);
+    linux_frame_pacer pacer = { };
+    if (!linux_init_frame_pacer (&pacer, frequency)) {
+        return 1;
+    }
 
-    // int padding = 500;
-    struct timeval timeout_tv;    // this is the duration select has to wait. this duration
-    // can be updated within the loop
-    timeout_tv.tv_sec = interval_tv.tv_sec;
-    timeout_tv.tv_usec = interval_tv.tv_usec;    // - padding; // 50 usec
+    const char *frame_clock = getenv ("HANDMADE_FRAME_CLOCK");
+    if (frame_clock && strcmp (frame_clock, "audio") == 0) {
+        if (sound_output->thread_running && sound_output->has_clock) {
+            linux_use_audio_clock (&pacer, sound_output);
+        }
+        else {
+            fprintf (stderr, "frame clock: no audio clock, pacing from CLOCK_MONOTONIC\n");
+        }
+    }
 
-    struct timeval end_tv;        // this is the expected end of the frame
-    timeradd (&begin_tv, &interval_tv, &end_tv);    /* end = begin + interval */
+    static frame_telemetry telemetry;
+    telemetry_init (&telemetry, pacer.period_ns);
+
+#if HANDMADE_PROFILE
+    GlobalDebugState.cpu_timer_frequency = linux_estimate_cpu_timer_frequency ();
+    uint64 profile_begin_frame = 0;
+    printf ("cpu timer %.3f GHz\n", (real64) GlobalDebugState.cpu_timer_frequency / 1e9);
+    linux_start_trace_writer ();
+#endif
+
+    /* sound is fed by its own thread, from its own loop (see alsa.c) */
+    enum
+    {
+        MAIN_EVENT_X11,
+        MAIN_EVENT_FRAME,
+    };
+    linux_event_loop loop;
+    if (!linux_init_event_loop (&loop)
+        || !linux_add_event_fd (&loop, ConnectionNumber (display), EPOLLIN, MAIN_EVENT_X11, 0)
+        || !linux_add_event_fd (&loop, pacer.timer_fd, EPOLLIN, MAIN_EVENT_FRAME, 0)) {
+        return 1;
+    }
 
     XEvent ev;
-    int x11_fd = ConnectionNumber (display);
-    fd_set in_fds;
-    uint64_t frame_index = 0;
     while (1) {
-        FD_ZERO (&in_fds);
-        FD_SET (x11_fd, &in_fds);
-
-        int rc = select (x11_fd + 1, &in_fds, 0, 0, &timeout_tv);
-        if (rc < 0) {
-            fprintf (stdout, "select return <0\n");
+        /* Xlib may already have read events into its queue, in which case the fd would not
+           become readable again, so only block when nothing is pending */
+        int count = linux_wait_for_events (&loop, XPending (display) ? 0 : -1);
+        if (count < 0) {
+            fprintf (stdout, "epoll_wait failed: %s\n", strerror (errno));
             return 1;
         }
-        if (rc == 0) {            /* timeout */
-            /* we consider the frame is over... increase the frame count */
-            frame_index++;
-
-            /* see if we overshot the frame: compare now with the time we initially expected to
-               finish the frame */
-            struct timeval now;
-            gettimeofday (&now, 0);
-            // if (timercmp (&now, &end_tv, >)) {
-            // show_timeval ("begin", &begin_tv);
-            // show_timeval ("end", &end_tv);
-            // show_timeval ("now", &now);
-            // struct timeval diff;
-            // timersub (&now, &end_tv, &diff);
-            // show_timeval ("overshot", &diff);
-            // return 1;
-            // }
-            // else {
-            // show_timeval ("begin", &begin_tv);
-            // show_timeval ("end", &now);
-            /* we did not overshoot, so measure the actual frame duration */
-            struct timeval diff;
-            timersub (&now, &begin_tv, &diff);
-            // For debug, print frame rate
-            // fprintf (stdout, "frame %ld duration: %ld.%06ld | FPS: %lf\n",
-            // frame_index, diff.tv_sec, diff.tv_usec,
-            // 1000000.0f / (float) diff.tv_usec);
-            /* reset the select timeout to a whole frame length. */
-            timeout_tv.tv_sec = interval_tv.tv_sec;
-            timeout_tv.tv_usec = interval_tv.tv_usec;    // - padding;
-            /* reset the beginning of the frame timestamp */
-            begin_tv.tv_sec = now.tv_sec;
-            begin_tv.tv_usec = now.tv_usec;
-            /* reset the expected end of the frame */
-            timeradd (&begin_tv, &interval_tv, &end_tv);
-            // }
+        bool frame_due = false;
+        for (int event_index = 0; event_index < count; event_index++) {
+            if (linux_event_tag (loop.ready + event_index) == MAIN_EVENT_FRAME) {
+                frame_due = true;
+            }
         }
-        else {                    /* rc > 0, an event was received */
-
-            fprintf (stdout, "event fired!\n");
-            while (XPending (display)) {
-                XNextEvent (display, &ev);
-                switch (ev.type) {
-                    case KeymapNotify:
-                    {
-                        XRefreshKeyboardMapping (&ev.xmapping);
-                    } break;
-                    case KeyPress:
-                        break;    /* ignore these */
-                    case KeyRelease:
-                    {
-                        char string[25];
-                        KeySym keysym;
-                        int len = XLookupString (&ev.xkey, string, 25, &keysym,
-                                                 NULL);
-                        bool redraw = false;
-                        switch (keysym) {
-                            case XK_Left:
-                            {
-                                x_offset += 5;
-                                redraw = true;
-                            } break;
-                            case XK_Right:
-                            {
-                                x_offset -= 5;
-                                redraw = true;
-                            } break;
-                            case XK_Up:
-                            {
-                                y_offset += 5;
-                                redraw = true;
-                            } break;
-                            case XK_Down:
-                            {
-                                y_offset -= 5;
-                                redraw = true;
-                            } break;
-                            default:
-                                break;
-                        }
-                        if (redraw) {
-                            XImage *image = create_image (display, visual, 0,
-                                                          width, height,
-                                                          x_offset,
-                                                          y_offset);
-                            XPutImage (display, win, context, image, 0, 0, 0, 0, width, height);
-                            XDestroyImage (image);
-                            XFlush (display);
-                        }
-                    } break;
-                    case Expose:
-                    {
-                        fprintf (stdout, "Expose\n");
-                        XImage *image = create_image (display, visual, 0, width,
-                                                      height, x_offset,
-                                                      y_offset);
-                        XPutImage (display, win, context, image, 0, 0, 0, 0, width, height);
-                        XDestroyImage (image);
-                        XFlush (display);
-                    } break;
-                    case ConfigureNotify:
-                    {
-                        fprintf (stdout, "ConfigureNotify\n");
-                        if (width != ev.xconfigure.width || height != ev.xconfigure.height) {
-                            width = ev.xconfigure.width;
-                            height = ev.xconfigure.height;
-                            XClearWindow (display, ev.xany.window);
-                            printf ("Size changed to: %d by %d\n", width, height);
-                        }
-                    } break;
-                    case ButtonPress:
-                    {
-                        XCloseDisplay (display);
-                        return 0;
+
+        while (XPending (display)) {
+            XNextEvent (display, &ev);
+            switch (ev.type) {
+                case KeymapNotify:
+                {
+                    XRefreshKeyboardMapping (&ev.xmapping);
+                } break;
+                case KeyPress:
+                    break;        /* ignore these */
+                case KeyRelease:
+                {
+                    char string[25];
+                    KeySym keysym;
+                    int len = XLookupString (&ev.xkey, string, 25, &keysym,
+                                             NULL);
+                    switch (keysym) {
+                        case XK_Left:
+                        {
+                            x_offset += 5;
+                        } break;
+                        case XK_Right:
+                        {
+                            x_offset -= 5;
+                        } break;
+                        case XK_Up:
+                        {
+                            y_offset += 5;
+                        } break;
+                        case XK_Down:
+                        {
+                            y_offset -= 5;
+                        } break;
+                        case XK_F8:
+                        {
+                            linux_print_telemetry (&telemetry, &pacer);
+                        } break;
+#if HANDMADE_PROFILE
+                        case XK_F9:
+                        {
+                            linux_print_profile (telemetry.frame_count - profile_begin_frame);
+                            profile_begin_frame = telemetry.frame_count;
+                        } break;
+                        case XK_F10:
+                        {
+                            linux_toggle_trace ();
+                        } break;
+#endif
+                        default:
+                            break;
+                    }
+                } break;
+                case Expose:
+                {
+                    fprintf (stdout, "Expose\n");
+                    /* the window contents are gone, so this always sends everything */
+                    render_and_present (display, win, context, memory, &buffer,
+                                        x_offset, y_offset, true);
+                } break;
+                case ConfigureNotify:
+                {
+                    fprintf (stdout, "ConfigureNotify\n");
+                    if (width != ev.xconfigure.width || height != ev.xconfigure.height) {
+                        width = ev.xconfigure.width;
+                        height = ev.xconfigure.height;
+                        /* the only place the offscreen buffer is reallocated */
+                        linux_wait_for_present (display, &buffer);
+                        linux_resize_offscreen_buffer (display, visual, &buffer, width, height);
+                        XClearWindow (display, ev.xany.window);
+                        printf ("Size changed to: %d by %d\n", width, height);
                     }
+                } break;
+                case ButtonPress:
+                {
+                    linux_print_telemetry (&telemetry, &pacer);
+#if HANDMADE_PROFILE
+                    linux_print_profile (telemetry.frame_count - profile_begin_frame);
+                    linux_finish_trace ();
+#endif
+                    linux_wait_for_present (display, &buffer);
+                    linux_free_offscreen_buffer (display, &buffer);
+                    linux_free_sound (sound_output);
+                    linux_free_event_loop (&loop);
+                    XCloseDisplay (display);
+                    return 0;
                 }
-            }                    /* pending events */
-
-            /* we're done processing events, so readjust the timeout */
-            fprintf (stdout, "adjusting timeout\n");
-            struct timeval now;
-            gettimeofday (&now, 0);
-            long t1 = now.tv_sec * 1000000 + now.tv_usec;
-            long t2 = end_tv.tv_sec * 1000000 + end_tv.tv_usec;
-            if (t1 > t2) {
-                fprintf (stdout, "missed frame\n");
-                timeout_tv.tv_sec = interval_tv.tv_sec;
-                timeout_tv.tv_usec = interval_tv.tv_usec;    // - padding; // 50
-                // usec
-            }
-            else {
-                timersub (&end_tv, &now, &timeout_tv);
-                // timeout_tv.tv_usec -= 50;
+                default:
+                {
+                    if (ev.type == buffer.shm_completion_type) {
+                        buffer.present_pending = false;
+                    }
+                } break;
             }
-        }                        /* event was received */
+        }                        /* pending events */
+
+        if (frame_due) {
+            /* the frame is over: wait out its last microseconds, then produce the next one */
+            int64 frame_ns = linux_finish_frame (&pacer);
+            uint64 missed = telemetry_missed_deadlines (frame_ns, telemetry.target_frame_ns);
+            telemetry_record_frame (&telemetry, frame_ns, missed);
+
+            TIMED_BLOCK ("frame");
+
+            render_and_present (display, win, context, memory, &buffer, x_offset, y_offset,
+                                false);
+            linux_fill_sound (sound_output, memory, tone_hz, &telemetry);
+        }
     }
 }
 
@@ -410,5 +875,42 @@ main (int argc, char **argv)
     int monitor_refresh_hz = 60;
     int game_update_hz = monitor_refresh_hz / 2;
     float target_seconds_per_frame = 1.0f / (float) game_update_hz;
-    return main_loop (display, win, context, width, height, game_update_hz);
+
+    /* the render queue fans the frame out over every core; the main thread only waits at the
+       end of game_update_render for the tiles to complete */
+    static platform_work_queue render_queue;
+    uint32 worker_thread_count = linux_get_worker_thread_count ();
+    linux_make_queue (&render_queue, worker_thread_count);
+
+    game_memory memory = { };
+    memory.render_queue = worker_thread_count ? &render_queue : 0;
+    memory.add_entry = linux_add_entry;
+    memory.complete_all_work = linux_complete_all_work;
+    memory.map_file = linux_map_file;
+    memory.unmap_file = linux_unmap_file;
+    memory.prefetch_file = linux_prefetch_file;
+    /* no music unless HANDMADE_MUSIC names a 16-bit PCM WAV file to loop */
+    memory.music_file_name = getenv ("HANDMADE_MUSIC");
+
+    /* anonymous mappings come back zeroed, as the game layer expects */
+    memory.permanent_storage_size = Megabytes (64);
+    memory.transient_storage_size = Megabytes (64);
+    uint64 total_size = memory.permanent_storage_size + memory.transient_storage_size;
+    memory.permanent_storage = mmap (0, total_size, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory.permanent_storage == MAP_FAILED) {
+        fprintf (stderr, "mmap - could not allocate game memory\n");
+        return 1;
+    }
+    memory.transient_storage = (uint8 *) memory.permanent_storage + memory.permanent_storage_size;
+
+    /* without a sound device we just run silent. the game mixes at 48kHz whatever the device
+       runs at, so HANDMADE_SOUND_DEVICE can name a hw: device directly, or null, null:realtime
+       or wav:<path> on a machine without a sound card */
+    const char *sound_device = getenv ("HANDMADE_SOUND_DEVICE");
+    static linux_sound_output sound_output;
+    linux_init_sound (&sound_output, sound_device ? sound_device : "default", 48000);
+
+    return main_loop (display, win, context, &memory, &sound_output, width, height,
+                      game_update_hz);
 }
@@ -1,25 +1,3 @@
-#include <stdint.h>
-
-#define internal static 
-#define local_persist static 
-#define global_variable static
-
-#define Pi32 3.14159265359f
-
-typedef int8_t int8;
-typedef int16_t int16;
-typedef int32_t int32;
-typedef int64_t int64;
-typedef int32 bool32;
-
-typedef uint8_t uint8;
-typedef uint16_t uint16;
-typedef uint32_t uint32;
-typedef uint64_t uint64;
-
-typedef float real32;
-typedef double real64;
-
 #include "handmade.h"
 #include "handmade.cc"
 
@@ -28,9 +6,6 @@ typedef double real64;
 #include <xinput.h>
 #include <dsound.h>
 
-// TODO(casey): Implement sine ourselves
-#include <math.h>
-
 struct win32_offscreen_buffer
 {
     // NOTE(casey): Pixels are alwasy 32-bits wide, Memory Order BB GG RR XX
@@ -51,6 +26,10 @@ struct win32_window_dimension
 global_variable bool32 GlobalRunning;
 global_variable win32_offscreen_buffer GlobalBackbuffer;
 global_variable LPDIRECTSOUNDBUFFER GlobalSecondaryBuffer;
+global_variable frame_telemetry GlobalTelemetry;
+#if HANDMADE_PROFILE
+global_variable uint64 GlobalProfileBeginFrame;
+#endif
 
 // NOTE(casey): XInputGetState
 #define X_INPUT_GET_STATE(name) DWORD WINAPI name(DWORD dwUserIndex, XINPUT_STATE *pState)
@@ -75,6 +54,18 @@ global_variable x_input_set_state *XInputSetState_ = XInputSetStateStub;
 #define DIRECT_SOUND_CREATE(name) HRESULT WINAPI name(LPCGUID pcGuidDevice, LPDIRECTSOUND *ppDS, LPUNKNOWN pUnkOuter)
 typedef DIRECT_SOUND_CREATE(direct_sound_create);
 
+// NOTE: PrefetchVirtualMemory only exists from Windows 8 on, so it is looked
+// up at startup; without it a prefetch does nothing and the pages come in
+// when they are first touched.
+struct win32_memory_range_entry
+{
+    PVOID VirtualAddress;
+    SIZE_T NumberOfBytes;
+};
+#define PREFETCH_VIRTUAL_MEMORY(name) BOOL WINAPI name(HANDLE hProcess, ULONG_PTR NumberOfEntries, win32_memory_range_entry *VirtualAddresses, ULONG Flags)
+typedef PREFETCH_VIRTUAL_MEMORY(prefetch_virtual_memory);
+global_variable prefetch_virtual_memory *PrefetchVirtualMemory_;
+
 void *
 PlatformLoadFile(char *FileName)
 {
@@ -82,6 +73,77 @@ PlatformLoadFile(char *FileName)
     return(0);
 }
 
+internal void
+Win32OutputTelemetry(void)
+{
+    char Report[1024];
+    telemetry_format_report(&GlobalTelemetry, Report, sizeof(Report));
+    OutputDebugStringA(Report);
+}
+
+#if HANDMADE_PROFILE
+internal uint64
+Win32EstimateCPUTimerFrequency(void)
+{
+    // NOTE: Count how many TSC ticks go by against the performance counter.
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+
+    LARGE_INTEGER BeginCounter;
+    QueryPerformanceCounter(&BeginCounter);
+    uint64 BeginCycles = read_cpu_timer();
+
+    Sleep(50);
+
+    uint64 EndCycles = read_cpu_timer();
+    LARGE_INTEGER EndCounter;
+    QueryPerformanceCounter(&EndCounter);
+
+    return((uint64)(((real64)(EndCycles - BeginCycles)*(real64)Frequency.QuadPart) /
+                    (real64)(EndCounter.QuadPart - BeginCounter.QuadPart)));
+}
+
+// NOTE: Reports what the timed blocks recorded since the last call, then
+// starts over. Only call this between frames, with the workers idle.
+internal void
+Win32OutputProfile(void)
+{
+    local_persist char Report[16384];
+    debug_format_report(Report, sizeof(Report),
+                        GlobalTelemetry.frame_count - GlobalProfileBeginFrame);
+    OutputDebugStringA(Report);
+    debug_reset_records();
+    GlobalProfileBeginFrame = GlobalTelemetry.frame_count;
+}
+
+// NOTE: Owns the trace file, streaming the per-thread event rings out while
+// a capture is running.
+DWORD WINAPI
+Win32TraceWriterThreadProc(LPVOID lpParameter)
+{
+    for(;;)
+    {
+        debug_update_trace();
+        Sleep(10);
+    }
+}
+
+internal void
+Win32ToggleTrace(void)
+{
+    if(GlobalDebugState.trace_requested)
+    {
+        debug_stop_trace();
+        OutputDebugStringA("trace capture stopped\n");
+    }
+    else
+    {
+        debug_start_trace("handmade_trace.json");
+        OutputDebugStringA("trace capture started, writing handmade_trace.json\n");
+    }
+}
+#endif
+
 internal void
 Win32LoadXInput(void)    
 {
@@ -116,6 +178,59 @@ Win32LoadXInput(void)
     }
 }
 
+// NOTE: The view keeps the file and the mapping object alive by itself, so
+// both handles are closed straight away.
+internal platform_mapped_file
+Win32MapFile(char const *FileName)
+{
+    platform_mapped_file Result = {};
+    HANDLE FileHandle = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, 0);
+    if(FileHandle != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER FileSize;
+        if(GetFileSizeEx(FileHandle, &FileSize) && FileSize.QuadPart)
+        {
+            HANDLE MappingHandle = CreateFileMappingA(FileHandle, 0, PAGE_READONLY, 0, 0, 0);
+            if(MappingHandle)
+            {
+                Result.contents = MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+                if(Result.contents)
+                {
+                    Result.size = (uint64)FileSize.QuadPart;
+                }
+                CloseHandle(MappingHandle);
+            }
+        }
+        CloseHandle(FileHandle);
+    }
+
+    return(Result);
+}
+
+internal void
+Win32UnmapFile(platform_mapped_file *File)
+{
+    if(File->contents)
+    {
+        UnmapViewOfFile(File->contents);
+    }
+    File->contents = 0;
+    File->size = 0;
+}
+
+internal void
+Win32PrefetchFile(platform_mapped_file *File, uint64 Offset, uint64 Size)
+{
+    if(PrefetchVirtualMemory_ && File->contents && (Offset < File->size))
+    {
+        win32_memory_range_entry Range;
+        Range.VirtualAddress = (uint8 *)File->contents + Offset;
+        Range.NumberOfBytes = (SIZE_T)((Size > File->size - Offset) ? (File->size - Offset) : Size);
+        PrefetchVirtualMemory_(GetCurrentProcess(), 1, &Range, 0);
+    }
+}
+
 internal void
 Win32InitDSound(HWND Window, int32 SamplesPerSecond, int32 BufferSize)
 {
@@ -263,6 +378,44 @@ Win32DisplayBufferInWindow(win32_offscreen_buffer *Buffer,
                   DIB_RGB_COLORS, SRCCOPY);
 }
 
+internal void
+Win32DisplayDirtyRects(win32_offscreen_buffer *Buffer, game_offscreen_buffer *GameBuffer,
+                       HDC DeviceContext, int WindowWidth, int WindowHeight)
+{
+    TIMED_FUNCTION();
+
+    if((WindowWidth == Buffer->Width) && (WindowHeight == Buffer->Height))
+    {
+        // NOTE: Unstretched, so only the regions the renderer touched need
+        // to go over the bus.
+        for(int RectIndex = 0;
+            RectIndex < GameBuffer->dirty_rect_count;
+            ++RectIndex)
+        {
+            game_rect *Rect = GameBuffer->dirty_rects + RectIndex;
+            int Width = Rect->max_x - Rect->min_x;
+            int Height = Rect->max_y - Rect->min_y;
+
+            // NOTE: StretchDIBits measures the source Y from the bottom of
+            // the image even for our top-down DIB.
+            StretchDIBits(DeviceContext,
+                          Rect->min_x, Rect->min_y, Width, Height,
+                          Rect->min_x, Buffer->Height - Rect->max_y, Width, Height,
+                          Buffer->Memory,
+                          &Buffer->Info,
+                          DIB_RGB_COLORS, SRCCOPY);
+        }
+    }
+    else if(GameBuffer->dirty_rect_count)
+    {
+        // NOTE: Stretched, the whole buffer goes over on purpose. Each rect
+        // stretched on its own rounds its edges differently from one
+        // stretch of the buffer, which leaves seams where old and new
+        // pixels meet; a window at the buffer size takes the path above.
+        Win32DisplayBufferInWindow(Buffer, DeviceContext, WindowWidth, WindowHeight);
+    }
+}
+
 internal LRESULT CALLBACK
 Win32MainWindowCallback(HWND Window,
                         UINT Message,
@@ -346,6 +499,29 @@ Win32MainWindowCallback(HWND Window,
                 else if(VKCode == VK_SPACE)
                 {
                 }
+                else if(VKCode == VK_F8)
+                {
+                    if(IsDown)
+                    {
+                        Win32OutputTelemetry();
+                    }
+                }
+#if HANDMADE_PROFILE
+                else if(VKCode == VK_F9)
+                {
+                    if(IsDown)
+                    {
+                        Win32OutputProfile();
+                    }
+                }
+                else if(VKCode == VK_F10)
+                {
+                    if(IsDown)
+                    {
+                        Win32ToggleTrace();
+                    }
+                }
+#endif
             }
 
             bool32 AltKeyWasDown = (LParam & (1 << 29));
@@ -375,70 +551,195 @@ Win32MainWindowCallback(HWND Window,
     return(Result);
 }
 
+struct platform_work_queue_entry
+{
+    platform_work_queue_callback *Callback;
+    void *Data;
+};
+
+struct platform_work_queue
+{
+    uint32 volatile CompletionGoal;
+    uint32 volatile CompletionCount;
+
+    uint32 volatile NextEntryToWrite;
+    uint32 volatile NextEntryToRead;
+    HANDLE SemaphoreHandle;
+
+    platform_work_queue_entry Entries[512];
+};
+
+internal void
+Win32AddEntry(platform_work_queue *Queue, platform_work_queue_callback *Callback, void *Data)
+{
+    // NOTE: Only the main thread adds entries, so the write index is not interlocked.
+    uint32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+    Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+    platform_work_queue_entry *Entry = Queue->Entries + Queue->NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    ++Queue->CompletionGoal;
+    _WriteBarrier();
+    Queue->NextEntryToWrite = NewNextEntryToWrite;
+    ReleaseSemaphore(Queue->SemaphoreHandle, 1, 0);
+}
+
+internal bool32
+Win32DoNextWorkQueueEntry(platform_work_queue *Queue)
+{
+    bool32 WeShouldSleep = false;
+
+    uint32 OriginalNextEntryToRead = Queue->NextEntryToRead;
+    uint32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+    if(OriginalNextEntryToRead != Queue->NextEntryToWrite)
+    {
+        uint32 Index = InterlockedCompareExchange((LONG volatile *)&Queue->NextEntryToRead,
+                                                  NewNextEntryToRead,
+                                                  OriginalNextEntryToRead);
+        if(Index == OriginalNextEntryToRead)
+        {
+            platform_work_queue_entry Entry = Queue->Entries[Index];
+            Entry.Callback(Queue, Entry.Data);
+            InterlockedIncrement((LONG volatile *)&Queue->CompletionCount);
+        }
+    }
+    else
+    {
+        WeShouldSleep = true;
+    }
+
+    return(WeShouldSleep);
+}
+
+// NOTE: This is the frame barrier; the main thread helps drain the queue
+// until every entry added this frame has completed.
+internal void
+Win32CompleteAllWork(platform_work_queue *Queue)
+{
+    while(Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        Win32DoNextWorkQueueEntry(Queue);
+    }
+
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
+
+DWORD WINAPI
+ThreadProc(LPVOID lpParameter)
+{
+    platform_work_queue *Queue = (platform_work_queue *)lpParameter;
+
+    for(;;)
+    {
+        if(Win32DoNextWorkQueueEntry(Queue))
+        {
+            WaitForSingleObjectEx(Queue->SemaphoreHandle, INFINITE, FALSE);
+        }
+    }
+}
+
+internal void
+Win32MakeQueue(platform_work_queue *Queue, uint32 ThreadCount)
+{
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+
+    Queue->NextEntryToWrite = 0;
+    Queue->NextEntryToRead = 0;
+
+    uint32 InitialCount = 0;
+    Queue->SemaphoreHandle = CreateSemaphoreEx(0,
+                                               InitialCount,
+                                               ThreadCount,
+                                               0, 0, SEMAPHORE_ALL_ACCESS);
+    for(uint32 ThreadIndex = 0;
+        ThreadIndex < ThreadCount;
+        ++ThreadIndex)
+    {
+        DWORD ThreadID;
+        HANDLE ThreadHandle = CreateThread(0, 0, ThreadProc, Queue, 0, &ThreadID);
+        CloseHandle(ThreadHandle);
+    }
+}
+
 struct win32_sound_output
 {
     int SamplesPerSecond;
     int ToneHz;
-    int16 ToneVolume;
     uint32 RunningSampleIndex;
-    int WavePeriod;
     int BytesPerSample;
     int SecondaryBufferSize;
-    real32 tSine;
-    int LatencySampleCount;
+    audio_latency_controller Latency;
+    audio_xrun_log Xruns;
 };
 
 internal void
-Win32FillSoundBuffer(win32_sound_output *SoundOutput, DWORD ByteToLock, DWORD BytesToWrite)
+Win32ClearBuffer(win32_sound_output *SoundOutput)
 {
-    // TODO(casey): More strenuous test!
     VOID *Region1;
     DWORD Region1Size;
     VOID *Region2;
     DWORD Region2Size;
-    if(SUCCEEDED(GlobalSecondaryBuffer->Lock(ByteToLock, BytesToWrite,
+    if(SUCCEEDED(GlobalSecondaryBuffer->Lock(0, SoundOutput->SecondaryBufferSize,
                                              &Region1, &Region1Size,
                                              &Region2, &Region2Size,
                                              0)))
     {
         // TODO(casey): assert that Region1Size/Region2Size is valid
-
-        // TODO(casey): Collapse these two loops
-        DWORD Region1SampleCount = Region1Size/SoundOutput->BytesPerSample;
-        int16 *SampleOut = (int16 *)Region1;
-        for(DWORD SampleIndex = 0;
-            SampleIndex < Region1SampleCount;
-            ++SampleIndex)
+        uint8 *DestSample = (uint8 *)Region1;
+        for(DWORD ByteIndex = 0;
+            ByteIndex < Region1Size;
+            ++ByteIndex)
         {
-            // TODO(casey): Draw this out for people
-            real32 SineValue = sinf(SoundOutput->tSine);
-            int16 SampleValue = (int16)(SineValue * SoundOutput->ToneVolume);
-            *SampleOut++ = SampleValue;
-            *SampleOut++ = SampleValue;
-
-            SoundOutput->tSine += 2.0f*Pi32*1.0f/(real32)SoundOutput->WavePeriod;
-            ++SoundOutput->RunningSampleIndex;
+            *DestSample++ = 0;
         }
 
-        DWORD Region2SampleCount = Region2Size/SoundOutput->BytesPerSample;
-        SampleOut = (int16 *)Region2;
-        for(DWORD SampleIndex = 0;
-            SampleIndex < Region2SampleCount;
-            ++SampleIndex)
+        DestSample = (uint8 *)Region2;
+        for(DWORD ByteIndex = 0;
+            ByteIndex < Region2Size;
+            ++ByteIndex)
         {
-            real32 SineValue = sinf(SoundOutput->tSine);
-            int16 SampleValue = (int16)(SineValue * SoundOutput->ToneVolume);
-            *SampleOut++ = SampleValue;
-            *SampleOut++ = SampleValue;
-
-            SoundOutput->tSine += 2.0f*Pi32*1.0f/(real32)SoundOutput->WavePeriod;
-            ++SoundOutput->RunningSampleIndex;
+            *DestSample++ = 0;
         }
 
         GlobalSecondaryBuffer->Unlock(Region1, Region1Size, Region2, Region2Size);
     }
 }
 
+// NOTE: The game mixes straight into the locked buffer, across the wrap
+// if there is one.
+internal void
+Win32FillSoundBuffer(win32_sound_output *SoundOutput, DWORD ByteToLock, DWORD BytesToWrite,
+                     game_memory *GameMemory)
+{
+    TIMED_FUNCTION();
+
+    VOID *Region1;
+    DWORD Region1Size;
+    VOID *Region2;
+    DWORD Region2Size;
+    if(SUCCEEDED(GlobalSecondaryBuffer->Lock(ByteToLock, BytesToWrite,
+                                             &Region1, &Region1Size,
+                                             &Region2, &Region2Size,
+                                             0)))
+    {
+        Assert(((Region1Size % SoundOutput->BytesPerSample) == 0) &&
+               ((Region2Size % SoundOutput->BytesPerSample) == 0));
+
+        game_sound_output_buffer SoundBuffer = {};
+        SoundBuffer.samples_per_second = SoundOutput->SamplesPerSecond;
+        SoundBuffer.regions.samples[0] = (int16 *)Region1;
+        SoundBuffer.regions.sample_count[0] = Region1Size / SoundOutput->BytesPerSample;
+        SoundBuffer.regions.samples[1] = (int16 *)Region2;
+        SoundBuffer.regions.sample_count[1] = Region2Size / SoundOutput->BytesPerSample;
+        game_get_sound_samples(GameMemory, &SoundBuffer, SoundOutput->ToneHz);
+        SoundOutput->RunningSampleIndex += get_audio_ring_sample_count(&SoundBuffer.regions);
+
+        GlobalSecondaryBuffer->Unlock(Region1, Region1Size, Region2, Region2Size);
+    }
+}
+
 int CALLBACK
 WinMain(HINSTANCE Instance,
         HINSTANCE PrevInstance,
@@ -450,6 +751,56 @@ WinMain(HINSTANCE Instance,
     int64 PerfCountFrequency = PerfCountFrequencyResult.QuadPart;
 
     Win32LoadXInput();
+    PrefetchVirtualMemory_ = (prefetch_virtual_memory *)
+        GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+
+#if HANDMADE_PROFILE
+    GlobalDebugState.cpu_timer_frequency = Win32EstimateCPUTimerFrequency();
+    HANDLE TraceWriterThread = CreateThread(0, 0, Win32TraceWriterThreadProc, 0, 0, 0);
+    CloseHandle(TraceWriterThread);
+#endif
+
+    // NOTE: One worker per logical core besides the main thread, which
+    // joins in when it waits for the frame to complete.
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    uint32 WorkerThreadCount = (SystemInfo.dwNumberOfProcessors > 1) ?
+        (SystemInfo.dwNumberOfProcessors - 1) : 0;
+    platform_work_queue RenderQueue = {};
+    Win32MakeQueue(&RenderQueue, WorkerThreadCount);
+
+    game_memory GameMemory = {};
+    GameMemory.render_queue = WorkerThreadCount ? &RenderQueue : 0;
+    GameMemory.add_entry = Win32AddEntry;
+    GameMemory.complete_all_work = Win32CompleteAllWork;
+    GameMemory.map_file = Win32MapFile;
+    GameMemory.unmap_file = Win32UnmapFile;
+    GameMemory.prefetch_file = Win32PrefetchFile;
+
+    // NOTE: No music unless HANDMADE_MUSIC names a 16-bit PCM WAV file to
+    // loop.
+    char MusicFileName[MAX_PATH];
+    DWORD MusicFileNameLength = GetEnvironmentVariableA("HANDMADE_MUSIC", MusicFileName,
+                                                        sizeof(MusicFileName));
+    if(MusicFileNameLength && (MusicFileNameLength < sizeof(MusicFileName)))
+    {
+        GameMemory.music_file_name = MusicFileName;
+    }
+
+    GameMemory.permanent_storage_size = Megabytes(64);
+    GameMemory.transient_storage_size = Megabytes(64);
+
+    // NOTE: VirtualAlloc hands back zeroed pages, as the game layer expects.
+    uint64 TotalSize = GameMemory.permanent_storage_size + GameMemory.transient_storage_size;
+    GameMemory.permanent_storage = VirtualAlloc(0, (size_t)TotalSize,
+                                                MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    GameMemory.transient_storage = ((uint8 *)GameMemory.permanent_storage +
+                                    GameMemory.permanent_storage_size);
+    if(!GameMemory.permanent_storage)
+    {
+        // TODO(casey): Logging
+        return(1);
+    }
     
     WNDCLASSA WindowClass = {};
 
@@ -484,6 +835,16 @@ WinMain(HINSTANCE Instance,
             // are not sharing it with anyone.
             HDC DeviceContext = GetDC(Window);
 
+            // NOTE: Deadlines are the monitor's refresh periods. VREFRESH
+            // reports 0 or 1 when the driver does not know, and then we
+            // assume 60Hz.
+            int MonitorRefreshHz = GetDeviceCaps(DeviceContext, VREFRESH);
+            if(MonitorRefreshHz <= 1)
+            {
+                MonitorRefreshHz = 60;
+            }
+            telemetry_init(&GlobalTelemetry, 1000000000LL / MonitorRefreshHz);
+
             // NOTE(casey): Graphics test
             int XOffset = 0;
             int YOffset = 0;
@@ -493,13 +854,16 @@ WinMain(HINSTANCE Instance,
             // TODO(casey): Make this like sixty seconds?
             SoundOutput.SamplesPerSecond = 48000;
             SoundOutput.ToneHz = 256;
-            SoundOutput.ToneVolume = 3000;
-            SoundOutput.WavePeriod = SoundOutput.SamplesPerSecond/SoundOutput.ToneHz;
             SoundOutput.BytesPerSample = sizeof(int16)*2;
             SoundOutput.SecondaryBufferSize = SoundOutput.SamplesPerSecond*SoundOutput.BytesPerSample;
-            SoundOutput.LatencySampleCount = SoundOutput.SamplesPerSecond / 15;
+            // NOTE: Starts at the old fixed SamplesPerSecond/15 and never
+            // goes below one 60Hz frame.
+            audio_latency_init(&SoundOutput.Latency, SoundOutput.SamplesPerSecond,
+                               SoundOutput.SamplesPerSecond / 60,
+                               SoundOutput.SamplesPerSecond / 4,
+                               SoundOutput.SamplesPerSecond / 15);
             Win32InitDSound(Window, SoundOutput.SamplesPerSecond, SoundOutput.SecondaryBufferSize);
-            Win32FillSoundBuffer(&SoundOutput, 0, SoundOutput.LatencySampleCount*SoundOutput.BytesPerSample);
+            Win32ClearBuffer(&SoundOutput);
             GlobalSecondaryBuffer->Play(0, 0, DSBPLAY_LOOPING);
 
             GlobalRunning = true;
@@ -522,6 +886,8 @@ WinMain(HINSTANCE Instance,
                     DispatchMessageA(&Message);
                 }
 
+                TIMED_BLOCK("frame");
+
                 // TODO(casey): Should we poll this more frequently
                 for (DWORD ControllerIndex = 0;
                      ControllerIndex < XUSER_MAX_COUNT;
@@ -558,7 +924,6 @@ WinMain(HINSTANCE Instance,
                         YOffset += StickY / 4096;
 
                         SoundOutput.ToneHz = 512 + (int)(256.0f*((real32)StickY / 30000.0f));
-                        SoundOutput.WavePeriod = SoundOutput.SamplesPerSecond/SoundOutput.ToneHz;
                     }
                     else
                     {
@@ -566,42 +931,71 @@ WinMain(HINSTANCE Instance,
                     }
                 }
 
-                game_offscreen_buffer buffer = {};
-                buffer.memory = GlobalBackbuffer.Memory;
-                buffer.width = GlobalBackbuffer.Width; 
-                buffer.height = GlobalBackbuffer.Height;
-                buffer.pitch = GlobalBackbuffer.Pitch; 
-                game_update_render(&buffer, XOffset, YOffset);
-
-                // NOTE(casey): DirectSound output test
+                // NOTE(casey): Compute how much sound to write and where
+                DWORD ByteToLock = 0;
+                DWORD BytesToWrite = 0;
                 DWORD PlayCursor;
                 DWORD WriteCursor;
+                bool32 SoundIsValid = false;
+                // TODO(casey): Tighten up sound logic so that we know where we should be
+                // writing to and can anticipate the time spent in the game update.
                 if(SUCCEEDED(GlobalSecondaryBuffer->GetCurrentPosition(&PlayCursor, &WriteCursor)))
                 {
-                    DWORD ByteToLock = ((SoundOutput.RunningSampleIndex*SoundOutput.BytesPerSample) %
-                                        SoundOutput.SecondaryBufferSize);
-
-                    DWORD TargetCursor =
-                        ((PlayCursor +
-                          (SoundOutput.LatencySampleCount*SoundOutput.BytesPerSample)) %
-                         SoundOutput.SecondaryBufferSize);
-                    DWORD BytesToWrite;
-                    if(ByteToLock > TargetCursor)
+                    // NOTE: Everything that comes back ran_dry is the
+                    // game being late: we write from this thread, once a
+                    // frame.
+                    DWORD BufferSampleCount = (SoundOutput.SecondaryBufferSize /
+                                               SoundOutput.BytesPerSample);
+                    audio_ring_position Position =
+                        measure_audio_ring(BufferSampleCount, SoundOutput.RunningSampleIndex,
+                                           PlayCursor / SoundOutput.BytesPerSample,
+                                           WriteCursor / SoundOutput.BytesPerSample,
+                                           SoundOutput.Latency.max_sample_count);
+                    if(Position.ran_dry)
                     {
-                        BytesToWrite = (SoundOutput.SecondaryBufferSize - ByteToLock);
-                        BytesToWrite += TargetCursor;
+                        LARGE_INTEGER XrunCounter;
+                        QueryPerformanceCounter(&XrunCounter);
+                        int64 XrunNS = (int64)(((real64)XrunCounter.QuadPart*1000000000.0) /
+                                               (real64)PerfCountFrequency);
+                        telemetry_record_xrun(&SoundOutput.Xruns, AudioXrunCause_late_frame,
+                                              XrunNS);
                     }
-                    else
+                    SoundOutput.RunningSampleIndex = Position.running_sample_index;
+                    ByteToLock = Position.write_index*SoundOutput.BytesPerSample;
+
+                    int32 DelaySampleCount = (int32)Position.delay_sample_count;
+                    int32 TargetSampleCount =
+                        audio_latency_update(&SoundOutput.Latency, DelaySampleCount,
+                                             telemetry_underrun_count(&SoundOutput.Xruns));
+                    telemetry_record_audio(&GlobalTelemetry, SoundOutput.SamplesPerSecond,
+                                           TargetSampleCount, DelaySampleCount,
+                                           &SoundOutput.Xruns);
+
+                    if(TargetSampleCount > DelaySampleCount)
                     {
-                        BytesToWrite = TargetCursor - ByteToLock;
+                        BytesToWrite = ((TargetSampleCount - DelaySampleCount)*
+                                        SoundOutput.BytesPerSample);
                     }
 
-                    Win32FillSoundBuffer(&SoundOutput, ByteToLock, BytesToWrite);
+                    SoundIsValid = true;
+                }
+
+                game_offscreen_buffer buffer = {};
+                buffer.memory = GlobalBackbuffer.Memory;
+                buffer.width = GlobalBackbuffer.Width; 
+                buffer.height = GlobalBackbuffer.Height;
+                buffer.pitch = GlobalBackbuffer.Pitch; 
+                game_update_render(&GameMemory, &buffer, XOffset, YOffset);
+
+                // NOTE(casey): DirectSound output test
+                if(SoundIsValid && BytesToWrite)
+                {
+                    Win32FillSoundBuffer(&SoundOutput, ByteToLock, BytesToWrite, &GameMemory);
                 }
                 
                 win32_window_dimension Dimension = Win32GetWindowDimension(Window);
-                Win32DisplayBufferInWindow(&GlobalBackbuffer, DeviceContext,
-                                           Dimension.Width, Dimension.Height);
+                Win32DisplayDirtyRects(&GlobalBackbuffer, &buffer, DeviceContext,
+                                       Dimension.Width, Dimension.Height);
 
                 uint64 EndCycleCount = __rdtsc();
                 
@@ -610,19 +1004,28 @@ WinMain(HINSTANCE Instance,
 
                 uint64 CyclesElapsed = EndCycleCount - LastCycleCount;
                 int64 CounterElapsed = EndCounter.QuadPart - LastCounter.QuadPart;
-                real64 MSPerFrame = (((1000.0f*(real64)CounterElapsed) / (real64)PerfCountFrequency));
-                real64 FPS = (real64)PerfCountFrequency / (real64)CounterElapsed;
-                real64 MCPF = ((real64)CyclesElapsed / (1000.0f * 1000.0f));
-
-#if 0
-                char Buffer[256];
-                sprintf(Buffer, "%.02fms/f,  %.02ff/s,  %.02fmc/f\n", MSPerFrame, FPS, MCPF);
-                OutputDebugStringA(Buffer);
-#endif
-                
+                int64 FrameNS = (int64)(((real64)CounterElapsed*1000000000.0) /
+                                        (real64)PerfCountFrequency);
+
+                telemetry_record_frame(&GlobalTelemetry, FrameNS,
+                                       telemetry_missed_deadlines(FrameNS,
+                                                                  GlobalTelemetry.target_frame_ns));
+
                 LastCounter = EndCounter;
                 LastCycleCount = EndCycleCount;
             }
+
+            Win32OutputTelemetry();
+#if HANDMADE_PROFILE
+            Win32OutputProfile();
+
+            // NOTE: The writer may still be draining the rings.
+            debug_stop_trace();
+            while(debug_trace_in_progress())
+            {
+                Sleep(1);
+            }
+#endif
         }
         else
         {